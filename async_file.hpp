@@ -0,0 +1,839 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#if defined(__linux__) && !defined(JMP_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define JMP_IO_URING 1
+#endif
+#endif
+#endif
+
+#include "memory.hpp"
+#include "instrumentation.hpp"
+
+namespace JMP
+{
+	namespace detail {
+#if defined(JMP_IO_URING)
+		// Minimal io_uring submission/completion ring over the raw system calls, enough to
+		// keep a few writes in flight without depending on liburing.
+		class IoUring {
+		private:
+			int _fd = -1;
+			void* _sq_ring = nullptr;
+			void* _cq_ring = nullptr;
+			size_t _sq_ring_size = 0;
+			size_t _cq_ring_size = 0;
+			io_uring_sqe* _sqes = nullptr;
+			size_t _sqes_size = 0;
+			unsigned* _sq_tail = nullptr;
+			unsigned* _sq_mask = nullptr;
+			unsigned* _sq_array = nullptr;
+			unsigned* _cq_head = nullptr;
+			unsigned* _cq_tail = nullptr;
+			unsigned* _cq_mask = nullptr;
+			io_uring_cqe* _cqes = nullptr;
+
+			static uint8_t* _at(void* ring, uint32_t offset) noexcept
+			{
+				return static_cast<uint8_t*>(ring) + offset;
+			}
+
+		public:
+			IoUring() = default;
+			IoUring(IoUring const&) = delete;
+			IoUring& operator=(IoUring const&) = delete;
+
+			~IoUring()
+			{
+				if (_sqes) ::munmap(_sqes, _sqes_size);
+				if (_cq_ring && _cq_ring != _sq_ring) ::munmap(_cq_ring, _cq_ring_size);
+				if (_sq_ring) ::munmap(_sq_ring, _sq_ring_size);
+				if (_fd >= 0) ::close(_fd);
+			}
+
+			// Returns false if io_uring is unavailable, e.g. on old kernels or when blocked by a sandbox.
+			bool init(unsigned entries) noexcept
+			{
+				io_uring_params params;
+				std::memset(&params, 0, sizeof(params));
+				_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+				if (_fd < 0) {
+					return false;
+				}
+
+				_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+				if (single_mmap) {
+					_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+				}
+
+				void* sq = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+				if (sq == MAP_FAILED) {
+					return false;
+				}
+				_sq_ring = sq;
+				if (single_mmap) {
+					_cq_ring = _sq_ring;
+				}
+				else {
+					void* cq = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+					if (cq == MAP_FAILED) {
+						return false;
+					}
+					_cq_ring = cq;
+				}
+				_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+				void* sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+				if (sqes == MAP_FAILED) {
+					return false;
+				}
+				_sqes = static_cast<io_uring_sqe*>(sqes);
+
+				_sq_tail = reinterpret_cast<unsigned*>(_at(_sq_ring, params.sq_off.tail));
+				_sq_mask = reinterpret_cast<unsigned*>(_at(_sq_ring, params.sq_off.ring_mask));
+				_sq_array = reinterpret_cast<unsigned*>(_at(_sq_ring, params.sq_off.array));
+				_cq_head = reinterpret_cast<unsigned*>(_at(_cq_ring, params.cq_off.head));
+				_cq_tail = reinterpret_cast<unsigned*>(_at(_cq_ring, params.cq_off.tail));
+				_cq_mask = reinterpret_cast<unsigned*>(_at(_cq_ring, params.cq_off.ring_mask));
+				_cqes = reinterpret_cast<io_uring_cqe*>(_at(_cq_ring, params.cq_off.cqes));
+				return true;
+			}
+
+			// Queues a vectored write and submits it. The iovec must stay alive until completion.
+			// The caller keeps at most as many writes in flight as the ring has entries.
+			bool write(int fd, iovec const* io, uint64_t offset, uint64_t user_data) noexcept
+			{
+				const unsigned tail = *_sq_tail;
+				const unsigned index = tail & *_sq_mask;
+				io_uring_sqe& sqe = _sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				// IORING_OP_WRITEV is available on every kernel with io_uring.
+				sqe.opcode = IORING_OP_WRITEV;
+				sqe.fd = fd;
+				sqe.addr = reinterpret_cast<uint64_t>(io);
+				sqe.len = 1;
+				sqe.off = offset;
+				sqe.user_data = user_data;
+				_sq_array[index] = index;
+				__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+				for (;;) {
+					const long submitted = ::syscall(__NR_io_uring_enter, _fd, 1, 0, 0, nullptr, 0);
+					if (submitted >= 0) {
+						return submitted == 1;
+					}
+					if (errno != EINTR) {
+						return false;
+					}
+				}
+			}
+
+			// Waits for the next completion. result is the number of bytes written or -errno.
+			bool wait(uint64_t& user_data, int32_t& result) noexcept
+			{
+				for (;;) {
+					const unsigned head = *_cq_head;
+					if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+						io_uring_cqe const& cqe = _cqes[head & *_cq_mask];
+						user_data = cqe.user_data;
+						result = cqe.res;
+						__atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+						return true;
+					}
+					if (::syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+						return false;
+					}
+				}
+			}
+		};
+#endif
+
+		// Positional file writes with completion in submission order. submit() may start the
+		// write and return before it finishes; complete() then waits for the oldest one.
+#ifdef _WIN32
+		class AsyncFileBackend {
+		private:
+			struct Slot {
+				OVERLAPPED overlapped;
+				uint8_t const* data;
+				size_t bytes;
+				uint64_t offset;
+				HANDLE handle;
+			};
+
+			HANDLE _file = INVALID_HANDLE_VALUE;
+			// Without FILE_FLAG_NO_BUFFERING, opened by the first write that is not sector
+			// aligned. Every write after it goes through this handle, since the offsets that
+			// follow are not aligned either.
+			HANDLE _buffered = INVALID_HANDLE_VALUE;
+			std::string _filename;
+			std::vector<Slot> _slots;
+			std::deque<size_t> _pending;
+			bool _direct = false;
+
+			HANDLE _handle() const noexcept
+			{
+				return _buffered != INVALID_HANDLE_VALUE ? _buffered : _file;
+			}
+
+			bool _start(Slot& slot) noexcept
+			{
+				slot.handle = _handle();
+				ResetEvent(slot.overlapped.hEvent);
+				slot.overlapped.Offset = static_cast<DWORD>(slot.offset);
+				slot.overlapped.OffsetHigh = static_cast<DWORD>(slot.offset >> 32);
+				const DWORD bytes = static_cast<DWORD>(std::min<size_t>(slot.bytes, 0x40000000));
+				return WriteFile(slot.handle, slot.data, bytes, nullptr, &slot.overlapped) || GetLastError() == ERROR_IO_PENDING;
+			}
+
+		public:
+			AsyncFileBackend() = default;
+			AsyncFileBackend(AsyncFileBackend const&) = delete;
+			AsyncFileBackend& operator=(AsyncFileBackend const&) = delete;
+
+			~AsyncFileBackend()
+			{
+				close();
+			}
+
+			static char const* name() noexcept { return "overlapped"; }
+
+			bool open(std::string const& filename, size_t slots, bool direct) noexcept
+			{
+				const DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+				_file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, flags, nullptr);
+				if (_file == INVALID_HANDLE_VALUE) {
+					return false;
+				}
+				_filename = filename;
+				_direct = direct;
+				_slots.resize(slots);
+				for (Slot& slot : _slots) {
+					std::memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+					slot.handle = _file;
+					slot.overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+					if (slot.overlapped.hEvent == nullptr) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			bool submit(size_t slot, uint8_t const* data, size_t bytes, uint64_t offset) noexcept
+			{
+				Slot& s = _slots[slot];
+				s.data = data;
+				s.bytes = bytes;
+				s.offset = offset;
+				if (!_start(s)) {
+					return false;
+				}
+				_pending.push_back(slot);
+				return true;
+			}
+
+			bool complete(size_t& slot) noexcept
+			{
+				slot = _pending.front();
+				_pending.pop_front();
+				Slot& s = _slots[slot];
+				for (;;) {
+					DWORD written = 0;
+					if (!GetOverlappedResult(s.handle, &s.overlapped, &written, TRUE) || written == 0) {
+						return false;
+					}
+					if (written >= s.bytes) {
+						return true;
+					}
+					s.data += written;
+					s.bytes -= written;
+					s.offset += written;
+					if (!_start(s)) {
+						return false;
+					}
+				}
+			}
+
+			// Synchronous write that has no alignment requirements, used for the tail of the
+			// file and for patching headers once all submitted writes have completed. With
+			// direct I/O it moves the file to the buffered handle for good.
+			bool write_sync(uint8_t const* data, size_t bytes, uint64_t offset) noexcept
+			{
+				if (_direct && _buffered == INVALID_HANDLE_VALUE) {
+					_buffered = CreateFileA(_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+						FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+					if (_buffered == INVALID_HANDLE_VALUE) {
+						return false;
+					}
+				}
+				const HANDLE handle = _handle();
+				OVERLAPPED overlapped;
+				std::memset(&overlapped, 0, sizeof(overlapped));
+				overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+				if (overlapped.hEvent == nullptr) {
+					return false;
+				}
+				bool ok = true;
+				while (ok && bytes > 0) {
+					ResetEvent(overlapped.hEvent);
+					overlapped.Offset = static_cast<DWORD>(offset);
+					overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+					DWORD written = 0;
+					const DWORD chunk = static_cast<DWORD>(std::min<size_t>(bytes, 0x40000000));
+					ok = (WriteFile(handle, data, chunk, nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING)
+						&& GetOverlappedResult(handle, &overlapped, &written, TRUE) && written > 0;
+					data += written;
+					bytes -= written;
+					offset += written;
+				}
+				CloseHandle(overlapped.hEvent);
+				return ok;
+			}
+
+			bool close() noexcept
+			{
+				bool ok = true;
+				if (_buffered != INVALID_HANDLE_VALUE) {
+					ok = CloseHandle(_buffered) && ok;
+					_buffered = INVALID_HANDLE_VALUE;
+				}
+				if (_file != INVALID_HANDLE_VALUE) {
+					ok = CloseHandle(_file) && ok;
+					_file = INVALID_HANDLE_VALUE;
+				}
+				for (Slot& slot : _slots) {
+					if (slot.overlapped.hEvent) CloseHandle(slot.overlapped.hEvent);
+				}
+				_slots.clear();
+				return ok;
+			}
+		};
+#else
+		class AsyncFileBackend {
+		private:
+			struct Slot {
+				iovec io;
+				uint64_t offset;
+			};
+
+			int _fd = -1;
+			std::vector<Slot> _slots;
+			std::deque<std::pair<size_t, bool>> _completed;
+			bool _direct = false;
+#if defined(JMP_IO_URING)
+			std::unique_ptr<IoUring> _ring;
+#endif
+
+			bool _pwrite(uint8_t const* data, size_t bytes, uint64_t offset) noexcept
+			{
+				while (bytes > 0) {
+					const ssize_t written = ::pwrite(_fd, data, bytes, static_cast<off_t>(offset));
+					if (written < 0 && errno == EINTR) {
+						continue;
+					}
+					if (written <= 0) {
+						return false;
+					}
+					data += written;
+					bytes -= static_cast<size_t>(written);
+					offset += static_cast<uint64_t>(written);
+				}
+				return true;
+			}
+
+			void _set_direct(bool direct) noexcept
+			{
+				if (direct == _direct) {
+					return;
+				}
+#if defined(O_DIRECT)
+				const int flags = ::fcntl(_fd, F_GETFL);
+				if (flags >= 0) {
+					::fcntl(_fd, F_SETFL, direct ? flags | O_DIRECT : flags & ~O_DIRECT);
+				}
+#elif defined(F_NOCACHE)
+				::fcntl(_fd, F_NOCACHE, direct ? 1 : 0);
+#endif
+				_direct = direct;
+			}
+
+		public:
+			AsyncFileBackend() = default;
+			AsyncFileBackend(AsyncFileBackend const&) = delete;
+			AsyncFileBackend& operator=(AsyncFileBackend const&) = delete;
+
+			~AsyncFileBackend()
+			{
+				close();
+			}
+
+			char const* name() const noexcept
+			{
+#if defined(JMP_IO_URING)
+				if (_ring) {
+					return "io_uring";
+				}
+#endif
+				return "pwrite";
+			}
+
+			bool open(std::string const& filename, size_t slots, bool direct) noexcept
+			{
+				const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+				_fd = -1;
+#if defined(O_DIRECT)
+				if (direct) {
+					// Not every file system supports O_DIRECT, fall back to buffered I/O.
+					_fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+					_direct = _fd >= 0;
+				}
+#endif
+				if (_fd < 0) {
+					_fd = ::open(filename.c_str(), flags, 0644);
+					if (_fd < 0) {
+						return false;
+					}
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+					if (direct) {
+						_set_direct(true);
+					}
+#endif
+				}
+				_slots.resize(slots);
+#if defined(JMP_IO_URING)
+				_ring.reset(new (std::nothrow) IoUring());
+				if (_ring && !_ring->init(static_cast<unsigned>(slots))) {
+					_ring.reset();
+				}
+#endif
+				return true;
+			}
+
+			bool submit(size_t slot, uint8_t const* data, size_t bytes, uint64_t offset) noexcept
+			{
+				Slot& s = _slots[slot];
+				s.io.iov_base = const_cast<uint8_t*>(data);
+				s.io.iov_len = bytes;
+				s.offset = offset;
+#if defined(JMP_IO_URING)
+				if (_ring) {
+					return _ring->write(_fd, &s.io, offset, slot);
+				}
+#endif
+				_completed.emplace_back(slot, _pwrite(data, bytes, offset));
+				return true;
+			}
+
+			bool complete(size_t& slot) noexcept
+			{
+#if defined(JMP_IO_URING)
+				if (_ring) {
+					for (;;) {
+						uint64_t user_data = 0;
+						int32_t result = 0;
+						if (!_ring->wait(user_data, result)) {
+							return false;
+						}
+						slot = static_cast<size_t>(user_data);
+						Slot& s = _slots[slot];
+						if (result == -EINTR || result == -EAGAIN) {
+							result = 0;
+						}
+						else if (result <= 0) {
+							return false;
+						}
+						if (static_cast<size_t>(result) >= s.io.iov_len) {
+							return true;
+						}
+						// Short write: resubmit the rest.
+						s.io.iov_base = static_cast<uint8_t*>(s.io.iov_base) + result;
+						s.io.iov_len -= static_cast<size_t>(result);
+						s.offset += static_cast<uint64_t>(result);
+						if (!_ring->write(_fd, &s.io, s.offset, slot)) {
+							return false;
+						}
+					}
+				}
+#endif
+				slot = _completed.front().first;
+				const bool ok = _completed.front().second;
+				_completed.pop_front();
+				return ok;
+			}
+
+			// Synchronous write that has no alignment requirements, used for the tail of the
+			// file and for patching headers once all submitted writes have completed.
+			bool write_sync(uint8_t const* data, size_t bytes, uint64_t offset) noexcept
+			{
+				_set_direct(false);
+				return _pwrite(data, bytes, offset);
+			}
+
+			bool close() noexcept
+			{
+#if defined(JMP_IO_URING)
+				_ring.reset();
+#endif
+				bool ok = true;
+				if (_fd >= 0) {
+					ok = ::close(_fd) == 0;
+					_fd = -1;
+				}
+				return ok;
+			}
+		};
+#endif
+	}
+
+	// Buffer pool configuration of AsyncFile.
+	struct AsyncFileOptions {
+		// Size of each buffer, rounded up to a multiple of AsyncFile::DIRECT_ALIGNMENT.
+		size_t buffer_size = size_t(1) << 20;
+		// Number of buffers in the pool, at least 2.
+		size_t buffer_count = 4;
+		// Bypass the page cache (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING).
+		bool direct = false;
+	};
+
+	// Appends to a file from one producer thread while a background thread does the I/O.
+	// Data is copied into fixed-size aligned buffers from a pool and full buffers are handed
+	// to the I/O thread, so the producer only waits on the disk when every buffer is in
+	// flight. On Linux the writes go through io_uring with all queued buffers in flight at
+	// once, on Windows through overlapped I/O, and elsewhere (or when io_uring is not
+	// available at run time) through pwrite(). With Options::direct the page cache is
+	// bypassed where the file system supports it.
+	// Usage:
+	//
+	// AsyncFile file("out.bin", { 4 << 20, 4, true });
+	// while (render(block)) {
+	//     file.write(block.data(), block.size());
+	// }
+	// file.close(); // Or let the destructor close the file.
+	//
+	class AsyncFile {
+	public:
+		// Buffer and write alignment required by direct I/O.
+		static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+		using Options = AsyncFileOptions;
+
+	private:
+		static constexpr size_t NO_SLOT = ~size_t(0);
+
+		struct Job {
+			size_t slot;
+			size_t bytes;
+			uint64_t offset;
+		};
+
+		// Shared with the I/O thread, kept behind a pointer so that AsyncFile can be moved.
+		struct State {
+			detail::AsyncFileBackend backend;
+			size_t buffer_size = 0;
+			size_t buffer_count = 0;
+			std::vector<uint8_t, AlignedAllocator<uint8_t, DIRECT_ALIGNMENT>> buffers;
+
+			std::mutex mutex;
+			std::condition_variable work;
+			std::condition_variable released;
+			std::vector<size_t> free;
+			std::deque<Job> queue;
+			bool stop = false;
+			std::atomic<bool> failed{ false };
+			std::thread thread;
+
+			// Producer side, only touched by the writing thread.
+			size_t slot = NO_SLOT;
+			size_t fill = 0;
+			uint64_t offset = 0;
+
+			uint8_t* buffer(size_t i) noexcept { return buffers.data() + i * buffer_size; }
+
+			// Marks the file failed and wakes the producer, whose waits all end on failure.
+			void fail()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					failed = true;
+				}
+				released.notify_all();
+			}
+
+			void release(size_t i)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					free.push_back(i);
+				}
+				released.notify_one();
+			}
+
+			void io_loop()
+			{
+				size_t in_flight = 0;
+				for (;;) {
+					std::deque<Job> jobs;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						if (in_flight == 0) {
+							work.wait(lock, [&] { return !queue.empty() || stop; });
+							if (queue.empty()) {
+								return;
+							}
+						}
+						jobs.swap(queue);
+					}
+
+					for (Job const& job : jobs) {
+						if (!failed.load(std::memory_order_relaxed) && backend.submit(job.slot, buffer(job.slot), job.bytes, job.offset)) {
+							++in_flight;
+						}
+						else {
+							fail();
+							release(job.slot);
+						}
+					}
+
+					if (in_flight > 0) {
+						size_t done = NO_SLOT;
+						if (!backend.complete(done)) {
+							fail();
+						}
+						--in_flight;
+						if (done != NO_SLOT) {
+							release(done);
+						}
+					}
+				}
+			}
+		};
+
+		std::unique_ptr<State> _state;
+
+		// Takes a buffer from the pool, waiting for one to be released if all are in flight.
+		bool _acquire()
+		{
+			State& s = *_state;
+			std::unique_lock<std::mutex> lock(s.mutex);
+			if (s.free.empty() && !s.failed.load()) {
+				JMP_TRACE_SCOPE("AsyncFile::wait_buffer");
+				JMP_TIME_SCOPE(IO_STALL_NANOSECONDS);
+				s.released.wait(lock, [&] { return !s.free.empty() || s.failed.load(); });
+			}
+			if (s.failed) {
+				return false;
+			}
+			s.slot = s.free.back();
+			s.free.pop_back();
+			s.fill = 0;
+			return true;
+		}
+
+		void _submit()
+		{
+			State& s = *_state;
+			{
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.queue.push_back({ s.slot, s.fill, s.offset });
+			}
+			s.work.notify_one();
+			s.offset += s.fill;
+			s.slot = NO_SLOT;
+			s.fill = 0;
+		}
+
+		// Waits until every submitted buffer is back in the pool, or until a write fails.
+		bool _drain()
+		{
+			State& s = *_state;
+			const size_t held = s.slot != NO_SLOT ? 1 : 0;
+			std::unique_lock<std::mutex> lock(s.mutex);
+			JMP_TIME_SCOPE(IO_STALL_NANOSECONDS);
+			s.released.wait(lock, [&] { return s.free.size() + held == s.buffer_count || s.failed.load(); });
+			return !s.failed;
+		}
+
+	public:
+		AsyncFile() = default;
+		AsyncFile(AsyncFile const&) = delete;
+		AsyncFile& operator=(AsyncFile const&) = delete;
+		AsyncFile(AsyncFile&&) = default;
+
+		AsyncFile& operator=(AsyncFile&& other)
+		{
+			if (this != &other) {
+				close();
+				_state = std::move(other._state);
+			}
+			return *this;
+		}
+
+		// Creates or truncates the file. Check is_open() before writing.
+		explicit AsyncFile(std::string const& filename, Options options = {})
+		{
+			open(filename, options);
+		}
+
+		~AsyncFile()
+		{
+			close();
+		}
+
+		bool open(std::string const& filename, Options options = {})
+		{
+			close();
+			std::unique_ptr<State> state(new State());
+			state->buffer_size = std::max<size_t>(1, (options.buffer_size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT) * DIRECT_ALIGNMENT;
+			state->buffer_count = std::max<size_t>(2, options.buffer_count);
+			if (!state->backend.open(filename, state->buffer_count, options.direct)) {
+				return false;
+			}
+			state->buffers.resize(state->buffer_size * state->buffer_count);
+			for (size_t i = state->buffer_count; i-- > 0;) {
+				state->free.push_back(i);
+			}
+			State* s = state.get();
+			state->thread = std::thread([s] { s->io_loop(); });
+			_state = std::move(state);
+			return true;
+		}
+
+		bool is_open() const noexcept
+		{
+			return _state != nullptr;
+		}
+
+		// False once any write has failed.
+		bool good() const noexcept
+		{
+			return _state && !_state->failed;
+		}
+
+		// Name of the I/O backend in use: "io_uring", "overlapped" or "pwrite".
+		char const* backend() const noexcept
+		{
+			return _state ? _state->backend.name() : "";
+		}
+
+		// Number of bytes appended so far.
+		uint64_t size() const noexcept
+		{
+			return _state ? _state->offset + _state->fill : 0;
+		}
+
+		// Appends bytes to the file. Blocks while all buffers are in flight.
+		bool write(void const* data, size_t bytes)
+		{
+			if (!good()) {
+				return false;
+			}
+			State& s = *_state;
+			uint8_t const* p = static_cast<uint8_t const*>(data);
+			while (bytes > 0) {
+				if (s.slot == NO_SLOT && !_acquire()) {
+					return false;
+				}
+				const size_t n = std::min(bytes, s.buffer_size - s.fill);
+				std::memcpy(s.buffer(s.slot) + s.fill, p, n);
+				s.fill += n;
+				p += n;
+				bytes -= n;
+				if (s.fill == s.buffer_size) {
+					_submit();
+				}
+			}
+			return true;
+		}
+
+		// Writes everything appended so far and waits for it to complete. A partial buffer
+		// is written synchronously, which turns off direct I/O for the rest of the file.
+		bool flush()
+		{
+			if (!is_open()) {
+				return false;
+			}
+			State& s = *_state;
+			if (!_drain()) {
+				return false;
+			}
+			if (s.slot != NO_SLOT) {
+				if (s.fill > 0 && !s.backend.write_sync(s.buffer(s.slot), s.fill, s.offset)) {
+					s.fail();
+				}
+				s.offset += s.fill;
+				s.fill = 0;
+				s.release(s.slot);
+				s.slot = NO_SLOT;
+			}
+			return good();
+		}
+
+		// Overwrites bytes that were already appended, e.g. to patch a header. Flushes first.
+		bool write_at(uint64_t offset, void const* data, size_t bytes)
+		{
+			if (!flush()) {
+				return false;
+			}
+			if (!_state->backend.write_sync(static_cast<uint8_t const*>(data), bytes, offset)) {
+				_state->fail();
+			}
+			return good();
+		}
+
+		// Flushes, stops the I/O thread and closes the file. Returns false if any write
+		// failed. Calling close() more than once is harmless.
+		bool close()
+		{
+			if (!_state) {
+				return false;
+			}
+			bool ok = flush();
+			{
+				std::lock_guard<std::mutex> lock(_state->mutex);
+				_state->stop = true;
+			}
+			_state->work.notify_one();
+			_state->thread.join();
+			ok = _state->backend.close() && ok && !_state->failed;
+			_state.reset();
+			return ok;
+		}
+	};
+}
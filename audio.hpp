@@ -6,9 +6,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
 #include <limits>
 #include <random>
+#include <type_traits>
+
+#include "simd.hpp"
+#include "endians.hpp"
+#include "instrumentation.hpp"
 
 namespace JMP
 {
@@ -22,12 +31,12 @@ namespace JMP
 
 		const sample_t SPEED_OF_SOUND = 343;
 
-		// Convert float samples to integer PCM (without dithering).
+		// Convert float samples to integer PCM (without dithering, see Audio::Ditherer in dither.hpp).
 		template <typename T>
 		T convert(float sample) = delete;
 
 		template <>
-		int16_t convert(float sample)
+		inline int16_t convert(float sample)
 		{
 			sample *= std::numeric_limits<int16_t>::max();
 
@@ -41,7 +50,7 @@ namespace JMP
 		}
 
 		template <>
-		uint8_t convert(float sample)
+		inline uint8_t convert(float sample)
 		{
 			sample = sample * 0.5f + 0.5f;
 			sample *= std::numeric_limits<uint8_t>::max();
@@ -55,5 +64,601 @@ namespace JMP
 
 			return (uint8_t)sample;
 		}
+
+		// Convert a block of float samples to 16-bit PCM (without dithering).
+		// The output is identical to calling convert<int16_t>() on each sample.
+		inline void convert(float const* input, int16_t* output, size_t count) noexcept
+		{
+			JMP_TRACE_SCOPE("Audio::convert");
+			JMP_COUNT(BYTES_CONVERTED, count * sizeof(float));
+			size_t i = 0;
+
+#if defined(JMP_SIMD_AVX2)
+			{
+				const __m256 scale = _mm256_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m256 hi = _mm256_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m256 lo = _mm256_set1_ps(std::numeric_limits<int16_t>::min());
+				for (; i + 16 <= count; i += 16) {
+					__m256 a = _mm256_mul_ps(_mm256_loadu_ps(input + i), scale);
+					__m256 b = _mm256_mul_ps(_mm256_loadu_ps(input + i + 8), scale);
+					a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+					b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+					// Packing works within 128-bit lanes, so restore the sample order afterwards.
+					__m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+					packed = _mm256_permute4x64_epi64(packed, 0xD8);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+				}
+			}
+#endif
+
+#if defined(JMP_SIMD_SSE2)
+			{
+				const __m128 scale = _mm_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m128 hi = _mm_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m128 lo = _mm_set1_ps(std::numeric_limits<int16_t>::min());
+				for (; i + 8 <= count; i += 8) {
+					__m128 a = _mm_mul_ps(_mm_loadu_ps(input + i), scale);
+					__m128 b = _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale);
+					a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+					b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+					const __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+				}
+			}
+#elif defined(JMP_SIMD_NEON)
+			{
+				const float32x4_t scale = vdupq_n_f32(std::numeric_limits<int16_t>::max());
+				const float32x4_t hi = vdupq_n_f32(std::numeric_limits<int16_t>::max());
+				const float32x4_t lo = vdupq_n_f32(std::numeric_limits<int16_t>::min());
+				for (; i + 8 <= count; i += 8) {
+					float32x4_t a = vmulq_f32(vld1q_f32(input + i), scale);
+					float32x4_t b = vmulq_f32(vld1q_f32(input + i + 4), scale);
+					a = vmaxq_f32(vminq_f32(a, hi), lo);
+					b = vmaxq_f32(vminq_f32(b, hi), lo);
+					const int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b)));
+					vst1q_s16(output + i, packed);
+				}
+			}
+#endif
+
+			for (; i < count; ++i) {
+				output[i] = convert<int16_t>(input[i]);
+			}
+		}
+
+		// Convert a block of float samples to unsigned 8-bit PCM (without dithering).
+		// The output is identical to calling convert<uint8_t>() on each sample.
+		inline void convert(float const* input, uint8_t* output, size_t count) noexcept
+		{
+			JMP_TRACE_SCOPE("Audio::convert");
+			JMP_COUNT(BYTES_CONVERTED, count * sizeof(float));
+			size_t i = 0;
+
+#if defined(JMP_SIMD_AVX2)
+			{
+				const __m256 half = _mm256_set1_ps(0.5f);
+				const __m256 scale = _mm256_set1_ps(std::numeric_limits<uint8_t>::max());
+				const __m256 zero = _mm256_setzero_ps();
+				const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+				for (; i + 32 <= count; i += 32) {
+					__m256i q[4];
+					for (int k = 0; k < 4; ++k) {
+						__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i + 8 * k), half), half);
+						v = _mm256_mul_ps(v, scale);
+						v = _mm256_max_ps(_mm256_min_ps(v, scale), zero);
+						q[k] = _mm256_cvttps_epi32(v);
+					}
+					__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(q[0], q[1]), _mm256_packs_epi32(q[2], q[3]));
+					packed = _mm256_permutevar8x32_epi32(packed, order);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+				}
+			}
+#endif
+
+#if defined(JMP_SIMD_SSE2)
+			{
+				const __m128 half = _mm_set1_ps(0.5f);
+				const __m128 scale = _mm_set1_ps(std::numeric_limits<uint8_t>::max());
+				const __m128 zero = _mm_setzero_ps();
+				for (; i + 16 <= count; i += 16) {
+					__m128i q[4];
+					for (int k = 0; k < 4; ++k) {
+						__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4 * k), half), half);
+						v = _mm_mul_ps(v, scale);
+						v = _mm_max_ps(_mm_min_ps(v, scale), zero);
+						q[k] = _mm_cvttps_epi32(v);
+					}
+					const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+				}
+			}
+#elif defined(JMP_SIMD_NEON)
+			{
+				const float32x4_t half = vdupq_n_f32(0.5f);
+				const float32x4_t scale = vdupq_n_f32(std::numeric_limits<uint8_t>::max());
+				const float32x4_t zero = vdupq_n_f32(0);
+				for (; i + 16 <= count; i += 16) {
+					int32x4_t q[4];
+					for (int k = 0; k < 4; ++k) {
+						float32x4_t v = vaddq_f32(vmulq_f32(vld1q_f32(input + i + 4 * k), half), half);
+						v = vmulq_f32(v, scale);
+						v = vmaxq_f32(vminq_f32(v, scale), zero);
+						q[k] = vcvtq_s32_f32(v);
+					}
+					const int16x8_t lo = vcombine_s16(vqmovn_s32(q[0]), vqmovn_s32(q[1]));
+					const int16x8_t hi = vcombine_s16(vqmovn_s32(q[2]), vqmovn_s32(q[3]));
+					vst1q_u8(output + i, vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+				}
+			}
+#endif
+
+			for (; i < count; ++i) {
+				output[i] = convert<uint8_t>(input[i]);
+			}
+		}
+
+		// Convert a block of float samples to signed PCM with the given number of significant
+		// bits (8 to 32, other values are clamped to that range), e.g. 24 for samples that are
+		// then packed with pack_int24(). As with the other conversions samples are scaled by
+		// 2^(bits - 1) - 1, clamped and truncated.
+		inline void convert(float const* input, int32_t* output, size_t count, unsigned bits = 32) noexcept
+		{
+			bits = std::min(std::max(bits, 8u), 32u);
+			JMP_TRACE_SCOPE("Audio::convert");
+			JMP_COUNT(BYTES_CONVERTED, count * sizeof(float));
+			const int64_t max_code = (int64_t(1) << (bits - 1)) - 1;
+			const float scale = static_cast<float>(max_code);
+			const float lo = static_cast<float>(-max_code - 1);
+			// 2^31 - 1 rounds up to 2^31 as a float, which no longer converts to int32_t.
+			const float hi = static_cast<double>(scale) > static_cast<double>(max_code) ? std::nextafter(scale, 0.0f) : scale;
+			size_t i = 0;
+
+#if defined(JMP_SIMD_AVX2)
+			{
+				const __m256 s = _mm256_set1_ps(scale);
+				const __m256 l = _mm256_set1_ps(lo);
+				const __m256 h = _mm256_set1_ps(hi);
+				for (; i + 8 <= count; i += 8) {
+					const __m256 v = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(input + i), s), h), l);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_cvttps_epi32(v));
+				}
+			}
+#endif
+
+#if defined(JMP_SIMD_SSE2)
+			{
+				const __m128 s = _mm_set1_ps(scale);
+				const __m128 l = _mm_set1_ps(lo);
+				const __m128 h = _mm_set1_ps(hi);
+				for (; i + 4 <= count; i += 4) {
+					const __m128 v = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(input + i), s), h), l);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_cvttps_epi32(v));
+				}
+			}
+#elif defined(JMP_SIMD_NEON)
+			{
+				const float32x4_t s = vdupq_n_f32(scale);
+				const float32x4_t l = vdupq_n_f32(lo);
+				const float32x4_t h = vdupq_n_f32(hi);
+				for (; i + 4 <= count; i += 4) {
+					const float32x4_t v = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(input + i), s), h), l);
+					vst1q_s32(output + i, vcvtq_s32_f32(v));
+				}
+			}
+#endif
+
+			for (; i < count; ++i) {
+				float sample = input[i] * scale;
+				if (sample > hi) {
+					sample = hi;
+				}
+				else if (sample < lo) {
+					sample = lo;
+				}
+				output[i] = static_cast<int32_t>(sample);
+			}
+		}
+
+		// Packs the low 24 bits of each sample into three little-endian bytes, the layout of
+		// 24-bit PCM in WAV files. The output holds 3 * count bytes.
+		inline void pack_int24(int32_t const* input, uint8_t* output, size_t count) noexcept
+		{
+			size_t i = 0;
+
+			// The x86 paths store a full register of which only the first three quarters are
+			// packed samples; the rest is overwritten by the next store, so each store needs
+			// that much output left after its samples.
+#if defined(JMP_SIMD_AVX2)
+			{
+				const __m256i shuffle = _mm256_setr_epi8(
+					0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+					0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+				const __m256i order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+				for (; 3 * (i + 8) + 8 <= 3 * count; i += 8) {
+					__m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+					v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, shuffle), order);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 3 * i), v);
+				}
+			}
+#endif
+
+#if defined(JMP_SIMD_SSSE3)
+			{
+				const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+				for (; 3 * (i + 4) + 4 <= 3 * count; i += 4) {
+					const __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(output + 3 * i), _mm_shuffle_epi8(v, shuffle));
+				}
+			}
+#elif defined(JMP_SIMD_NEON)
+			if constexpr (is_little_endian()) {
+				// De-interleave the bytes of 16 samples and store back the three low planes.
+				for (; i + 16 <= count; i += 16) {
+					const uint8x16x4_t bytes = vld4q_u8(reinterpret_cast<uint8_t const*>(input + i));
+					uint8x16x3_t packed;
+					packed.val[0] = bytes.val[0];
+					packed.val[1] = bytes.val[1];
+					packed.val[2] = bytes.val[2];
+					vst3q_u8(output + 3 * i, packed);
+				}
+			}
+#endif
+
+			for (; i < count; ++i) {
+				const uint32_t v = static_cast<uint32_t>(input[i]);
+				output[3 * i] = static_cast<uint8_t>(v);
+				output[3 * i + 1] = static_cast<uint8_t>(v >> 8);
+				output[3 * i + 2] = static_cast<uint8_t>(v >> 16);
+			}
+		}
+
+		namespace detail {
+#if defined(JMP_SIMD_SSE2) || defined(JMP_SIMD_NEON)
+#if defined(JMP_SIMD_SSE2)
+			using Lanes = __m128i;
+#else
+			using Lanes = uint8x16_t;
+#endif
+
+			// Loads or stores the first Bytes bytes of a register. Partial loads zero the rest.
+			template <size_t Bytes>
+			inline Lanes load_lanes(void const* src) noexcept
+			{
+				Lanes v{};
+				std::memcpy(&v, src, Bytes);
+				return v;
+			}
+
+			template <size_t Bytes>
+			inline void store_lanes(void* dst, Lanes v) noexcept
+			{
+				std::memcpy(dst, &v, Bytes);
+			}
+
+			// Transposes the square matrix of Size-byte elements held in v, 8x8 for 16-bit and
+			// 4x4 for 32-bit elements: element j of v[i] becomes element i of v[j].
+			template <size_t Size>
+			inline void transpose_lanes(Lanes* v) noexcept
+			{
+#if defined(JMP_SIMD_SSE2)
+				if constexpr (Size == 2) {
+					const __m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+					const __m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+					const __m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+					const __m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+					const __m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+					const __m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+					const __m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+					const __m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+					const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+					const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+					const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+					const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+					const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+					const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+					const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+					const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+					v[0] = _mm_unpacklo_epi64(b0, b4);
+					v[1] = _mm_unpackhi_epi64(b0, b4);
+					v[2] = _mm_unpacklo_epi64(b1, b5);
+					v[3] = _mm_unpackhi_epi64(b1, b5);
+					v[4] = _mm_unpacklo_epi64(b2, b6);
+					v[5] = _mm_unpackhi_epi64(b2, b6);
+					v[6] = _mm_unpacklo_epi64(b3, b7);
+					v[7] = _mm_unpackhi_epi64(b3, b7);
+				}
+				else {
+					const __m128i a0 = _mm_unpacklo_epi32(v[0], v[1]);
+					const __m128i a1 = _mm_unpackhi_epi32(v[0], v[1]);
+					const __m128i a2 = _mm_unpacklo_epi32(v[2], v[3]);
+					const __m128i a3 = _mm_unpackhi_epi32(v[2], v[3]);
+					v[0] = _mm_unpacklo_epi64(a0, a2);
+					v[1] = _mm_unpackhi_epi64(a0, a2);
+					v[2] = _mm_unpacklo_epi64(a1, a3);
+					v[3] = _mm_unpackhi_epi64(a1, a3);
+				}
+#else
+				if constexpr (Size == 2) {
+					const uint16x8x2_t a0 = vtrnq_u16(vreinterpretq_u16_u8(v[0]), vreinterpretq_u16_u8(v[1]));
+					const uint16x8x2_t a1 = vtrnq_u16(vreinterpretq_u16_u8(v[2]), vreinterpretq_u16_u8(v[3]));
+					const uint16x8x2_t a2 = vtrnq_u16(vreinterpretq_u16_u8(v[4]), vreinterpretq_u16_u8(v[5]));
+					const uint16x8x2_t a3 = vtrnq_u16(vreinterpretq_u16_u8(v[6]), vreinterpretq_u16_u8(v[7]));
+					const uint32x4x2_t b0 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[0]), vreinterpretq_u32_u16(a1.val[0]));
+					const uint32x4x2_t b1 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[1]), vreinterpretq_u32_u16(a1.val[1]));
+					const uint32x4x2_t b2 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[0]), vreinterpretq_u32_u16(a3.val[0]));
+					const uint32x4x2_t b3 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[1]), vreinterpretq_u32_u16(a3.val[1]));
+					v[0] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(b0.val[0]), vget_low_u32(b2.val[0])));
+					v[1] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(b1.val[0]), vget_low_u32(b3.val[0])));
+					v[2] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(b0.val[1]), vget_low_u32(b2.val[1])));
+					v[3] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(b1.val[1]), vget_low_u32(b3.val[1])));
+					v[4] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(b0.val[0]), vget_high_u32(b2.val[0])));
+					v[5] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(b1.val[0]), vget_high_u32(b3.val[0])));
+					v[6] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(b0.val[1]), vget_high_u32(b2.val[1])));
+					v[7] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(b1.val[1]), vget_high_u32(b3.val[1])));
+				}
+				else {
+					const uint32x4x2_t a0 = vtrnq_u32(vreinterpretq_u32_u8(v[0]), vreinterpretq_u32_u8(v[1]));
+					const uint32x4x2_t a1 = vtrnq_u32(vreinterpretq_u32_u8(v[2]), vreinterpretq_u32_u8(v[3]));
+					v[0] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(a0.val[0]), vget_low_u32(a1.val[0])));
+					v[1] = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(a0.val[1]), vget_low_u32(a1.val[1])));
+					v[2] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(a0.val[0]), vget_high_u32(a1.val[0])));
+					v[3] = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(a0.val[1]), vget_high_u32(a1.val[1])));
+				}
+#endif
+			}
+
+			// Interleaves the Size-byte elements of two registers (lo holds the first half of the
+			// pairs) and the inverse, splitting pairs into their even and odd elements.
+			template <size_t Size>
+			inline void zip_lanes(Lanes a, Lanes b, Lanes& lo, Lanes& hi) noexcept
+			{
+#if defined(JMP_SIMD_SSE2)
+				lo = Size == 2 ? _mm_unpacklo_epi16(a, b) : _mm_unpacklo_epi32(a, b);
+				hi = Size == 2 ? _mm_unpackhi_epi16(a, b) : _mm_unpackhi_epi32(a, b);
+#else
+				if constexpr (Size == 2) {
+					const uint16x8x2_t z = vzipq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b));
+					lo = vreinterpretq_u8_u16(z.val[0]);
+					hi = vreinterpretq_u8_u16(z.val[1]);
+				}
+				else {
+					const uint32x4x2_t z = vzipq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b));
+					lo = vreinterpretq_u8_u32(z.val[0]);
+					hi = vreinterpretq_u8_u32(z.val[1]);
+				}
+#endif
+			}
+
+			template <size_t Size>
+			inline void unzip_lanes(Lanes lo, Lanes hi, Lanes& even, Lanes& odd) noexcept
+			{
+#if defined(JMP_SIMD_SSE2)
+				if constexpr (Size == 2) {
+					// Sign extending each half keeps packs_epi32 from saturating.
+					even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16), _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+					odd = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+				}
+				else {
+					const __m128 a = _mm_castsi128_ps(lo);
+					const __m128 b = _mm_castsi128_ps(hi);
+					even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+					odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+				}
+#else
+				if constexpr (Size == 2) {
+					const uint16x8x2_t z = vuzpq_u16(vreinterpretq_u16_u8(lo), vreinterpretq_u16_u8(hi));
+					even = vreinterpretq_u8_u16(z.val[0]);
+					odd = vreinterpretq_u8_u16(z.val[1]);
+				}
+				else {
+					const uint32x4x2_t z = vuzpq_u32(vreinterpretq_u32_u8(lo), vreinterpretq_u32_u8(hi));
+					even = vreinterpretq_u8_u32(z.val[0]);
+					odd = vreinterpretq_u8_u32(z.val[1]);
+				}
+#endif
+			}
+
+			// Converts 8 float samples to 16-bit PCM exactly like convert(float const*, int16_t*, size_t).
+			inline Lanes int16_lanes(float const* input) noexcept
+			{
+#if defined(JMP_SIMD_SSE2)
+				const __m128 scale = _mm_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m128 hi = _mm_set1_ps(std::numeric_limits<int16_t>::max());
+				const __m128 lo = _mm_set1_ps(std::numeric_limits<int16_t>::min());
+				const __m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(input), scale), hi), lo);
+				const __m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(input + 4), scale), hi), lo);
+				return _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+#else
+				const float32x4_t scale = vdupq_n_f32(std::numeric_limits<int16_t>::max());
+				const float32x4_t hi = vdupq_n_f32(std::numeric_limits<int16_t>::max());
+				const float32x4_t lo = vdupq_n_f32(std::numeric_limits<int16_t>::min());
+				const float32x4_t a = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(input), scale), hi), lo);
+				const float32x4_t b = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(input + 4), scale), hi), lo);
+				return vreinterpretq_u8_s16(vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+#endif
+			}
+
+			// Writes K channels of Size-byte samples as frames stride samples apart, transposing a
+			// register of samples per channel at a time. load(k, f) returns the samples [f, f + N)
+			// of channel k. Returns the number of frames written, a multiple of N.
+			template <size_t K, size_t Size, typename Load>
+			inline size_t interleave_lanes(Load&& load, void* output, size_t stride, size_t frames) noexcept
+			{
+				constexpr size_t N = sizeof(Lanes) / Size;
+				uint8_t* out = static_cast<uint8_t*>(output);
+				size_t f = 0;
+				if (K == 2 && stride == 2) {
+					for (; f + N <= frames; f += N) {
+						Lanes lo, hi;
+						zip_lanes<Size>(load(0, f), load(1, f), lo, hi);
+						store_lanes<sizeof(Lanes)>(out + 2 * Size * f, lo);
+						store_lanes<sizeof(Lanes)>(out + 2 * Size * f + sizeof(Lanes), hi);
+					}
+					return f;
+				}
+				for (; f + N <= frames; f += N) {
+					Lanes v[N];
+					for (size_t k = 0; k < N; ++k) {
+						v[k] = k < K ? load(k, f) : Lanes{};
+					}
+					transpose_lanes<Size>(v);
+					for (size_t j = 0; j < N; ++j) {
+						store_lanes<K * Size>(out + Size * (f + j) * stride, v[j]);
+					}
+				}
+				return f;
+			}
+
+			// The inverse of interleave_lanes(): store(k, f, lanes) receives the samples
+			// [f, f + N) of channel k.
+			template <size_t K, size_t Size, typename Store>
+			inline size_t deinterleave_lanes(void const* input, size_t stride, Store&& store, size_t frames) noexcept
+			{
+				constexpr size_t N = sizeof(Lanes) / Size;
+				uint8_t const* in = static_cast<uint8_t const*>(input);
+				size_t f = 0;
+				if (K == 2 && stride == 2) {
+					for (; f + N <= frames; f += N) {
+						Lanes even, odd;
+						unzip_lanes<Size>(load_lanes<sizeof(Lanes)>(in + 2 * Size * f),
+							load_lanes<sizeof(Lanes)>(in + 2 * Size * f + sizeof(Lanes)), even, odd);
+						store(0, f, even);
+						store(1, f, odd);
+					}
+					return f;
+				}
+				for (; f + N <= frames; f += N) {
+					Lanes v[N];
+					for (size_t j = 0; j < N; ++j) {
+						v[j] = load_lanes<K * Size>(in + Size * (f + j) * stride);
+					}
+					transpose_lanes<Size>(v);
+					for (size_t k = 0; k < K; ++k) {
+						store(k, f, v[k]);
+					}
+				}
+				return f;
+			}
+
+			// Calls f(std::integral_constant<size_t, k>()) for a run-time k in [1, K].
+			template <size_t K, typename F>
+			inline void with_group_size(size_t k, F&& f)
+			{
+				if constexpr (K > 1) {
+					if (k < K) {
+						with_group_size<K - 1>(k, f);
+						return;
+					}
+				}
+				f(std::integral_constant<size_t, K>());
+			}
+
+			// Visits the channels in groups of up to N as group(K, first_channel, first_frame, frames),
+			// in blocks of frames small enough that the interleaved block stays in the L1 cache
+			// while every group writes its part of each frame.
+			template <size_t N, typename Group>
+			inline void for_each_channel_group(size_t channel_count, size_t frames, size_t sample_size, Group&& group)
+			{
+				constexpr size_t BLOCK_BYTES = 16 * 1024;
+				const size_t block = std::max<size_t>(16, (BLOCK_BYTES / (channel_count * sample_size + 1)) & ~size_t(15));
+				for (size_t begin = 0; begin < frames; begin += block) {
+					const size_t n = std::min(block, frames - begin);
+					for (size_t c = 0; c < channel_count; c += N) {
+						with_group_size<N>(std::min(N, channel_count - c), [&](auto k) {
+							group(k, c, begin, n);
+						});
+					}
+				}
+			}
+#endif
+		}
+
+		// Interleaves planar channel buffers into frames, output[f * channel_count + c] = channels[c][f].
+		// 16-bit and 32-bit samples are transposed with SIMD, 8 or 4 channels at a time.
+		template <typename T>
+		inline void interleave(T const* const* channels, size_t channel_count, T* output, size_t frames) noexcept
+		{
+#if defined(JMP_SIMD_SSE2) || defined(JMP_SIMD_NEON)
+			if constexpr (sizeof(T) == 2 || sizeof(T) == 4) {
+				constexpr size_t N = sizeof(detail::Lanes) / sizeof(T);
+				detail::for_each_channel_group<N>(channel_count, frames, sizeof(T), [&](auto k, size_t c, size_t begin, size_t n) {
+					constexpr size_t K = decltype(k)::value;
+					T const* const* group = channels + c;
+					T* out = output + begin * channel_count + c;
+					const size_t done = detail::interleave_lanes<K, sizeof(T)>([&](size_t i, size_t f) {
+						return detail::load_lanes<sizeof(detail::Lanes)>(group[i] + begin + f);
+					}, out, channel_count, n);
+					for (size_t f = done; f < n; ++f) {
+						for (size_t i = 0; i < K; ++i) {
+							out[f * channel_count + i] = group[i][begin + f];
+						}
+					}
+				});
+				return;
+			}
+#endif
+			for (size_t f = 0; f < frames; ++f) {
+				for (size_t c = 0; c < channel_count; ++c) {
+					output[f * channel_count + c] = channels[c][f];
+				}
+			}
+		}
+
+		// Splits interleaved frames into planar channel buffers, channels[c][f] = input[f * channel_count + c].
+		template <typename T>
+		inline void deinterleave(T const* input, size_t channel_count, T* const* channels, size_t frames) noexcept
+		{
+#if defined(JMP_SIMD_SSE2) || defined(JMP_SIMD_NEON)
+			if constexpr (sizeof(T) == 2 || sizeof(T) == 4) {
+				constexpr size_t N = sizeof(detail::Lanes) / sizeof(T);
+				detail::for_each_channel_group<N>(channel_count, frames, sizeof(T), [&](auto k, size_t c, size_t begin, size_t n) {
+					constexpr size_t K = decltype(k)::value;
+					T* const* group = channels + c;
+					T const* in = input + begin * channel_count + c;
+					const size_t done = detail::deinterleave_lanes<K, sizeof(T)>(in, channel_count, [&](size_t i, size_t f, detail::Lanes v) {
+						detail::store_lanes<sizeof(detail::Lanes)>(group[i] + begin + f, v);
+					}, n);
+					for (size_t f = done; f < n; ++f) {
+						for (size_t i = 0; i < K; ++i) {
+							group[i][begin + f] = in[f * channel_count + i];
+						}
+					}
+				});
+				return;
+			}
+#endif
+			for (size_t f = 0; f < frames; ++f) {
+				for (size_t c = 0; c < channel_count; ++c) {
+					channels[c][f] = input[f * channel_count + c];
+				}
+			}
+		}
+
+		// Converts planar float channels to interleaved 16-bit PCM in a single pass. The output is
+		// identical to interleaving the channels and then calling convert(float const*, int16_t*, size_t).
+		inline void interleave(float const* const* channels, size_t channel_count, int16_t* output, size_t frames) noexcept
+		{
+#if defined(JMP_SIMD_SSE2) || defined(JMP_SIMD_NEON)
+			detail::for_each_channel_group<8>(channel_count, frames, sizeof(int16_t), [&](auto k, size_t c, size_t begin, size_t n) {
+				constexpr size_t K = decltype(k)::value;
+				float const* const* group = channels + c;
+				int16_t* out = output + begin * channel_count + c;
+				const size_t done = detail::interleave_lanes<K, sizeof(int16_t)>([&](size_t i, size_t f) {
+					return detail::int16_lanes(group[i] + begin + f);
+				}, out, channel_count, n);
+				for (size_t f = done; f < n; ++f) {
+					for (size_t i = 0; i < K; ++i) {
+						out[f * channel_count + i] = convert<int16_t>(group[i][begin + f]);
+					}
+				}
+			});
+#else
+			for (size_t f = 0; f < frames; ++f) {
+				for (size_t c = 0; c < channel_count; ++c) {
+					output[f * channel_count + c] = convert<int16_t>(channels[c][f]);
+				}
+			}
+#endif
+		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,85 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "simd.hpp"
+
+namespace JMP
+{
+    // One value per octave band, from 63 Hz to 8 kHz (see OCTAVE_BAND_CENTERS). A band vector of
+    // floats fills one AVX register, or two SSE or NEON registers, and the arithmetic operators go
+    // through the pack layer so that each of them is one instruction per register.
+    template <typename T>
+    struct alignas(8 * sizeof(T)) Bands {
+        static constexpr size_t count = 8;
+
+        T v[count];
+
+    private:
+        template <class F>
+        static Bands _apply(Bands const & a, Bands const & b, F&& f) {
+            using P = simd::Pack<T>;
+            Bands r;
+            if constexpr (P::width <= count) {
+                for (size_t i = 0; i < count; i += P::width) {
+                    f(P::load(a.v + i), P::load(b.v + i)).store(r.v + i);
+                }
+            }
+            else {
+                // Registers wider than a band vector, e.g. AVX-512: plain loop over the bands.
+                for (size_t i = 0; i < count; ++i) {
+                    r.v[i] = f(simd::Scalar<T>{ a.v[i] }, simd::Scalar<T>{ b.v[i] }).v;
+                }
+            }
+            return r;
+        }
+
+    public:
+        static Bands broadcast(T x) {
+            Bands r;
+            std::fill_n(r.v, count, x);
+            return r;
+        }
+
+        static Bands load(T const* p) {
+            Bands r;
+            std::copy_n(p, count, r.v);
+            return r;
+        }
+
+        void store(T* p) const { std::copy_n(v, count, p); }
+
+        T& operator[](size_t i) { return v[i]; }
+        T const & operator[](size_t i) const { return v[i]; }
+
+        Bands operator+(Bands const & o) const { return _apply(*this, o, [](auto a, auto b) { return a + b; }); }
+        Bands operator-(Bands const & o) const { return _apply(*this, o, [](auto a, auto b) { return a - b; }); }
+        Bands operator*(Bands const & o) const { return _apply(*this, o, [](auto a, auto b) { return a * b; }); }
+        Bands operator*(T s) const { return *this * broadcast(s); }
+
+        Bands& operator+=(Bands const & o) { return *this = *this + o; }
+        Bands& operator*=(Bands const & o) { return *this = *this * o; }
+        Bands& operator*=(T s) { return *this = *this * s; }
+
+        T max() const { return *std::max_element(v, v + count); }
+
+        T mean() const {
+            T sum = 0;
+            for (T x : v) {
+                sum += x;
+            }
+            return sum / static_cast<T>(count);
+        }
+    };
+
+    // Center frequencies of the bands of Bands, in Hz.
+    constexpr double OCTAVE_BAND_CENTERS[Bands<float>::count] = { 63, 125, 250, 500, 1000, 2000, 4000, 8000 };
+}
@@ -0,0 +1,314 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "audio.hpp"
+#include "dither.hpp"
+#include "convolver.hpp"
+#include "resampler.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+static void BM_ConvertInt16_PerSample(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.2f, 1.2f);
+	std::vector<int16_t> output(input.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < input.size(); ++i) {
+			output[i] = Audio::convert<int16_t>(input[i]);
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_ConvertInt16_PerSample)->Arg(1 << 12)->Arg(1 << 20);
+
+static void BM_ConvertInt16_Batch(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.2f, 1.2f);
+	std::vector<int16_t> output(input.size());
+	for (auto _ : state) {
+		Audio::convert(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_ConvertInt16_Batch)->Arg(1 << 12)->Arg(1 << 20);
+
+static void BM_ConvertUInt8_PerSample(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.2f, 1.2f);
+	std::vector<uint8_t> output(input.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < input.size(); ++i) {
+			output[i] = Audio::convert<uint8_t>(input[i]);
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_ConvertUInt8_PerSample)->Arg(1 << 12)->Arg(1 << 20);
+
+static void BM_ConvertUInt8_Batch(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.2f, 1.2f);
+	std::vector<uint8_t> output(input.size());
+	for (auto _ : state) {
+		Audio::convert(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_ConvertUInt8_Batch)->Arg(1 << 12)->Arg(1 << 20);
+
+// TPDF dither drawn from std::mt19937 per sample, for comparison with Audio::Ditherer.
+static void BM_DitherInt16_Mt19937(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	std::vector<int16_t> output(input.size());
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+	for (auto _ : state) {
+		for (size_t i = 0; i < input.size(); ++i) {
+			const float dither = distribution(generator) + distribution(generator);
+			const float v = std::floor(input[i] * std::numeric_limits<int16_t>::max() + dither + 0.5f);
+			output[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, v)));
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DitherInt16_Mt19937)->Arg(1 << 16);
+
+static void BM_DitherInt16(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	std::vector<int16_t> output(input.size());
+	Audio::Ditherer ditherer(2, static_cast<Audio::NoiseShaping>(state.range(1)));
+	for (auto _ : state) {
+		ditherer.convert(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DitherInt16)
+	->Args({ 1 << 16, static_cast<int>(Audio::NoiseShaping::NONE) })
+	->Args({ 1 << 16, static_cast<int>(Audio::NoiseShaping::FIRST_ORDER) })
+	->Args({ 1 << 16, static_cast<int>(Audio::NoiseShaping::SECOND_ORDER) });
+
+static void BM_PackInt24_PerByte(benchmark::State& state)
+{
+	const auto input = Bench::random_values<int32_t>(static_cast<size_t>(state.range(0)), -(1 << 23), (1 << 23) - 1);
+	std::vector<uint8_t> output(3 * input.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < input.size(); ++i) {
+			const uint32_t v = static_cast<uint32_t>(input[i]);
+			output[3 * i] = static_cast<uint8_t>(v);
+			output[3 * i + 1] = static_cast<uint8_t>(v >> 8);
+			output[3 * i + 2] = static_cast<uint8_t>(v >> 16);
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PackInt24_PerByte)->Arg(1 << 16);
+
+static void BM_PackInt24(benchmark::State& state)
+{
+	const auto input = Bench::random_values<int32_t>(static_cast<size_t>(state.range(0)), -(1 << 23), (1 << 23) - 1);
+	std::vector<uint8_t> output(3 * input.size());
+	for (auto _ : state) {
+		Audio::pack_int24(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PackInt24)->Arg(1 << 16);
+
+static void BM_ConvertInt24_Batch(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.2f, 1.2f);
+	std::vector<int32_t> output(input.size());
+	for (auto _ : state) {
+		Audio::convert(input.data(), output.data(), input.size(), 24);
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ConvertInt24_Batch)->Arg(1 << 16);
+
+// Planar test signal of range(1) channels with range(0) frames each.
+struct PlanarSignal {
+	std::vector<std::vector<float>> samples;
+	std::vector<float const*> channels;
+
+	PlanarSignal(size_t frames, size_t channel_count)
+	{
+		for (size_t c = 0; c < channel_count; ++c) {
+			samples.push_back(Bench::random_values<float>(frames, -1.2f, 1.2f, static_cast<uint32_t>(c + 1)));
+			channels.push_back(samples.back().data());
+		}
+	}
+};
+
+// The hand-written loop that Audio::interleave() replaces.
+static void BM_Interleave_PerSample(benchmark::State& state)
+{
+	const size_t frames = static_cast<size_t>(state.range(0));
+	const size_t channel_count = static_cast<size_t>(state.range(1));
+	const PlanarSignal signal(frames, channel_count);
+	std::vector<float> output(frames * channel_count);
+	for (auto _ : state) {
+		for (size_t f = 0; f < frames; ++f) {
+			for (size_t c = 0; c < channel_count; ++c) {
+				output[f * channel_count + c] = signal.channels[c][f];
+			}
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(output.size() * sizeof(float)));
+}
+BENCHMARK(BM_Interleave_PerSample)->Args({ 1 << 14, 2 })->Args({ 1 << 14, 8 })->Args({ 1 << 14, 16 })->Args({ 1 << 12, 64 });
+
+static void BM_Interleave(benchmark::State& state)
+{
+	const size_t frames = static_cast<size_t>(state.range(0));
+	const size_t channel_count = static_cast<size_t>(state.range(1));
+	const PlanarSignal signal(frames, channel_count);
+	std::vector<float> output(frames * channel_count);
+	for (auto _ : state) {
+		Audio::interleave(signal.channels.data(), channel_count, output.data(), frames);
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(output.size() * sizeof(float)));
+}
+BENCHMARK(BM_Interleave)->Args({ 1 << 14, 2 })->Args({ 1 << 14, 8 })->Args({ 1 << 14, 16 })->Args({ 1 << 12, 64 });
+
+static void BM_Deinterleave(benchmark::State& state)
+{
+	const size_t frames = static_cast<size_t>(state.range(0));
+	const size_t channel_count = static_cast<size_t>(state.range(1));
+	const auto input = Bench::random_values<float>(frames * channel_count, -1.2f, 1.2f);
+	std::vector<std::vector<float>> samples(channel_count, std::vector<float>(frames));
+	std::vector<float*> channels;
+	for (auto& channel : samples) {
+		channels.push_back(channel.data());
+	}
+	for (auto _ : state) {
+		Audio::deinterleave(input.data(), channel_count, channels.data(), frames);
+		benchmark::DoNotOptimize(channels.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(input.size() * sizeof(float)));
+}
+BENCHMARK(BM_Deinterleave)->Args({ 1 << 14, 2 })->Args({ 1 << 14, 8 })->Args({ 1 << 14, 16 });
+
+// Interleaving to float and then converting, the two-pass path the fused kernel replaces.
+static void BM_InterleaveInt16_TwoPass(benchmark::State& state)
+{
+	const size_t frames = static_cast<size_t>(state.range(0));
+	const size_t channel_count = static_cast<size_t>(state.range(1));
+	const PlanarSignal signal(frames, channel_count);
+	std::vector<float> interleaved(frames * channel_count);
+	std::vector<int16_t> output(frames * channel_count);
+	for (auto _ : state) {
+		Audio::interleave(signal.channels.data(), channel_count, interleaved.data(), frames);
+		Audio::convert(interleaved.data(), output.data(), interleaved.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(output.size() * sizeof(float)));
+}
+BENCHMARK(BM_InterleaveInt16_TwoPass)->Args({ 1 << 14, 2 })->Args({ 1 << 14, 8 })->Args({ 1 << 14, 16 })->Args({ 1 << 12, 64 });
+
+static void BM_InterleaveInt16(benchmark::State& state)
+{
+	const size_t frames = static_cast<size_t>(state.range(0));
+	const size_t channel_count = static_cast<size_t>(state.range(1));
+	const PlanarSignal signal(frames, channel_count);
+	std::vector<int16_t> output(frames * channel_count);
+	for (auto _ : state) {
+		Audio::interleave(signal.channels.data(), channel_count, output.data(), frames);
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(output.size() * sizeof(float)));
+}
+BENCHMARK(BM_InterleaveInt16)->Args({ 1 << 14, 2 })->Args({ 1 << 14, 8 })->Args({ 1 << 14, 16 })->Args({ 1 << 12, 64 });
+
+// Direct-form FIR as the baseline for the convolver, on a short response.
+static void BM_ConvolveDirect(benchmark::State& state)
+{
+	const size_t frames = 4096;
+	const auto ir = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -0.1f, 0.1f);
+	const auto input = Bench::random_values<float>(frames + ir.size(), -1.0f, 1.0f);
+	std::vector<float> output(frames);
+	for (auto _ : state) {
+		for (size_t i = 0; i < frames; ++i) {
+			float sum = 0;
+			for (size_t j = 0; j < ir.size(); ++j) {
+				sum += input[i + ir.size() - j] * ir[j];
+			}
+			output[i] = sum;
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(frames));
+}
+BENCHMARK(BM_ConvolveDirect)->Arg(1 << 10)->Arg(1 << 13);
+
+// Arguments: response length, block size, largest block size (uniform if equal).
+static void BM_Convolver(benchmark::State& state)
+{
+	const size_t frames = 1 << 14;
+	const auto ir = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -0.1f, 0.1f);
+	const auto input = Bench::random_values<float>(frames, -1.0f, 1.0f);
+	std::vector<float> output(frames);
+	Audio::Convolver<float> convolver(ir, static_cast<size_t>(state.range(1)), static_cast<size_t>(state.range(2)));
+	for (auto _ : state) {
+		convolver.process(input.data(), output.data(), frames);
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(frames));
+}
+BENCHMARK(BM_Convolver)
+	->Args({ 1 << 10, 256, 256 })->Args({ 1 << 13, 256, 256 })
+	->Args({ 1 << 17, 256, 256 })->Args({ 1 << 17, 256, 16384 })
+	->Args({ 1 << 17, 64, 64 })->Args({ 1 << 17, 64, 16384 });
+
+// Arguments: input rate, output rate.
+static void BM_Resampler(benchmark::State& state)
+{
+	const size_t frames = 1 << 14;
+	const auto input = Bench::random_values<float>(frames, -1.0f, 1.0f);
+	Audio::Resampler<float> resampler(static_cast<uint32_t>(state.range(0)), static_cast<uint32_t>(state.range(1)));
+	std::vector<float> output(resampler.max_output(frames));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(resampler.process(input.data(), frames, output.data()));
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(frames));
+}
+BENCHMARK(BM_Resampler)->Args({ 96000, 48000 })->Args({ 96000, 44100 })->Args({ 44100, 48000 });
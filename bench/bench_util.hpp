@@ -0,0 +1,44 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+namespace JMP
+{
+	namespace Bench
+	{
+		// Uniformly distributed values in [lo, hi) for floating point, [lo, hi] for integers,
+		// deterministic across runs.
+		template <typename T>
+		std::vector<T> random_values(size_t count, T lo, T hi, uint32_t seed = 1)
+		{
+			std::mt19937 generator(seed);
+			std::vector<T> values(count);
+			if constexpr (std::is_floating_point<T>::value) {
+				std::uniform_real_distribution<T> distribution(lo, hi);
+				for (T& v : values) v = distribution(generator);
+			}
+			else {
+				std::uniform_int_distribution<int64_t> distribution(lo, hi);
+				for (T& v : values) v = static_cast<T>(distribution(generator));
+			}
+			return values;
+		}
+
+		// Path of a scratch file in the system temporary directory.
+		inline std::string temp_path(std::string const& name)
+		{
+			return (std::filesystem::temp_directory_path() / name).string();
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <limits>
+
+#include "endians.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+template <typename T>
+static void BM_Byteswap_PerElement(benchmark::State& state)
+{
+	const auto input = Bench::random_values<T>(static_cast<size_t>(state.range(0)), 0, std::numeric_limits<T>::max());
+	std::vector<T> output(input.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < input.size(); ++i) {
+			output[i] = byteswap<T>(input[i]);
+		}
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(T)));
+}
+BENCHMARK_TEMPLATE(BM_Byteswap_PerElement, uint16_t)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Byteswap_PerElement, uint32_t)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Byteswap_PerElement, uint64_t)->Arg(1 << 20);
+
+template <typename T>
+static void BM_Byteswap_Copy(benchmark::State& state)
+{
+	const auto input = Bench::random_values<T>(static_cast<size_t>(state.range(0)), 0, std::numeric_limits<T>::max());
+	std::vector<T> output(input.size());
+	for (auto _ : state) {
+		byteswap_copy(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(T)));
+}
+BENCHMARK_TEMPLATE(BM_Byteswap_Copy, uint16_t)->Arg(1 << 12)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Byteswap_Copy, uint32_t)->Arg(1 << 12)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Byteswap_Copy, uint64_t)->Arg(1 << 12)->Arg(1 << 20);
+
+// Reference for the byte swap kernels.
+static void BM_Memcpy(benchmark::State& state)
+{
+	const auto input = Bench::random_values<uint32_t>(static_cast<size_t>(state.range(0)), 0, 1 << 30);
+	std::vector<uint32_t> output(input.size());
+	for (auto _ : state) {
+		std::memcpy(output.data(), input.data(), input.size() * sizeof(uint32_t));
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(uint32_t)));
+}
+BENCHMARK(BM_Memcpy)->Arg(1 << 12)->Arg(1 << 20);
+
+static void BM_ToBigEndian(benchmark::State& state)
+{
+	const auto input = Bench::random_values<uint32_t>(static_cast<size_t>(state.range(0)), 0, 1 << 30);
+	std::vector<BigEndian<uint32_t>> output(input.size());
+	for (auto _ : state) {
+		to_big_endian(input.data(), output.data(), input.size());
+		benchmark::DoNotOptimize(output.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(uint32_t)));
+}
+BENCHMARK(BM_ToBigEndian)->Arg(1 << 20);
@@ -0,0 +1,78 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+// End-to-end benchmarks. These run a single iteration each and take seconds.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+
+#include "wavefile.hpp"
+#include "spatial.hpp"
+#include "thread_pool.hpp"
+#include "vector_batch.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+// Streams 1 GB of float samples to disk.
+static void BM_Macro_WriteWav1GB(benchmark::State& state)
+{
+	const size_t total_bytes = size_t(1) << 30;
+	const auto block = Bench::random_values<float>(size_t(1) << 16, -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_1gb.wav");
+	for (auto _ : state) {
+		WaveFile::Writer writer(path, 2, 48000, WaveFile::AudioFormat::FLOAT, 32);
+		for (size_t written = 0; written < total_bytes; written += block.size() * sizeof(float)) {
+			writer.write(block.data(), block.size());
+		}
+		if (!writer.close()) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(total_bytes));
+}
+BENCHMARK(BM_Macro_WriteWav1GB)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// Nearest hit of 1M random rays against 10k circles in a 100 m square, through the uniform grid
+// and the thread pool.
+static void BM_Macro_Trace1MRays10kCircles(benchmark::State& state)
+{
+	const size_t ray_count = size_t(1) << 20;
+	const size_t circle_count = 10000;
+	const auto cx = Bench::random_values<float>(circle_count, -50.0f, 50.0f, 1);
+	const auto cy = Bench::random_values<float>(circle_count, -50.0f, 50.0f, 2);
+	const auto radius = Bench::random_values<float>(circle_count, 0.05f, 0.5f, 3);
+	CircleSet<float> circles;
+	for (size_t i = 0; i < circle_count; ++i) {
+		circles.push_back(Vector2<float>(cx[i], cy[i]), radius[i]);
+	}
+	const CircleGrid<float> grid(circles);
+
+	const auto px = Bench::random_values<float>(ray_count, -50.0f, 50.0f, 4);
+	const auto py = Bench::random_values<float>(ray_count, -50.0f, 50.0f, 5);
+	const auto directions = Vector2Batch<float>::RandomDirections<FastMath>(ray_count, 6);
+
+	ThreadPool pool;
+	const size_t batch_size = 4096;
+	std::vector<size_t> hits(pool.worker_count());
+	for (auto _ : state) {
+		std::fill(hits.begin(), hits.end(), 0);
+		pool.parallel_for((ray_count + batch_size - 1) / batch_size, [&](size_t batch, size_t worker) {
+			const size_t last = std::min(ray_count, (batch + 1) * batch_size);
+			for (size_t i = batch * batch_size; i < last; ++i) {
+				const Ray2<float> ray(Vector2<float>(px[i], py[i]), directions[i]);
+				hits[worker] += grid.intersect(ray) ? 1 : 0;
+			}
+		});
+		benchmark::DoNotOptimize(hits.data());
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ray_count));
+	state.counters["threads"] = static_cast<double>(pool.worker_count());
+}
+BENCHMARK(BM_Macro_Trace1MRays10kCircles)->Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
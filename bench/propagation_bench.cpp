@@ -0,0 +1,261 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+
+#include "image_source.hpp"
+#include "incremental_propagation.hpp"
+#include "thread_pool.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+// A room shaped like a star with range(0) points, concave so that images get culled and
+// paths get occluded.
+static std::vector<Wall<float>> star_room(size_t points)
+{
+	std::vector<Vector2<float>> vertices;
+	for (size_t i = 0; i < 2 * points; ++i) {
+		const float angle = 3.14159265f * static_cast<float>(i) / static_cast<float>(points);
+		const float radius = i % 2 == 0 ? 10.0f : 7.0f;
+		vertices.push_back(Vector2<float>(radius * std::cos(angle), radius * std::sin(angle)));
+	}
+	return polygon_walls(vertices, 0.1f);
+}
+
+// Builds the image tree up to range(1) reflections.
+static void BM_ImageSource_Build(benchmark::State& state)
+{
+	ImageSourceModel<float> model(star_room(static_cast<size_t>(state.range(0))));
+	for (auto _ : state) {
+		model.build(Vector2<float>(0.5f, 0.3f), static_cast<uint32_t>(state.range(1)));
+		benchmark::DoNotOptimize(model.images().data());
+	}
+	state.counters["images"] = static_cast<double>(model.size());
+}
+BENCHMARK(BM_ImageSource_Build)->Args({ 6, 3 })->Args({ 6, 5 })->Args({ 12, 3 })->Unit(benchmark::kMicrosecond);
+
+// Finds the valid paths to a listener in a cached tree, as done when only the listener moves.
+static void BM_ImageSource_Arrivals(benchmark::State& state)
+{
+	ImageSourceModel<float> model(star_room(static_cast<size_t>(state.range(0))));
+	model.build(Vector2<float>(0.5f, 0.3f), static_cast<uint32_t>(state.range(1)));
+	const Listener<float> listener{ Vector2<float>(-2.0f, 1.5f), 0.5f };
+	size_t paths = 0;
+	for (auto _ : state) {
+		paths = model.arrivals(listener).size();
+		benchmark::DoNotOptimize(paths);
+	}
+	state.counters["images"] = static_cast<double>(model.size());
+	state.counters["paths"] = static_cast<double>(paths);
+}
+BENCHMARK(BM_ImageSource_Arrivals)->Args({ 6, 3 })->Args({ 6, 5 })->Args({ 12, 3 })->Unit(benchmark::kMicrosecond);
+
+// Traces range(1) rays through the star room with range(0) points, modelled with walls.
+static void BM_Propagation_WallRoom(benchmark::State& state)
+{
+	Scene<float> scene;
+	for (auto const& wall : star_room(static_cast<size_t>(state.range(0)))) {
+		scene.add_wall(wall.segment, wall.absorption);
+	}
+	scene.build();
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	PropagationSettings<float> settings;
+	settings.ray_count = static_cast<size_t>(state.range(1));
+	settings.max_length = 200;
+	size_t arrivals = 0;
+	for (auto _ : state) {
+		arrivals = engine.run(scene, Vector2<float>(0.5f, 0.3f), Listener<float>{ Vector2<float>(-2.0f, 1.5f), 0.5f }, settings).size();
+		benchmark::DoNotOptimize(arrivals);
+	}
+	state.counters["arrivals"] = static_cast<double>(arrivals);
+	state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Propagation_WallRoom)->Args({ 6, 1000 })->Args({ 48, 1000 })->Unit(benchmark::kMillisecond);
+
+// Same room with each wall approximated by a row of small overlapping circles, as rooms had
+// to be built before walls were supported.
+static void BM_Propagation_CircleRoom(benchmark::State& state)
+{
+	Scene<float> scene;
+	const float radius = 0.05f;
+	for (auto const& wall : star_room(static_cast<size_t>(state.range(0)))) {
+		const size_t count = static_cast<size_t>(std::ceil(wall.segment.length() / radius));
+		for (size_t i = 0; i <= count; ++i) {
+			const float t = static_cast<float>(i) / static_cast<float>(count);
+			scene.add_circle(wall.segment.start() + wall.segment.delta() * t, radius, wall.absorption);
+		}
+	}
+	scene.build();
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	PropagationSettings<float> settings;
+	settings.ray_count = static_cast<size_t>(state.range(1));
+	settings.max_length = 200;
+	size_t arrivals = 0;
+	for (auto _ : state) {
+		arrivals = engine.run(scene, Vector2<float>(0.5f, 0.3f), Listener<float>{ Vector2<float>(-2.0f, 1.5f), 0.5f }, settings).size();
+		benchmark::DoNotOptimize(arrivals);
+	}
+	state.counters["arrivals"] = static_cast<double>(arrivals);
+	state.counters["circles"] = static_cast<double>(scene.circles().size());
+	state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Propagation_CircleRoom)->Args({ 6, 1000 })->Args({ 48, 1000 })->Unit(benchmark::kMillisecond);
+
+// One run per frame in the wall room, collecting the arrivals. range(0) reuses the output vector
+// across frames so that steady-state frames do not allocate; 0 returns a new vector each time.
+static void BM_Propagation_Frames(benchmark::State& state)
+{
+	Scene<float> scene;
+	for (auto const& wall : star_room(6)) {
+		scene.add_wall(wall.segment, wall.absorption);
+	}
+	scene.build();
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	PropagationSettings<float> settings;
+	settings.ray_count = 1000;
+	settings.max_length = 50;
+	settings.random_directions = true;
+	const Listener<float> listener{ Vector2<float>(-2.0f, 1.5f), 0.5f };
+	std::vector<Arrival<float>> arrivals;
+	for (auto _ : state) {
+		if (state.range(0)) {
+			engine.run(scene, Vector2<float>(0.5f, 0.3f), listener, settings, arrivals);
+		}
+		else {
+			arrivals = engine.run(scene, Vector2<float>(0.5f, 0.3f), listener, settings);
+		}
+		benchmark::DoNotOptimize(arrivals.data());
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(settings.ray_count));
+}
+BENCHMARK(BM_Propagation_Frames)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// The star room with 6 points and range(0) small scatterers inside.
+static Scene<float> scattering_room(size_t scatterers)
+{
+	Scene<float> scene;
+	for (auto const& wall : star_room(6)) {
+		scene.add_wall(wall.segment, wall.absorption);
+	}
+	const auto xs = Bench::random_values<float>(scatterers, -5.0f, 5.0f, 1);
+	const auto ys = Bench::random_values<float>(scatterers, -5.0f, 5.0f, 2);
+	for (size_t i = 0; i < scatterers; ++i) {
+		scene.add_circle(Vector2<float>(xs[i], ys[i]), 0.05f, 0.2f);
+	}
+	scene.build();
+	return scene;
+}
+
+static PropagationSettings<float> frame_settings()
+{
+	PropagationSettings<float> settings;
+	settings.ray_count = 4000;
+	settings.max_length = 30;
+	return settings;
+}
+
+// Full trace of a frame in which one scatterer has moved.
+static void BM_Propagation_FullFrame(benchmark::State& state)
+{
+	Scene<float> scene = scattering_room(static_cast<size_t>(state.range(0)));
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	const PropagationSettings<float> settings = frame_settings();
+	const Listener<float> listener{ Vector2<float>(-2.0f, 1.5f), 0.5f };
+	std::vector<Arrival<float>> arrivals;
+	size_t frame = 0;
+	for (auto _ : state) {
+		const size_t i = frame++ % scene.circles().size();
+		scene.move_circle(i, scene.circles().center(i) + Vector2<float>(0.01f, 0.0f), scene.circles().radius(i));
+		engine.run(scene, Vector2<float>(0.5f, 0.3f), listener, settings, arrivals);
+		benchmark::DoNotOptimize(arrivals.data());
+	}
+}
+BENCHMARK(BM_Propagation_FullFrame)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+// Same frames with IncrementalPropagation, which only retraces the rays near the moved scatterer.
+static void BM_Propagation_IncrementalFrame(benchmark::State& state)
+{
+	Scene<float> scene = scattering_room(static_cast<size_t>(state.range(0)));
+	ThreadPool pool(1);
+	IncrementalPropagation<float> tracer(pool, frame_settings());
+	size_t changes = 0;
+	auto count = [&](size_t, Arrival<float> const&) { ++changes; };
+	tracer.run(scene, Vector2<float>(0.5f, 0.3f), Listener<float>{ Vector2<float>(-2.0f, 1.5f), 0.5f }, count);
+	size_t frame = 0;
+	size_t retraced = 0;
+	for (auto _ : state) {
+		const size_t i = frame++ % scene.circles().size();
+		const Vector2<float> center = scene.circles().center(i);
+		scene.move_circle(i, center + Vector2<float>(0.01f, 0.0f), scene.circles().radius(i));
+		tracer.moved_circle(i, center, scene.circles().radius(i));
+		retraced += tracer.update(scene, count);
+	}
+	benchmark::DoNotOptimize(changes);
+	state.counters["retraced"] = benchmark::Counter(static_cast<double>(retraced), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Propagation_IncrementalFrame)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+// Octave-band absorption of the walls of the star room, rising towards high frequencies.
+static const Bands<float> band_absorption{ { 0.02f, 0.03f, 0.05f, 0.08f, 0.12f, 0.2f, 0.3f, 0.4f } };
+
+// Eight scalar runs, one per band, with the band's absorption and air attenuation per arrival.
+static void BM_Propagation_PerBandRuns(benchmark::State& state)
+{
+	std::vector<Scene<float>> scenes(Bands<float>::count);
+	for (size_t b = 0; b < scenes.size(); ++b) {
+		for (auto const& wall : star_room(6)) {
+			scenes[b].add_wall(wall.segment, band_absorption[b]);
+		}
+		scenes[b].build();
+	}
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	PropagationSettings<float> settings = frame_settings();
+	const AirAbsorption<float> air = AirAbsorption<float>::standard();
+	const Listener<float> listener{ Vector2<float>(-2.0f, 1.5f), 0.5f };
+	float total = 0;
+	for (auto _ : state) {
+		for (size_t b = 0; b < scenes.size(); ++b) {
+			engine.run(scenes[b], Vector2<float>(0.5f, 0.3f), listener, settings, [&](size_t, Arrival<float> const& a) {
+				total += a.energy * std::exp(-air.per_meter[b] * a.length);
+			});
+		}
+	}
+	benchmark::DoNotOptimize(total);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(settings.ray_count));
+}
+BENCHMARK(BM_Propagation_PerBandRuns)->Unit(benchmark::kMicrosecond);
+
+// A single run carrying all eight band energies.
+static void BM_Propagation_BandRun(benchmark::State& state)
+{
+	Scene<float> scene;
+	for (auto const& wall : star_room(6)) {
+		scene.add_wall(wall.segment, band_absorption);
+	}
+	scene.build();
+	ThreadPool pool(1);
+	const PropagationEngine<float> engine(pool);
+	PropagationSettings<float> settings = frame_settings();
+	const AirAbsorption<float> air = AirAbsorption<float>::standard();
+	const Listener<float> listener{ Vector2<float>(-2.0f, 1.5f), 0.5f };
+	Bands<float> total = Bands<float>::broadcast(0);
+	for (auto _ : state) {
+		engine.run_bands(scene, Vector2<float>(0.5f, 0.3f), listener, settings, air, [&](size_t, BandArrival<float> const& a) {
+			total += a.energy;
+		});
+	}
+	benchmark::DoNotOptimize(total);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(settings.ray_count));
+}
+BENCHMARK(BM_Propagation_BandRun)->Unit(benchmark::kMicrosecond);
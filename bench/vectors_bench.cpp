@@ -0,0 +1,335 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "vectors.hpp"
+#include "vector_batch.hpp"
+#include "ray_packet.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+namespace
+{
+	std::vector<Vector2<float>> random_vectors(size_t count, uint32_t seed = 1)
+	{
+		const auto xs = Bench::random_values<float>(count, -10.0f, 10.0f, seed);
+		const auto ys = Bench::random_values<float>(count, -10.0f, 10.0f, seed + 1);
+		std::vector<Vector2<float>> vectors;
+		vectors.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			vectors.emplace_back(xs[i], ys[i]);
+		}
+		return vectors;
+	}
+}
+
+static void BM_Vector2_Magnitude(benchmark::State& state)
+{
+	const auto vectors = random_vectors(static_cast<size_t>(state.range(0)));
+	std::vector<float> out(vectors.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < vectors.size(); ++i) {
+			out[i] = vectors[i].magnitude();
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2_Magnitude)->Arg(1 << 16);
+
+static void BM_Vector2_MagnitudeFast(benchmark::State& state)
+{
+	const auto vectors = random_vectors(static_cast<size_t>(state.range(0)));
+	std::vector<float> out(vectors.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < vectors.size(); ++i) {
+			out[i] = vectors[i].magnitude<FastMath>();
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2_MagnitudeFast)->Arg(1 << 16);
+
+static void BM_Vector2Batch_Magnitudes(benchmark::State& state)
+{
+	const Vector2Batch<float> batch(random_vectors(static_cast<size_t>(state.range(0))));
+	std::vector<float> out(batch.size());
+	for (auto _ : state) {
+		batch.magnitudes(out.data());
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_Magnitudes)->Arg(1 << 16);
+
+static void BM_Vector2_Normalized(benchmark::State& state)
+{
+	auto vectors = random_vectors(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		for (auto& v : vectors) {
+			v = v.normalized();
+		}
+		benchmark::DoNotOptimize(vectors.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2_Normalized)->Arg(1 << 16);
+
+static void BM_Vector2Batch_Normalize(benchmark::State& state)
+{
+	Vector2Batch<float> batch(random_vectors(static_cast<size_t>(state.range(0))));
+	for (auto _ : state) {
+		batch.normalize();
+		benchmark::DoNotOptimize(batch.x());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_Normalize)->Arg(1 << 16);
+
+static void BM_Vector2_Dot(benchmark::State& state)
+{
+	const auto a = random_vectors(static_cast<size_t>(state.range(0)), 1);
+	const auto b = random_vectors(static_cast<size_t>(state.range(0)), 3);
+	std::vector<float> out(a.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < a.size(); ++i) {
+			out[i] = a[i].dot(b[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2_Dot)->Arg(1 << 16);
+
+static void BM_Vector2Batch_Dot(benchmark::State& state)
+{
+	const Vector2Batch<float> a(random_vectors(static_cast<size_t>(state.range(0)), 1));
+	const Vector2Batch<float> b(random_vectors(static_cast<size_t>(state.range(0)), 3));
+	std::vector<float> out(a.size());
+	for (auto _ : state) {
+		a.dot(b, out.data());
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_Dot)->Arg(1 << 16);
+
+// Projection of every vector onto one direction, against the same kernel over 16-bit storage
+// below. At 1 << 22 vectors the batch no longer fits in cache and the loads dominate.
+static void BM_Vector2Batch_DotDirection(benchmark::State& state)
+{
+	const Vector2Batch<float> batch(random_vectors(static_cast<size_t>(state.range(0))));
+	const Vector2<float> direction = Vector2<float>(1, 2).normalized();
+	std::vector<float> out(batch.size());
+	for (auto _ : state) {
+		batch.dot(direction, out.data());
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_DotDirection)->Arg(1 << 16)->Arg(1 << 22);
+
+template <typename S>
+static void BM_CompactVector2Batch_DotDirection(benchmark::State& state)
+{
+	const CompactVector2Batch<S> batch{ Vector2Batch<float>(random_vectors(static_cast<size_t>(state.range(0)))) };
+	const Vector2<float> direction = Vector2<float>(1, 2).normalized();
+	std::vector<float> out(batch.size());
+	for (auto _ : state) {
+		batch.dot(direction, out.data());
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_CompactVector2Batch_DotDirection, Half)->Arg(1 << 16)->Arg(1 << 22);
+BENCHMARK_TEMPLATE(BM_CompactVector2Batch_DotDirection, BFloat16)->Arg(1 << 16)->Arg(1 << 22);
+BENCHMARK_TEMPLATE(BM_CompactVector2Batch_DotDirection, int16_t)->Arg(1 << 16)->Arg(1 << 22);
+
+static void BM_Vector2_Reflect(benchmark::State& state)
+{
+	auto vectors = random_vectors(static_cast<size_t>(state.range(0)));
+	const Vector2<float> normal = Vector2<float>(1, 2).normalized();
+	for (auto _ : state) {
+		for (auto& v : vectors) {
+			v = v.reflect(normal);
+		}
+		benchmark::DoNotOptimize(vectors.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2_Reflect)->Arg(1 << 16);
+
+static void BM_Vector2Batch_Reflect(benchmark::State& state)
+{
+	Vector2Batch<float> batch(random_vectors(static_cast<size_t>(state.range(0))));
+	const Vector2<float> normal = Vector2<float>(1, 2).normalized();
+	for (auto _ : state) {
+		batch.reflect(normal);
+		benchmark::DoNotOptimize(batch.x());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_Reflect)->Arg(1 << 16);
+
+template <class Math>
+static void BM_Vector2_Rotate(benchmark::State& state)
+{
+	auto vectors = random_vectors(static_cast<size_t>(state.range(0)));
+	for (auto _ : state) {
+		for (auto& v : vectors) {
+			v = v.template rotate<Math>(0.01f);
+		}
+		benchmark::DoNotOptimize(vectors.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_Vector2_Rotate, StdMath)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_Vector2_Rotate, FastMath)->Arg(1 << 16);
+
+static void BM_Vector2Batch_Rotate(benchmark::State& state)
+{
+	Vector2Batch<float> batch(random_vectors(static_cast<size_t>(state.range(0))));
+	const auto rotation = Rotation2<float>::Angle(0.01f);
+	for (auto _ : state) {
+		batch.rotate(rotation);
+		benchmark::DoNotOptimize(batch.x());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector2Batch_Rotate)->Arg(1 << 16);
+
+static void BM_Ray2_IntersectCircle(benchmark::State& state)
+{
+	const auto positions = random_vectors(static_cast<size_t>(state.range(0)), 1);
+	const auto directions = random_vectors(static_cast<size_t>(state.range(0)), 3);
+	std::vector<Ray2<float>> rays;
+	for (size_t i = 0; i < positions.size(); ++i) {
+		rays.emplace_back(positions[i], directions[i].normalized());
+	}
+	const Vector2<float> center(1, 2);
+	size_t hits = 0;
+	for (auto _ : state) {
+		for (auto const& ray : rays) {
+			hits += ray.intersect_circle(center, 3.0f).has_value();
+		}
+	}
+	benchmark::DoNotOptimize(hits);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Ray2_IntersectCircle)->Arg(1 << 16);
+
+static void BM_Ray2_IntersectCircleUnit(benchmark::State& state)
+{
+	const auto positions = random_vectors(static_cast<size_t>(state.range(0)), 1);
+	const auto directions = random_vectors(static_cast<size_t>(state.range(0)), 3);
+	std::vector<Ray2<float>> rays;
+	for (size_t i = 0; i < positions.size(); ++i) {
+		rays.emplace_back(positions[i], directions[i].normalized());
+	}
+	const Vector2<float> center(1, 2);
+	size_t hits = 0;
+	for (auto _ : state) {
+		for (auto const& ray : rays) {
+			hits += ray.intersect_circle_unit(center, 3.0f).has_value();
+		}
+	}
+	benchmark::DoNotOptimize(hits);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Ray2_IntersectCircleUnit)->Arg(1 << 16);
+
+// Ray/circle tests per second for a packet against a circle set.
+static void BM_Ray2Packet_Intersect(benchmark::State& state)
+{
+	const size_t ray_count = static_cast<size_t>(state.range(0));
+	const size_t circle_count = static_cast<size_t>(state.range(1));
+	const auto positions = random_vectors(ray_count, 1);
+	const auto directions = random_vectors(ray_count, 3);
+	std::vector<Ray2<float>> rays;
+	for (size_t i = 0; i < ray_count; ++i) {
+		rays.emplace_back(positions[i], directions[i].normalized());
+	}
+	const Ray2Packet<float> packet(rays);
+	CircleSet<float> circles;
+	for (auto const& c : random_vectors(circle_count, 5)) {
+		circles.push_back(c, 0.2f);
+	}
+	std::vector<int32_t> index(ray_count);
+	std::vector<float> distance(ray_count);
+	for (auto _ : state) {
+		packet.intersect(circles, index.data(), distance.data());
+		benchmark::DoNotOptimize(distance.data());
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ray_count * circle_count));
+}
+BENCHMARK(BM_Ray2Packet_Intersect)->Args({ 1 << 12, 64 })->Args({ 1 << 12, 1024 });
+
+namespace
+{
+	// Walls of length 1 at random positions and orientations.
+	std::vector<Segment2<float>> random_walls(size_t count)
+	{
+		const auto starts = random_vectors(count, 5);
+		const auto directions = random_vectors(count, 7);
+		std::vector<Segment2<float>> walls;
+		for (size_t i = 0; i < count; ++i) {
+			walls.emplace_back(starts[i], starts[i] + directions[i].normalized());
+		}
+		return walls;
+	}
+}
+
+// Ray/wall tests per second, one ray and one wall at a time.
+static void BM_Ray2_IntersectSegment(benchmark::State& state)
+{
+	const size_t ray_count = static_cast<size_t>(state.range(0));
+	const auto positions = random_vectors(ray_count, 1);
+	const auto directions = random_vectors(ray_count, 3);
+	std::vector<Ray2<float>> rays;
+	for (size_t i = 0; i < ray_count; ++i) {
+		rays.emplace_back(positions[i], directions[i].normalized());
+	}
+	const auto walls = random_walls(static_cast<size_t>(state.range(1)));
+	size_t hits = 0;
+	for (auto _ : state) {
+		for (auto const& ray : rays) {
+			for (auto const& wall : walls) {
+				hits += ray.intersect_segment(wall).has_value();
+			}
+		}
+	}
+	benchmark::DoNotOptimize(hits);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ray_count * walls.size()));
+}
+BENCHMARK(BM_Ray2_IntersectSegment)->Args({ 1 << 12, 64 });
+
+// Ray/wall tests per second for a packet against a segment set.
+static void BM_Ray2Packet_IntersectSegments(benchmark::State& state)
+{
+	const size_t ray_count = static_cast<size_t>(state.range(0));
+	const auto positions = random_vectors(ray_count, 1);
+	const auto directions = random_vectors(ray_count, 3);
+	std::vector<Ray2<float>> rays;
+	for (size_t i = 0; i < ray_count; ++i) {
+		rays.emplace_back(positions[i], directions[i].normalized());
+	}
+	const Ray2Packet<float> packet(rays);
+	SegmentSet<float> walls;
+	for (auto const& wall : random_walls(static_cast<size_t>(state.range(1)))) {
+		walls.push_back(wall);
+	}
+	std::vector<int32_t> index(ray_count);
+	std::vector<float> distance(ray_count);
+	for (auto _ : state) {
+		packet.intersect(walls, index.data(), distance.data());
+		benchmark::DoNotOptimize(distance.data());
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ray_count * walls.size()));
+}
+BENCHMARK(BM_Ray2Packet_IntersectSegments)->Args({ 1 << 12, 64 })->Args({ 1 << 12, 1024 });
@@ -0,0 +1,213 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "audio.hpp"
+#include "wavefile.hpp"
+#include "ring_buffer.hpp"
+#include "bench_util.hpp"
+
+using namespace JMP;
+
+static void BM_WaveFile_WriteFloat(benchmark::State& state)
+{
+	const auto samples = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_write.wav");
+	for (auto _ : state) {
+		if (!WaveFile::write(path, 2, 48000, samples)) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_WaveFile_WriteFloat)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+
+// Same samples as BM_WaveFile_WriteFloat held in range(1) separate buffers, as in a ring
+// buffer, written with one gathered write instead of being copied into a single vector.
+static void BM_WaveFile_WriteGather(benchmark::State& state)
+{
+	const auto samples = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	const size_t part_size = samples.size() / static_cast<size_t>(state.range(1));
+	std::vector<WaveFile::SampleView<float>> parts;
+	for (size_t i = 0; i < samples.size(); i += part_size) {
+		parts.emplace_back(samples.data() + i, std::min(part_size, samples.size() - i));
+	}
+	const std::string path = Bench::temp_path("jmp_bench_gather.wav");
+	for (auto _ : state) {
+		if (!WaveFile::write(path, 2, 48000, parts.data(), parts.size())) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_WaveFile_WriteGather)->Args({ 1 << 22, 256 })->Unit(benchmark::kMillisecond);
+
+// range(0) short files of range(1) samples each, written one by one and as a batch.
+static void BM_WaveFile_WriteSnippets(benchmark::State& state)
+{
+	const auto samples = Bench::random_values<float>(static_cast<size_t>(state.range(1)), -1.0f, 1.0f);
+	std::vector<std::string> paths;
+	for (int64_t i = 0; i < state.range(0); ++i) {
+		paths.push_back(Bench::temp_path("jmp_bench_snippet_" + std::to_string(i) + ".wav"));
+	}
+	for (auto _ : state) {
+		for (auto const& path : paths) {
+			WaveFile::write(path, 1, 48000, samples);
+		}
+	}
+	for (auto const& path : paths) {
+		std::remove(path.c_str());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WaveFile_WriteSnippets)->Args({ 1000, 512 })->Unit(benchmark::kMillisecond);
+
+static void BM_WaveFile_WriteBatch(benchmark::State& state)
+{
+	const auto samples = Bench::random_values<float>(static_cast<size_t>(state.range(1)), -1.0f, 1.0f);
+	std::vector<WaveFile::BatchFile<float>> files;
+	for (int64_t i = 0; i < state.range(0); ++i) {
+		files.push_back({ Bench::temp_path("jmp_bench_snippet_" + std::to_string(i) + ".wav"), samples });
+	}
+	for (auto _ : state) {
+		if (WaveFile::write_batch(1, 48000, files) != files.size()) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	for (auto const& file : files) {
+		std::remove(file.filename.c_str());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WaveFile_WriteBatch)->Args({ 1000, 512 })->Unit(benchmark::kMillisecond);
+
+static void BM_WaveFile_WriteInt16(benchmark::State& state)
+{
+	const auto input = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_write16.wav");
+	std::vector<int16_t> samples(input.size());
+	for (auto _ : state) {
+		Audio::convert(input.data(), samples.data(), input.size());
+		if (!WaveFile::write(path, 2, 48000, samples)) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_WaveFile_WriteInt16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+
+// Streams the same amount of data as BM_WaveFile_WriteFloat in blocks of range(1) samples.
+static void BM_WaveFile_WriterBlocks(benchmark::State& state)
+{
+	const size_t total = static_cast<size_t>(state.range(0));
+	const auto block = Bench::random_values<float>(static_cast<size_t>(state.range(1)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_writer.wav");
+	for (auto _ : state) {
+		WaveFile::Writer writer(path, 2, 48000, WaveFile::AudioFormat::FLOAT, 32);
+		for (size_t written = 0; written < total; written += block.size()) {
+			writer.write(block.data(), block.size());
+		}
+		if (!writer.close()) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_WaveFile_WriterBlocks)->Args({ 1 << 22, 4096 })->Unit(benchmark::kMillisecond);
+
+// Same stream as BM_WaveFile_WriterBlocks through the asynchronous writer; range(2) selects
+// unbuffered (direct) I/O.
+static void BM_WaveFile_AsyncWriterBlocks(benchmark::State& state)
+{
+	const size_t total = static_cast<size_t>(state.range(0));
+	const auto block = Bench::random_values<float>(static_cast<size_t>(state.range(1)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_async_writer.wav");
+	AsyncFileOptions options;
+	options.direct = state.range(2) != 0;
+	for (auto _ : state) {
+		WaveFile::AsyncWriter writer(path, 2, 48000, WaveFile::AudioFormat::FLOAT, 32, options);
+		for (size_t written = 0; written < total; written += block.size()) {
+			writer.write(block.data(), block.size());
+		}
+		if (!writer.close()) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_WaveFile_AsyncWriterBlocks)->Args({ 1 << 22, 4096, 0 })->Args({ 1 << 22, 4096, 1 })->Unit(benchmark::kMillisecond);
+
+// Capture as from an audio callback: a producer thread pushes small blocks into a ring buffer
+// while the benchmark thread drains it into the asynchronous writer. range(1) is the callback
+// block size. Both sides yield when they cannot make progress (a full ring would be an
+// overrun for a real callback).
+static void BM_RingBuffer_CaptureToAsyncWriter(benchmark::State& state)
+{
+	const size_t total = static_cast<size_t>(state.range(0));
+	const auto block = Bench::random_values<float>(static_cast<size_t>(state.range(1)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_ring_capture.wav");
+	Audio::RingBuffer<float> ring(1 << 16);
+	for (auto _ : state) {
+		WaveFile::AsyncWriter writer(path, 2, 48000, WaveFile::AudioFormat::FLOAT, 32);
+		std::atomic<bool> done{ false };
+		std::thread producer([&] {
+			for (size_t written = 0; written < total;) {
+				const size_t n = ring.write(block.data(), std::min(block.size(), total - written));
+				if (n == 0) {
+					std::this_thread::yield();
+				}
+				written += n;
+			}
+			done.store(true, std::memory_order_release);
+		});
+		bool ok = true;
+		while (!done.load(std::memory_order_acquire)) {
+			if (ring.read_available() == 0) {
+				std::this_thread::yield();
+			}
+			ok = ring.drain(writer) && ok;
+		}
+		producer.join();
+		ok = ring.drain(writer) && ok;
+		if (!writer.close() || !ok) {
+			state.SkipWithError("write failed");
+			break;
+		}
+	}
+	std::remove(path.c_str());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(sizeof(float)));
+}
+BENCHMARK(BM_RingBuffer_CaptureToAsyncWriter)->Args({ 1 << 22, 256 })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_WaveFile_ReaderOpen(benchmark::State& state)
+{
+	const auto samples = Bench::random_values<float>(static_cast<size_t>(state.range(0)), -1.0f, 1.0f);
+	const std::string path = Bench::temp_path("jmp_bench_read.wav");
+	WaveFile::write(path, 2, 48000, samples);
+	for (auto _ : state) {
+		WaveFile::Reader reader(path);
+		benchmark::DoNotOptimize(reader.samples<float>().data());
+	}
+	std::remove(path.c_str());
+}
+BENCHMARK(BM_WaveFile_ReaderOpen)->Arg(1 << 22);
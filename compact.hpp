@@ -0,0 +1,402 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "memory.hpp"
+#include "simd.hpp"
+
+namespace JMP
+{
+	// 16-bit storage formats for large float buffers, half the size and memory traffic of
+	// float. They are storage only: values are decoded to float when loaded (a whole SIMD
+	// register at a time with simd::decode()) and all computation stays in float.
+	//
+	// Half is IEEE 754 binary16, 11 significant bits between about 6e-5 and 65504.
+	// BFloat16 is the upper half of a float, with its full range but only 8 significant bits.
+	// int16_t is fixed point with a scale chosen per buffer: value = q * scale, which gives a
+	// uniform absolute error of scale / 2 over [-32767, 32767] * scale, e.g. for positions in
+	// a scene of known extent.
+	//
+	// Encoding rounds to nearest, ties to even, in every format; values beyond the range
+	// become infinities with Half and the largest step with int16_t.
+	struct Half {
+		uint16_t bits;
+	};
+
+	struct BFloat16 {
+		uint16_t bits;
+	};
+
+	template <typename S>
+	struct is_compact : std::bool_constant<std::is_same<S, Half>::value || std::is_same<S, BFloat16>::value
+		|| std::is_same<S, int16_t>::value> {};
+
+	inline Half to_half(float value) noexcept
+	{
+		uint32_t u;
+		std::memcpy(&u, &value, sizeof(u));
+		const uint16_t sign = static_cast<uint16_t>((u >> 16) & 0x8000);
+		const uint32_t exponent = (u >> 23) & 0xff;
+		uint32_t mantissa = u & 0x7fffff;
+		if (exponent == 0xff) {
+			// Keeps NaNs quiet and their top payload bits.
+			return Half{ static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 | (mantissa >> 13) : 0)) };
+		}
+		const int e = static_cast<int>(exponent) - 127 + 15;
+		if (e >= 31) {
+			return Half{ static_cast<uint16_t>(sign | 0x7c00) };
+		}
+		if (e <= 0) {
+			// Subnormal in half precision, in steps of 2^-24.
+			if (e < -10) {
+				return Half{ sign };
+			}
+			mantissa |= 0x800000;
+			const uint32_t shift = static_cast<uint32_t>(14 - e);
+			uint32_t h = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+			const uint32_t tie = 1u << (shift - 1);
+			if (rest > tie || (rest == tie && (h & 1))) {
+				++h;
+			}
+			return Half{ static_cast<uint16_t>(sign | h) };
+		}
+		// A carry out of the mantissa correctly moves to the next exponent, or to infinity.
+		uint32_t h = (static_cast<uint32_t>(e) << 10) | (mantissa >> 13);
+		const uint32_t rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+			++h;
+		}
+		return Half{ static_cast<uint16_t>(sign | h) };
+	}
+
+	inline float to_float(Half value) noexcept
+	{
+		const uint32_t sign = static_cast<uint32_t>(value.bits & 0x8000) << 16;
+		const uint32_t exponent = (value.bits >> 10) & 0x1f;
+		const uint32_t mantissa = value.bits & 0x3ff;
+		uint32_t u;
+		if (exponent == 0) {
+			const float magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+			return sign != 0 ? -magnitude : magnitude;
+		}
+		if (exponent == 31) {
+			u = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else {
+			u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	inline BFloat16 to_bfloat16(float value) noexcept
+	{
+		uint32_t u;
+		std::memcpy(&u, &value, sizeof(u));
+		if ((u & 0x7fffffff) > 0x7f800000) {
+			return BFloat16{ static_cast<uint16_t>((u >> 16) | 0x40) };
+		}
+		return BFloat16{ static_cast<uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16) };
+	}
+
+	inline float to_float(BFloat16 value) noexcept
+	{
+		const uint32_t u = static_cast<uint32_t>(value.bits) << 16;
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	// Fixed point with inv_scale = 1 / scale. NaN gives an unspecified value.
+	inline int16_t to_fixed16(float value, float inv_scale) noexcept
+	{
+		// In this order NaN compares false and is clamped too.
+		const float q = std::min(32767.0f, std::max(-32767.0f, value * inv_scale));
+		return static_cast<int16_t>(std::nearbyint(q));
+	}
+
+	namespace simd {
+
+		// Loads P::width stored values as a pack of floats. int16_t values are converted
+		// as integers, the caller applies their scale.
+		inline Scalar<float> decode(Scalar<float>, Half const* p) { return { to_float(*p) }; }
+		inline Scalar<float> decode(Scalar<float>, BFloat16 const* p) { return { to_float(*p) }; }
+		inline Scalar<float> decode(Scalar<float>, int16_t const* p) { return { static_cast<float>(*p) }; }
+
+		namespace detail {
+			template <class P, typename S>
+			inline P decode_lanes(S const* p)
+			{
+				alignas(64) float values[P::width];
+				for (size_t i = 0; i < P::width; ++i) {
+					values[i] = to_float(p[i]);
+				}
+				return P::load(values);
+			}
+		}
+
+#if defined(JMP_SIMD_AVX512)
+		inline F32x16 decode(F32x16, Half const* p)
+		{
+			return { _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p))) };
+		}
+		inline F32x16 decode(F32x16, BFloat16 const* p)
+		{
+			const __m512i u = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)));
+			return { _mm512_castsi512_ps(_mm512_slli_epi32(u, 16)) };
+		}
+		inline F32x16 decode(F32x16, int16_t const* p)
+		{
+			return { _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)))) };
+		}
+#elif defined(JMP_SIMD_AVX2)
+		inline F32x8 decode(F32x8, Half const* p)
+		{
+#if defined(JMP_SIMD_F16C)
+			return { _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p))) };
+#else
+			return detail::decode_lanes<F32x8>(p);
+#endif
+		}
+		inline F32x8 decode(F32x8, BFloat16 const* p)
+		{
+			const __m256i u = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)));
+			return { _mm256_castsi256_ps(_mm256_slli_epi32(u, 16)) };
+		}
+		inline F32x8 decode(F32x8, int16_t const* p)
+		{
+			return { _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)))) };
+		}
+#elif defined(JMP_SIMD_SSE2)
+		inline F32x4 decode(F32x4, Half const* p)
+		{
+#if defined(JMP_SIMD_F16C)
+			return { _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p))) };
+#else
+			return detail::decode_lanes<F32x4>(p);
+#endif
+		}
+		inline F32x4 decode(F32x4, BFloat16 const* p)
+		{
+			const __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(p));
+			return { _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), v)) };
+		}
+		inline F32x4 decode(F32x4, int16_t const* p)
+		{
+			// Each value lands in the upper half of its lane; the shift extends the sign.
+			const __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(p));
+			return { _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)) };
+		}
+#elif defined(JMP_SIMD_NEON64)
+		inline F32x4 decode(F32x4, Half const* p)
+		{
+			return { vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(reinterpret_cast<uint16_t const*>(p)))) };
+		}
+		inline F32x4 decode(F32x4, BFloat16 const* p)
+		{
+			return { vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(reinterpret_cast<uint16_t const*>(p)), 16)) };
+		}
+		inline F32x4 decode(F32x4, int16_t const* p)
+		{
+			return { vcvtq_f32_s32(vmovl_s16(vld1_s16(p))) };
+		}
+#endif
+	}
+
+	// Bulk conversions between float and the storage formats. scale only applies to int16_t.
+	inline void encode(float const* input, Half* output, size_t count, float = 1)
+	{
+		size_t i = 0;
+#if defined(JMP_SIMD_AVX512)
+		for (; i + 16 <= count; i += 16) {
+			const __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), h);
+		}
+#elif defined(JMP_SIMD_F16C)
+		for (; i + 8 <= count; i += 8) {
+			const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), h);
+		}
+#elif defined(JMP_SIMD_NEON64)
+		for (; i + 4 <= count; i += 4) {
+			vst1_u16(reinterpret_cast<uint16_t*>(output + i), vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i))));
+		}
+#endif
+		for (; i < count; ++i) {
+			output[i] = to_half(input[i]);
+		}
+	}
+
+	inline void encode(float const* input, BFloat16* output, size_t count, float = 1)
+	{
+		// Integer rounding the compiler vectorizes by itself.
+		for (size_t i = 0; i < count; ++i) {
+			output[i] = to_bfloat16(input[i]);
+		}
+	}
+
+	inline void encode(float const* input, int16_t* output, size_t count, float scale = 1)
+	{
+		const float inv_scale = 1 / scale;
+		size_t i = 0;
+#if defined(JMP_SIMD_SSE2)
+		// Converts with the current rounding mode, to nearest by default, as nearbyint() does.
+		const __m128 s = _mm_set1_ps(inv_scale);
+		const __m128 lo = _mm_set1_ps(-32767.0f);
+		const __m128 hi = _mm_set1_ps(32767.0f);
+		for (; i + 8 <= count; i += 8) {
+			const __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i), s), lo), hi);
+			const __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4), s), lo), hi);
+			const __m128i q = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), q);
+		}
+#elif defined(JMP_SIMD_NEON64)
+		const float32x4_t s = vdupq_n_f32(inv_scale);
+		const float32x4_t lo = vdupq_n_f32(-32767.0f);
+		const float32x4_t hi = vdupq_n_f32(32767.0f);
+		for (; i + 4 <= count; i += 4) {
+			const float32x4_t v = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(input + i), s), lo), hi);
+			vst1_s16(output + i, vqmovn_s32(vcvtnq_s32_f32(v)));
+		}
+#endif
+		for (; i < count; ++i) {
+			output[i] = to_fixed16(input[i], inv_scale);
+		}
+	}
+
+	template <typename S, std::enable_if_t<is_compact<S>::value, bool> = true>
+	inline void decode(S const* input, float* output, size_t count, float scale = 1)
+	{
+		simd::for_each_pack<float>(count, [&](auto p, size_t i) {
+			using P = decltype(p);
+			if constexpr (std::is_same<S, int16_t>::value) {
+				(simd::decode(P{}, input + i) * P::broadcast(scale)).store(output + i);
+			}
+			else {
+				simd::decode(P{}, input + i).store(output + i);
+			}
+		});
+	}
+
+	// Scale that fits count values into int16_t fixed point with the finest step.
+	inline float fixed16_scale(float const* values, size_t count) noexcept
+	{
+		float largest = 0;
+		for (size_t i = 0; i < count; ++i) {
+			largest = std::max(largest, std::abs(values[i]));
+		}
+		return largest > 0 ? largest / 32767.0f : 1.0f;
+	}
+
+	// Cache-line aligned array of floats kept in a 16-bit storage format S (Half, BFloat16 or
+	// int16_t). load<P>(i) decodes P::width values straight into a register, so kernels read
+	// half the bytes of a float array and compute as before; decode() expands a range into
+	// floats for code that needs them in memory.
+	//
+	// With int16_t the scale is fixed when the array is filled: assign() without a scale picks
+	// the finest one for its values, and later writes saturate at that range.
+	// Usage:
+	//
+	// CompactArray<Half> bins(ir.data(), ir.size());
+	// bins.decode(first, count, block.data());
+	//
+	template <typename S>
+	class CompactArray {
+		static_assert(is_compact<S>::value, "CompactArray stores Half, BFloat16 or int16_t");
+
+	public:
+		using storage_type = std::vector<S, AlignedAllocator<S>>;
+
+	private:
+		storage_type _data;
+		float _scale = 1;
+
+	public:
+		CompactArray() = default;
+
+		// count zeros, with a fixed-point step of scale.
+		explicit CompactArray(size_t count, float scale = 1) : _data(count, S{}), _scale(scale) {}
+
+		CompactArray(float const* values, size_t count) { assign(values, count); }
+
+		CompactArray(float const* values, size_t count, float scale) { assign(values, count, scale); }
+
+		void assign(float const* values, size_t count)
+		{
+			assign(values, count, std::is_same<S, int16_t>::value ? fixed16_scale(values, count) : 1.0f);
+		}
+
+		void assign(float const* values, size_t count, float scale)
+		{
+			_scale = scale;
+			_data.resize(count);
+			encode(values, _data.data(), count, _scale);
+		}
+
+		size_t size() const noexcept { return _data.size(); }
+		bool empty() const noexcept { return _data.empty(); }
+		size_t bytes() const noexcept { return _data.size() * sizeof(S); }
+		// Step of the int16_t fixed point, 1 for the floating point formats.
+		float scale() const noexcept { return _scale; }
+
+		S* data() noexcept { return _data.data(); }
+		S const* data() const noexcept { return _data.data(); }
+
+		float operator[](size_t i) const
+		{
+			if constexpr (std::is_same<S, int16_t>::value) {
+				return static_cast<float>(_data[i]) * _scale;
+			}
+			else {
+				return to_float(_data[i]);
+			}
+		}
+
+		void set(size_t i, float value) { encode(&value, _data.data() + i, 1, _scale); }
+
+		// Encodes count values over [first, first + count).
+		void store(size_t first, float const* values, size_t count)
+		{
+			encode(values, _data.data() + first, count, _scale);
+		}
+
+		// P::width values from index i as floats, for kernels written with simd::for_each_pack.
+		template <class P>
+		P load(size_t i) const
+		{
+			if constexpr (std::is_same<S, int16_t>::value) {
+				return simd::decode(P{}, _data.data() + i) * P::broadcast(_scale);
+			}
+			else {
+				return simd::decode(P{}, _data.data() + i);
+			}
+		}
+
+		// Decodes [first, first + count) into out.
+		void decode(size_t first, size_t count, float* out) const
+		{
+			JMP::decode(_data.data() + first, out, count, _scale);
+		}
+
+		std::vector<float> decode() const
+		{
+			std::vector<float> values(size());
+			decode(0, size(), values.data());
+			return values;
+		}
+	};
+}
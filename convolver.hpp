@@ -0,0 +1,320 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "audio.hpp"
+#include "fft.hpp"
+#include "memory.hpp"
+#include "simd.hpp"
+#include "wavefile.hpp"
+
+namespace JMP
+{
+	namespace Audio {
+
+		namespace detail {
+
+			// Uniformly partitioned overlap-save convolution: the impulse response is cut into
+			// partitions of one block, each transformed once with an FFT of two blocks. Every
+			// block of input is transformed into a frequency-domain delay line, and the output
+			// block is the inverse transform of the sum of the last spectra times the partitions.
+			template <typename T>
+			class UniformPartitions {
+				using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+				size_t _block = 0;
+				size_t _partitions = 0;
+				// Bins of a spectrum, rounded up so that every spectrum starts aligned.
+				size_t _stride = 0;
+				size_t _current = 0;
+				RealFFT<T> _fft;
+				storage_type _ir_re, _ir_im;
+				storage_type _delay_re, _delay_im;
+				storage_type _sum_re, _sum_im;
+				// The previous and current input blocks.
+				storage_type _input;
+				storage_type _output;
+
+			public:
+				UniformPartitions() = default;
+
+				UniformPartitions(T const* ir, size_t length, size_t block)
+					: _block(block), _partitions((length + block - 1) / block),
+					_stride((block + 1 + 15) & ~size_t(15)), _fft(2 * block),
+					_ir_re(_partitions * _stride), _ir_im(_partitions * _stride),
+					_delay_re(_partitions * _stride), _delay_im(_partitions * _stride),
+					_sum_re(_stride), _sum_im(_stride), _input(2 * block), _output(2 * block)
+				{
+					// The 1 / size of the inverse transform is folded into the partitions.
+					const T scale = T(1) / static_cast<T>(2 * block);
+					for (size_t p = 0; p < _partitions; ++p) {
+						std::fill(_output.begin(), _output.end(), T(0));
+						const size_t count = std::min(block, length - p * block);
+						for (size_t i = 0; i < count; ++i) {
+							_output[i] = ir[p * block + i] * scale;
+						}
+						_fft.forward(_output.data(), _ir_re.data() + p * _stride, _ir_im.data() + p * _stride);
+					}
+				}
+
+				size_t block_size() const noexcept { return _block; }
+				size_t partitions() const noexcept { return _partitions; }
+
+				void reset()
+				{
+					std::fill(_delay_re.begin(), _delay_re.end(), T(0));
+					std::fill(_delay_im.begin(), _delay_im.end(), T(0));
+					std::fill(_input.begin(), _input.end(), T(0));
+					_current = 0;
+				}
+
+				// Convolves the next block_size() input samples, adding the block_size() output
+				// samples at the same times to output.
+				void process(T const* input, T* output)
+				{
+					std::copy_n(_input.data() + _block, _block, _input.data());
+					std::copy_n(input, _block, _input.data() + _block);
+
+					_current = _current == 0 ? _partitions - 1 : _current - 1;
+					T* xr = _delay_re.data() + _current * _stride;
+					T* xi = _delay_im.data() + _current * _stride;
+					_fft.forward(_input.data(), xr, xi);
+
+					// Spectrum p of the delay line, counting back from the newest, meets partition p.
+					const size_t bins = _fft.bins();
+					std::fill_n(_sum_re.data(), bins, T(0));
+					std::fill_n(_sum_im.data(), bins, T(0));
+					for (size_t p = 0; p < _partitions; ++p) {
+						const size_t slot = (_current + p) % _partitions;
+						T const* ar = _delay_re.data() + slot * _stride;
+						T const* ai = _delay_im.data() + slot * _stride;
+						T const* br = _ir_re.data() + p * _stride;
+						T const* bi = _ir_im.data() + p * _stride;
+						T* sr = _sum_re.data();
+						T* si = _sum_im.data();
+						simd::for_each_pack<T>(bins, [&](auto pack, size_t k) {
+							using P = decltype(pack);
+							const P a_re = P::load(ar + k);
+							const P a_im = P::load(ai + k);
+							const P b_re = P::load(br + k);
+							const P b_im = P::load(bi + k);
+							fmadd(a_re, b_re, P::load(sr + k) - a_im * b_im).store(sr + k);
+							fmadd(a_re, b_im, fmadd(a_im, b_re, P::load(si + k))).store(si + k);
+						});
+					}
+
+					// The first half of the circular convolution wraps around; the second half is
+					// the linear convolution at the times of the current block.
+					_fft.inverse(_sum_re.data(), _sum_im.data(), _output.data());
+					T const* tail = _output.data() + _block;
+					simd::for_each_pack<T>(_block, [&](auto pack, size_t i) {
+						using P = decltype(pack);
+						(P::load(output + i) + P::load(tail + i)).store(output + i);
+					});
+				}
+			};
+		}
+
+		// Streaming convolution of a signal with a fixed impulse response, e.g. to auralize a
+		// response from ImpulseResponseAccumulator. The response is cut into uniform partitions
+		// of block_size samples, convolved by overlap-save with FFTs of twice that size, so the
+		// cost per sample grows with the logarithm of the block size and linearly with the
+		// number of partitions.
+		//
+		// With max_block_size above block_size the partitioning is non-uniform: the head of the
+		// response keeps partitions of block_size, and further along the response they grow
+		// four times larger per level, up to max_block_size, which makes long responses much
+		// cheaper at the same latency. Each level runs a block of its own size at once, so a
+		// call to process() that completes a large block costs more than the others; for
+		// real-time monitoring at a small block size, keep max_block_size small enough that
+		// this peak fits in an audio callback.
+		//
+		// process() accepts any number of samples and delays the output by latency() samples,
+		// the block size. process_block() convolves exactly one block without that delay.
+		// Usage:
+		//
+		// Audio::Convolver<> reverb(ir.data(), ir.size(), 256, 16384);
+		// reverb.process(dry, wet, frames); // Per audio callback.
+		//
+		template <typename T = sample_t>
+		class Convolver {
+			using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+			// Partitions of one size, convolving the part of the response from offset on.
+			// The offset is block size - base block size, so the level's output for a block
+			// starts exactly at the base block completing it.
+			struct Level {
+				detail::UniformPartitions<T> partitions;
+				storage_type input;
+				size_t fill;
+			};
+
+			size_t _block = 0;
+			size_t _length = 0;
+			size_t _fill = 0;
+			std::vector<Level> _levels;
+			storage_type _input;
+			storage_type _output;
+			// Output from the start of the current block, as long as the largest level's block.
+			storage_type _pending;
+
+			void _process()
+			{
+				for (Level& level : _levels) {
+					const size_t size = level.partitions.block_size();
+					if (size == _block) {
+						level.partitions.process(_input.data(), _pending.data());
+						continue;
+					}
+					std::copy_n(_input.data(), _block, level.input.data() + level.fill);
+					level.fill += _block;
+					if (level.fill == size) {
+						level.partitions.process(level.input.data(), _pending.data());
+						level.fill = 0;
+					}
+				}
+				std::copy_n(_pending.data(), _block, _output.data());
+				std::copy(_pending.begin() + _block, _pending.end(), _pending.begin());
+				std::fill(_pending.end() - _block, _pending.end(), T(0));
+			}
+
+		public:
+			Convolver() = default;
+
+			// block_size and max_block_size must be powers of two. An empty response gives silence.
+			Convolver(T const* ir, size_t length, size_t block_size, size_t max_block_size = 0)
+				: _block(block_size), _length(length), _input(block_size), _output(block_size)
+			{
+				if (block_size == 0 || (block_size & (block_size - 1)) != 0
+					|| (max_block_size & (max_block_size - 1)) != 0) {
+					throw std::invalid_argument("Convolver block sizes must be powers of two");
+				}
+				max_block_size = std::max(max_block_size, block_size);
+				size_t largest = block_size;
+				for (size_t size = block_size, offset = 0; offset < length; size *= 4) {
+					// Each level but the last covers three of its partitions, up to the offset
+					// of the next level.
+					const size_t end = size * 4 <= max_block_size ? std::min(length, size * 4 - block_size) : length;
+					std::vector<T> part(ir + offset, ir + end);
+					_levels.push_back(Level{ detail::UniformPartitions<T>(part.data(), part.size(), size),
+						storage_type(size == block_size ? 0 : size), 0 });
+					largest = size;
+					offset = end;
+				}
+				_pending.resize(std::max(largest, block_size));
+			}
+
+			Convolver(std::vector<T> const& ir, size_t block_size, size_t max_block_size = 0)
+				: Convolver(ir.data(), ir.size(), block_size, max_block_size) {}
+
+			size_t block_size() const noexcept { return _block; }
+			size_t length() const noexcept { return _length; }
+			size_t latency() const noexcept { return _block; }
+			size_t levels() const noexcept { return _levels.size(); }
+
+			// Forgets the signal so far, as if the convolver had just been built.
+			void reset()
+			{
+				for (Level& level : _levels) {
+					level.partitions.reset();
+					level.fill = 0;
+				}
+				std::fill(_input.begin(), _input.end(), T(0));
+				std::fill(_output.begin(), _output.end(), T(0));
+				std::fill(_pending.begin(), _pending.end(), T(0));
+				_fill = 0;
+			}
+
+			// Convolves count samples, writing as many output samples delayed by latency().
+			// input and output may be the same buffer.
+			void process(T const* input, T* output, size_t count)
+			{
+				while (count > 0) {
+					const size_t n = std::min(count, _block - _fill);
+					std::copy_n(input, n, _input.data() + _fill);
+					std::copy_n(_output.data() + _fill, n, output);
+					_fill += n;
+					if (_fill == _block) {
+						_process();
+						_fill = 0;
+					}
+					input += n;
+					output += n;
+					count -= n;
+				}
+			}
+
+			// Convolves exactly block_size() samples without delay. Do not mix with process()
+			// on the same convolver, which keeps a partly filled block.
+			void process_block(T const* input, T* output)
+			{
+				std::copy_n(input, _block, _input.data());
+				_process();
+				std::copy_n(_output.data(), _block, output);
+			}
+		};
+
+		// Full convolution of a signal with an impulse response, count + length - 1 samples.
+		template <typename T>
+		std::vector<T> convolve(T const* signal, size_t count, T const* ir, size_t length, size_t block_size = 4096,
+			size_t max_block_size = 0)
+		{
+			if (count == 0 || length == 0) {
+				return {};
+			}
+			Convolver<T> convolver(ir, length, block_size, max_block_size);
+			std::vector<T> result(count + length - 1 + block_size);
+			std::copy_n(signal, count, result.begin());
+			for (size_t first = 0; first < result.size(); first += block_size) {
+				const size_t n = std::min(block_size, result.size() - first);
+				convolver.process(result.data() + first, result.data() + first, n);
+			}
+			result.erase(result.begin(), result.begin() + block_size);
+			return result;
+		}
+
+		// Streams the convolution of a mono signal, tail included, to a mono float writer,
+		// scaled by gain. Nothing but one block is buffered, so the signal can be as long as
+		// the file allows. The convolver is reset first.
+		template <class Sink, typename T>
+		bool convolve(WaveFile::BasicWriter<Sink>& writer, Convolver<T>& convolver, T const* signal, size_t count, T gain = 1)
+		{
+			convolver.reset();
+			const size_t block = convolver.block_size();
+			const size_t latency = convolver.latency();
+			const size_t total = count + (convolver.length() > 0 ? convolver.length() - 1 : 0);
+			std::vector<T> input(block);
+			std::vector<T> output(block);
+			std::vector<float> samples(block);
+			// Time of the first input sample of the block, with the output latency() behind it.
+			for (size_t first = 0; first < total + latency; first += block) {
+				const size_t n = std::min(block, total + latency - first);
+				const size_t available = first < count ? std::min(n, count - first) : 0;
+				if (available > 0) {
+					std::copy_n(signal + first, available, input.begin());
+				}
+				std::fill(input.begin() + available, input.end(), T(0));
+				convolver.process(input.data(), output.data(), n);
+				// The first latency() samples out are from before the signal.
+				const size_t skip = first < latency ? std::min(n, latency - first) : 0;
+				for (size_t i = skip; i < n; ++i) {
+					samples[i - skip] = static_cast<float>(output[i] * gain);
+				}
+				if (n > skip && !writer.write(samples.data(), n - skip)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+}
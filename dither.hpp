@@ -0,0 +1,329 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "simd.hpp"
+
+namespace JMP
+{
+	namespace Audio {
+
+		enum class NoiseShaping {
+			NONE,			// Plain TPDF dither, white noise floor.
+			FIRST_ORDER,	// Error feedback through (1 - z^-1).
+			SECOND_ORDER	// Error feedback through (1 - z^-1)^2.
+		};
+
+		namespace detail {
+			// Integer hash with good avalanche behaviour (lowbias32 by Chris Wellons). Only
+			// uses multiplies, shifts and xors, so it vectorizes on every target.
+			constexpr uint32_t dither_hash(uint32_t x) noexcept
+			{
+				x ^= x >> 16;
+				x *= 0x7FEB352Du;
+				x ^= x >> 15;
+				x *= 0x846CA68Bu;
+				x ^= x >> 16;
+				return x;
+			}
+
+			// Maps a hash to triangular noise in (-1, 1) by summing its two 16-bit halves.
+			inline float dither_tpdf(uint32_t h) noexcept
+			{
+				const int32_t sum = static_cast<int32_t>(h & 0xFFFF) + static_cast<int32_t>(h >> 16);
+				return static_cast<float>(sum - 0xFFFF) * (1.0f / 65536);
+			}
+
+			// Writes TPDF noise for the sample counters first .. first + count - 1 to noise.
+			// The result only depends on the counters, not on how a stream is split into calls
+			// or on the instruction set.
+			inline void tpdf_noise(uint32_t seed, uint32_t first, float* noise, size_t count) noexcept
+			{
+				const uint32_t key = dither_hash(seed ^ 0x9E3779B9u);
+				size_t i = 0;
+
+#if defined(JMP_SIMD_AVX2)
+				{
+					const __m256i m0 = _mm256_set1_epi32(static_cast<int32_t>(0x7FEB352Du));
+					const __m256i m1 = _mm256_set1_epi32(static_cast<int32_t>(0x846CA68Bu));
+					const __m256i low = _mm256_set1_epi32(0xFFFF);
+					const __m256i bias = _mm256_set1_epi32(0xFFFF);
+					const __m256 scale = _mm256_set1_ps(1.0f / 65536);
+					__m256i x = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(first + key)),
+						_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+					for (; i + 8 <= count; i += 8) {
+						__m256i h = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+						h = _mm256_mullo_epi32(h, m0);
+						h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+						h = _mm256_mullo_epi32(h, m1);
+						h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+						const __m256i sum = _mm256_add_epi32(_mm256_and_si256(h, low), _mm256_srli_epi32(h, 16));
+						_mm256_storeu_ps(noise + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(sum, bias)), scale));
+						x = _mm256_add_epi32(x, _mm256_set1_epi32(8));
+					}
+				}
+#elif defined(JMP_SIMD_SSE2)
+				{
+					// SSE2 has no 32-bit lane multiply, build it from two 32x32->64 multiplies.
+					const auto mullo = [](__m128i a, __m128i b) {
+						const __m128i even = _mm_mul_epu32(a, b);
+						const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+						return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+							_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+					};
+					const __m128i m0 = _mm_set1_epi32(static_cast<int32_t>(0x7FEB352Du));
+					const __m128i m1 = _mm_set1_epi32(static_cast<int32_t>(0x846CA68Bu));
+					const __m128i low = _mm_set1_epi32(0xFFFF);
+					const __m128i bias = _mm_set1_epi32(0xFFFF);
+					const __m128 scale = _mm_set1_ps(1.0f / 65536);
+					__m128i x = _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(first + key)), _mm_setr_epi32(0, 1, 2, 3));
+					for (; i + 4 <= count; i += 4) {
+						__m128i h = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+						h = mullo(h, m0);
+						h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+						h = mullo(h, m1);
+						h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+						const __m128i sum = _mm_add_epi32(_mm_and_si128(h, low), _mm_srli_epi32(h, 16));
+						_mm_storeu_ps(noise + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(sum, bias)), scale));
+						x = _mm_add_epi32(x, _mm_set1_epi32(4));
+					}
+				}
+#elif defined(JMP_SIMD_NEON)
+				{
+					const uint32x4_t m0 = vdupq_n_u32(0x7FEB352Du);
+					const uint32x4_t m1 = vdupq_n_u32(0x846CA68Bu);
+					const uint32x4_t low = vdupq_n_u32(0xFFFF);
+					const int32x4_t bias = vdupq_n_s32(0xFFFF);
+					const float32x4_t scale = vdupq_n_f32(1.0f / 65536);
+					const uint32_t lanes[4] = { 0, 1, 2, 3 };
+					uint32x4_t x = vaddq_u32(vdupq_n_u32(first + key), vld1q_u32(lanes));
+					for (; i + 4 <= count; i += 4) {
+						uint32x4_t h = veorq_u32(x, vshrq_n_u32(x, 16));
+						h = vmulq_u32(h, m0);
+						h = veorq_u32(h, vshrq_n_u32(h, 15));
+						h = vmulq_u32(h, m1);
+						h = veorq_u32(h, vshrq_n_u32(h, 16));
+						const int32x4_t sum = vreinterpretq_s32_u32(vaddq_u32(vandq_u32(h, low), vshrq_n_u32(h, 16)));
+						vst1q_f32(noise + i, vmulq_f32(vcvtq_f32_s32(vsubq_s32(sum, bias)), scale));
+						x = vaddq_u32(x, vdupq_n_u32(4));
+					}
+				}
+#endif
+
+				for (; i < count; ++i) {
+					noise[i] = dither_tpdf(dither_hash(first + key + static_cast<uint32_t>(i)));
+				}
+			}
+
+			// Rounds to the nearest integer. std::nearbyint and std::floor are library calls unless
+			// the compiler may ignore floating point exceptions, and latency matters here because
+			// the rounding sits on the noise shaping feedback path.
+			inline float dither_round(float v) noexcept
+			{
+#if defined(JMP_SIMD_AVX2)
+				return _mm_cvtss_f32(_mm_round_ss(_mm_setzero_ps(), _mm_set_ss(v), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+#elif defined(JMP_SIMD_NEON64)
+				return vgetq_lane_f32(vrndnq_f32(vdupq_n_f32(v)), 0);
+#else
+				// Only valid well inside the int32_t range, which the callers guarantee.
+				v += 0.5f;
+				const float t = static_cast<float>(static_cast<int32_t>(v));
+				return v < t ? t - 1 : t;
+#endif
+			}
+
+			// Maps [-1, 1] onto the code range of each PCM type, matching Audio::convert.
+			template <typename T>
+			struct PcmRange;
+
+			template <>
+			struct PcmRange<int16_t> {
+				static constexpr float scale = std::numeric_limits<int16_t>::max();
+				static constexpr float offset = 0;
+				static constexpr float lo = std::numeric_limits<int16_t>::min();
+				static constexpr float hi = std::numeric_limits<int16_t>::max();
+			};
+
+			template <>
+			struct PcmRange<uint8_t> {
+				static constexpr float scale = std::numeric_limits<uint8_t>::max() * 0.5f;
+				static constexpr float offset = std::numeric_limits<uint8_t>::max() * 0.5f;
+				static constexpr float lo = 0;
+				static constexpr float hi = std::numeric_limits<uint8_t>::max();
+			};
+		}
+
+		// Converts float samples to integer PCM with TPDF dither of +-1 LSB and optional
+		// error-feedback noise shaping, rounding to the nearest code. The noise counter and
+		// the shaping error of each channel are carried across calls, so a stream can be
+		// converted block by block in front of WaveFile::Writer:
+		//
+		// Audio::Ditherer ditherer(2, Audio::NoiseShaping::SECOND_ORDER);
+		// ditherer.convert(block.data(), pcm.data(), block.size());
+		// writer.write(pcm.data(), pcm.size());
+		//
+		// Input is interleaved and blocks may end in the middle of a frame. The noise for
+		// the n-th sample of the stream depends only on n and the seed, so the output does
+		// not depend on the block size. The counter is 32 bits and wraps after 2^32 samples.
+		//
+		// Without noise shaping the whole block is vectorized. The error feedback is a
+		// recursion over each channel and runs one sample at a time, so with noise shaping
+		// only the noise generation is vectorized; the recursions of up to four channels are
+		// interleaved to hide their latency.
+		class Ditherer {
+		public:
+			explicit Ditherer(uint16_t channels = 1, NoiseShaping shaping = NoiseShaping::NONE, uint32_t seed = 0)
+				: _seed(seed), _channels(channels ? channels : 1), _shaping(shaping), _error(2 * size_t(_channels), 0.0f)
+			{}
+
+			uint16_t channels() const noexcept { return _channels; }
+			NoiseShaping shaping() const noexcept { return _shaping; }
+
+			// Restarts the stream: clears the shaping error and the noise counter.
+			void reset() noexcept
+			{
+				std::fill(_error.begin(), _error.end(), 0.0f);
+				_counter = 0;
+				_channel = 0;
+			}
+
+			void convert(float const* input, int16_t* output, size_t count) noexcept { _convert(input, output, count); }
+			void convert(float const* input, uint8_t* output, size_t count) noexcept { _convert(input, output, count); }
+
+		private:
+			static constexpr size_t CHUNK = 256;
+
+			uint32_t _seed;
+			uint32_t _counter = 0;
+			uint16_t _channels;
+			uint16_t _channel = 0;
+			NoiseShaping _shaping;
+			// Last two quantization errors of each channel, most recent first.
+			std::vector<float> _error;
+
+			// One step of the error feedback for a sample in code units s with dither d. The
+			// noise is kept off the feedback path: only the last subtraction and the rounding
+			// depend on the previous error.
+			template <typename T>
+			static T _shape_sample(float s, float d, float& e0, float& e1, bool second) noexcept
+			{
+				using Range = detail::PcmRange<T>;
+				const float feedback = second ? 2 * e0 - e1 : e0;
+				const float q = detail::dither_round((s + d) - feedback);
+				e1 = e0;
+				e0 = q - (s - feedback);
+				return static_cast<T>(std::max(std::min(q, Range::hi), Range::lo));
+			}
+
+			// Clamping the input keeps the error bounded when the signal clips.
+			template <typename T>
+			static float _code(float sample) noexcept
+			{
+				using Range = detail::PcmRange<T>;
+				return std::max(std::min(sample * Range::scale + Range::offset, Range::hi), Range::lo);
+			}
+
+			// Whole frames of C channels with the error state in registers, so the recursions
+			// of the channels overlap instead of waiting on each other through memory.
+			template <size_t C, typename T>
+			static void _shape_frames(float const* in, T* out, float const* noise, size_t frames, float* error, bool second) noexcept
+			{
+				float e0[C], e1[C];
+				for (size_t c = 0; c < C; ++c) {
+					e0[c] = error[2 * c];
+					e1[c] = error[2 * c + 1];
+				}
+				for (size_t f = 0; f < frames; ++f) {
+					for (size_t c = 0; c < C; ++c) {
+						const size_t i = f * C + c;
+						out[i] = _shape_sample<T>(_code<T>(in[i]), noise[i], e0[c], e1[c], second);
+					}
+				}
+				for (size_t c = 0; c < C; ++c) {
+					error[2 * c] = e0[c];
+					error[2 * c + 1] = e1[c];
+				}
+			}
+
+			template <typename T>
+			void _shape(float const* in, T* out, float const* noise, size_t n) noexcept
+			{
+				const bool second = _shaping == NoiseShaping::SECOND_ORDER;
+				const size_t channels = _channels;
+				size_t c = _channel;
+				size_t i = 0;
+				const auto step = [&]() {
+					out[i] = _shape_sample<T>(_code<T>(in[i]), noise[i], _error[2 * c], _error[2 * c + 1], second);
+					++i;
+					if (++c == channels) {
+						c = 0;
+					}
+				};
+
+				// Finish a frame left open by the previous call.
+				while (c != 0 && i < n) {
+					step();
+				}
+				if (channels <= 4) {
+					const size_t frames = (n - i) / channels;
+					switch (channels) {
+					case 1: _shape_frames<1>(in + i, out + i, noise + i, frames, _error.data(), second); break;
+					case 2: _shape_frames<2>(in + i, out + i, noise + i, frames, _error.data(), second); break;
+					case 3: _shape_frames<3>(in + i, out + i, noise + i, frames, _error.data(), second); break;
+					default: _shape_frames<4>(in + i, out + i, noise + i, frames, _error.data(), second); break;
+					}
+					i += frames * channels;
+				}
+				while (i < n) {
+					step();
+				}
+			}
+
+			template <typename T>
+			void _convert(float const* input, T* output, size_t count) noexcept
+			{
+				using Range = detail::PcmRange<T>;
+				alignas(64) float buffer[CHUNK];
+
+				for (size_t done = 0; done < count;) {
+					const size_t n = std::min(CHUNK, count - done);
+					float const* in = input + done;
+					T* out = output + done;
+					detail::tpdf_noise(_seed, _counter, buffer, n);
+					_counter += static_cast<uint32_t>(n);
+
+					if (_shaping == NoiseShaping::NONE) {
+						simd::for_each_pack<float>(n, [&](auto p, size_t i) {
+							using P = decltype(p);
+							P v = simd::fmadd(P::load(in + i), P::broadcast(Range::scale), P::broadcast(Range::offset));
+							v = v + P::load(buffer + i) + P::broadcast(0.5f);
+							// Clamp before rounding, which keeps floor() in its valid range on SSE2.
+							v = simd::max(simd::min(v, P::broadcast(Range::hi)), P::broadcast(Range::lo));
+							simd::floor(v).store(buffer + i);
+						});
+						for (size_t i = 0; i < n; ++i) {
+							out[i] = static_cast<T>(buffer[i]);
+						}
+					}
+					else {
+						_shape(in, out, buffer, n);
+					}
+
+					_channel = static_cast<uint16_t>((_channel + n) % _channels);
+					done += n;
+				}
+			}
+		};
+	}
+}
@@ -8,28 +8,40 @@
 
 #include <type_traits>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 
+#include "simd.hpp"
+
+#if __cplusplus >= 202002L && __has_include(<bit>)
+#include <bit>
+#endif
+
+// JMP_BIG_ENDIAN is 1 on big-endian targets and 0 on little-endian targets.
+#ifndef JMP_BIG_ENDIAN
+#if defined(__cpp_lib_endian)
+#define JMP_BIG_ENDIAN (std::endian::native == std::endian::big)
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define JMP_BIG_ENDIAN 1
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define JMP_BIG_ENDIAN 0
+#elif defined(_WIN32) || defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64)
+#define JMP_BIG_ENDIAN 0
+#else
+#error "Unable to detect the target endianness, define JMP_BIG_ENDIAN to 0 or 1."
+#endif
+#endif
 
 namespace JMP
 {
-	// Runtime check of machine endianness.
-	bool is_big_endian() noexcept {
-		const union {
-			uint32_t i;
-			uint8_t c[4];
-		} u = { 0x11223344 };
-
-		return u.c[0] == 0x11;
+	// Compile-time check of machine endianness.
+	constexpr bool is_big_endian() noexcept {
+		return JMP_BIG_ENDIAN != 0;
 	}
 
-	// Runtime check of machine endianness.
-	bool is_little_endian() noexcept {
-		const union {
-			uint32_t i;
-			uint8_t c[4];
-		} u = { 0x11223344 };
-
-		return u.c[0] == 0x44;
+	// Compile-time check of machine endianness.
+	constexpr bool is_little_endian() noexcept {
+		return JMP_BIG_ENDIAN == 0;
 	}
 
 	// Swapping the bytes of an 8-bit integer is a no-op.
@@ -70,6 +82,91 @@ namespace JMP
 			((i & 0x00000000000000FF) << 56);
 	}
 
+	namespace detail {
+		// Byte swap of a single value using the compiler intrinsics when available.
+		template <typename T>
+		inline T bswap(T i) noexcept {
+			using U = std::make_unsigned_t<T>;
+			const U u = static_cast<U>(i);
+#if defined(_MSC_VER) && !defined(__clang__)
+			if constexpr (sizeof(T) == 2) return static_cast<T>(_byteswap_ushort(u));
+			else if constexpr (sizeof(T) == 4) return static_cast<T>(_byteswap_ulong(u));
+			else if constexpr (sizeof(T) == 8) return static_cast<T>(_byteswap_uint64(u));
+			else return i;
+#elif defined(__GNUC__) || defined(__clang__)
+			if constexpr (sizeof(T) == 2) return static_cast<T>(__builtin_bswap16(u));
+			else if constexpr (sizeof(T) == 4) return static_cast<T>(__builtin_bswap32(u));
+			else if constexpr (sizeof(T) == 8) return static_cast<T>(__builtin_bswap64(u));
+			else return i;
+#else
+			return static_cast<T>(byteswap<U>(u));
+#endif
+		}
+
+#if defined(JMP_SIMD_SSSE3)
+		// Shuffle mask that reverses the bytes of each element of the given size within a 128-bit lane.
+		template <size_t Size>
+		inline __m128i bswap_mask() noexcept {
+			alignas(16) uint8_t mask[16];
+			for (size_t i = 0; i < 16; ++i) {
+				mask[i] = static_cast<uint8_t>((i / Size) * Size + (Size - 1 - i % Size));
+			}
+			return _mm_load_si128(reinterpret_cast<__m128i const*>(mask));
+		}
+#endif
+	}
+
+	// Swaps the bytes of every element of a buffer. Input and output may be the same
+	// buffer, but must not otherwise overlap.
+	template <typename T, std::enable_if_t<std::is_integral<T>::value, bool> = true>
+	inline void byteswap_copy(T const* input, T* output, size_t count) noexcept {
+		if constexpr (sizeof(T) == 1) {
+			if (input != output && count > 0) {
+				std::memcpy(output, input, count);
+			}
+		}
+		else {
+			size_t i = 0;
+
+#if defined(JMP_SIMD_SSSE3)
+			constexpr size_t lanes = 16 / sizeof(T);
+			const __m128i mask = detail::bswap_mask<sizeof(T)>();
+#if defined(JMP_SIMD_AVX2)
+			const __m256i mask2 = _mm256_broadcastsi128_si256(mask);
+			for (; i + 4 * lanes <= count; i += 4 * lanes) {
+				const __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i));
+				const __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(input + i + 2 * lanes));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_shuffle_epi8(a, mask2));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i + 2 * lanes), _mm256_shuffle_epi8(b, mask2));
+			}
+#endif
+			for (; i + lanes <= count; i += lanes) {
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(input + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_shuffle_epi8(a, mask));
+			}
+#elif defined(JMP_SIMD_NEON)
+			constexpr size_t lanes = 16 / sizeof(T);
+			for (; i + lanes <= count; i += lanes) {
+				const uint8x16_t a = vld1q_u8(reinterpret_cast<uint8_t const*>(input + i));
+				uint8_t* out = reinterpret_cast<uint8_t*>(output + i);
+				if constexpr (sizeof(T) == 2) vst1q_u8(out, vrev16q_u8(a));
+				else if constexpr (sizeof(T) == 4) vst1q_u8(out, vrev32q_u8(a));
+				else vst1q_u8(out, vrev64q_u8(a));
+			}
+#endif
+
+			for (; i < count; ++i) {
+				output[i] = detail::bswap(input[i]);
+			}
+		}
+	}
+
+	// Swaps the bytes of every element of a buffer in place.
+	template <typename T, std::enable_if_t<std::is_integral<T>::value, bool> = true>
+	inline void byteswap_inplace(T* data, size_t count) noexcept {
+		byteswap_copy(data, data, count);
+	}
+
 	// Stores an integer value in big-endian format.
 	template <typename T, std::enable_if_t<std::is_integral<T>::value, bool> = true>
 	class BigEndian
@@ -77,21 +174,21 @@ namespace JMP
 	private:
 		T _val;
 	public:
-		BigEndian() : _val(0) {}
-		BigEndian(T const& i) : _val(is_little_endian() ? byteswap<T>(i) : i) {}
+		constexpr BigEndian() : _val(0) {}
+		constexpr BigEndian(T const& i) : _val(is_little_endian() ? byteswap<T>(i) : i) {}
 
-		operator T() const {
+		constexpr operator T() const {
 			return is_little_endian() ? byteswap<T>(_val) : _val;
 		}
 
 		// Returns a big-endian ordered integer.
-		T bytes() const {
+		constexpr T bytes() const {
 			return _val;
 		}
 		
 		// Returns a pointer to the raw bytes of the big-endian integer.
 		char const* byte_ptr() const {
-			return static_cast<char const*>(&_val);
+			return reinterpret_cast<char const*>(&_val);
 		}
 	};
 
@@ -102,21 +199,69 @@ namespace JMP
 	private:
 		T _val;
 	public:
-		LittleEndian() : _val(0) {}
-		LittleEndian(T const& i) : _val(is_big_endian() ? byteswap<T>(i) : i) {}
+		constexpr LittleEndian() : _val(0) {}
+		constexpr LittleEndian(T const& i) : _val(is_big_endian() ? byteswap<T>(i) : i) {}
 
-		operator T() const {
+		constexpr operator T() const {
 			return is_big_endian() ? byteswap<T>(_val) : _val;
 		}
 
 		// Returns a little-endian ordered integer.
-		T bytes() const {
+		constexpr T bytes() const {
 			return _val;
 		}
 
 		// Returns a pointer to the raw bytes of the little-endian integer.
 		char const* byte_ptr() const {
-			return static_cast<char const*>(&_val);
+			return reinterpret_cast<char const*>(&_val);
 		}
 	};
+
+	// Converts a buffer of native integers to big-endian storage.
+	template <typename T>
+	inline void to_big_endian(T const* input, BigEndian<T>* output, size_t count) noexcept {
+		static_assert(sizeof(BigEndian<T>) == sizeof(T), "BigEndian<T> must have the same layout as T.");
+		if constexpr (is_little_endian()) {
+			byteswap_copy(input, reinterpret_cast<T*>(output), count);
+		}
+		else if (count > 0) {
+			std::memcpy(static_cast<void*>(output), static_cast<void const*>(input), count * sizeof(T));
+		}
+	}
+
+	// Converts a buffer of big-endian integers to native byte order.
+	template <typename T>
+	inline void from_big_endian(BigEndian<T> const* input, T* output, size_t count) noexcept {
+		static_assert(sizeof(BigEndian<T>) == sizeof(T), "BigEndian<T> must have the same layout as T.");
+		if constexpr (is_little_endian()) {
+			byteswap_copy(reinterpret_cast<T const*>(input), output, count);
+		}
+		else if (count > 0) {
+			std::memcpy(static_cast<void*>(output), static_cast<void const*>(input), count * sizeof(T));
+		}
+	}
+
+	// Converts a buffer of native integers to little-endian storage.
+	template <typename T>
+	inline void to_little_endian(T const* input, LittleEndian<T>* output, size_t count) noexcept {
+		static_assert(sizeof(LittleEndian<T>) == sizeof(T), "LittleEndian<T> must have the same layout as T.");
+		if constexpr (is_big_endian()) {
+			byteswap_copy(input, reinterpret_cast<T*>(output), count);
+		}
+		else if (count > 0) {
+			std::memcpy(static_cast<void*>(output), static_cast<void const*>(input), count * sizeof(T));
+		}
+	}
+
+	// Converts a buffer of little-endian integers to native byte order.
+	template <typename T>
+	inline void from_little_endian(LittleEndian<T> const* input, T* output, size_t count) noexcept {
+		static_assert(sizeof(LittleEndian<T>) == sizeof(T), "LittleEndian<T> must have the same layout as T.");
+		if constexpr (is_big_endian()) {
+			byteswap_copy(reinterpret_cast<T const*>(input), output, count);
+		}
+		else if (count > 0) {
+			std::memcpy(static_cast<void*>(output), static_cast<void const*>(input), count * sizeof(T));
+		}
+	}
 }
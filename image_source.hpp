@@ -0,0 +1,252 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <optional>
+
+#include "vectors.hpp"
+#include "propagation.hpp"
+
+namespace JMP
+{
+    // A reflecting line segment. absorption is the fraction of energy lost at each reflection.
+    template <typename T>
+    struct Wall {
+        Segment2<T> segment;
+        T absorption;
+    };
+
+    // The walls of a closed polygon, given its vertices in order, all with the same absorption.
+    template <typename T>
+    std::vector<Wall<T>> polygon_walls(std::vector<Vector2<T>> const & vertices, T absorption = 0) {
+        std::vector<Wall<T>> walls;
+        for (size_t i = 0; i < vertices.size() && vertices.size() > 1; ++i) {
+            walls.push_back(Wall<T>{ Segment2<T>(vertices[i], vertices[(i + 1) % vertices.size()]), absorption });
+        }
+        return walls;
+    }
+
+    // Deterministic early reflections in rooms made of walls, by the image-source method.
+    // build() mirrors the source in the walls up to a maximum reflection order and keeps, for
+    // each image, the part of its wall through which the image can be seen (its beam). A wall
+    // outside an image's beam cannot reflect that image, so the whole subtree below it is
+    // culled, which keeps the tree far smaller than walls^order in rooms with many walls.
+    //
+    // The tree only depends on the source and the walls, so it is cached until build() is
+    // called again; moving the listener only needs arrivals(), which checks each image
+    // against the listener's position, finds the reflection points and tests every leg of
+    // the path for occlusion by other walls.
+    //
+    // The energy of each arrival is the energy PropagationEngine collects on average for the
+    // same path: the fraction of directions from the image that cross the listener, times the
+    // energy left after absorption. Early reflections from the image sources can therefore be
+    // joined with a ray-traced tail (see ImpulseResponseAccumulator::add_early()).
+    // Usage:
+    //
+    // ImageSourceModel<float> model(polygon_walls(vertices, 0.1f));
+    // model.build(source, 3);
+    // ir.add_early(model.arrivals(listener), 3);
+    //
+    template <typename T>
+    class ImageSourceModel {
+    public:
+        struct Image {
+            Vector2<T> position;
+            // Part of the wall in which the image was mirrored through which it is visible.
+            // Empty for the source itself.
+            Segment2<T> window;
+            // Fraction of the energy left after the reflections.
+            T gain;
+            int32_t parent;
+            // Wall the parent was mirrored in, -1 for the source.
+            int32_t wall;
+            uint32_t order;
+        };
+
+    private:
+        std::vector<Wall<T>> _walls;
+        std::vector<Image> _images;
+
+        // Keeps the part of the segment [a, b] where a linear function with the values fa at a
+        // and fb at b is not negative. Returns false if nothing is left.
+        static bool _clip(Vector2<T>& a, Vector2<T>& b, T fa, T fb) {
+            if (fa < 0 && fb < 0) {
+                return false;
+            }
+            if (fa < 0) {
+                a = a + (b - a) * (fa / (fa - fb));
+            }
+            else if (fb < 0) {
+                b = a + (b - a) * (fa / (fa - fb));
+            }
+            return true;
+        }
+
+        // The three half-planes bounding the beam of an image: the two sides of the wedge from
+        // the image through the ends of its window, and the far side of the window.
+        static bool _beam(Image const & image, Vector2<T>& apex, Vector2<T>& left, Vector2<T>& right, T& far_side) {
+            apex = image.position;
+            left = image.window.start();
+            right = image.window.end();
+            const T orientation = (left - apex).cross(right - apex);
+            if (orientation == 0) {
+                return false;
+            }
+            if (orientation < 0) {
+                std::swap(left, right);
+            }
+            far_side = image.window.side(apex) > 0 ? T(-1) : T(1);
+            return true;
+        }
+
+        // Part of a wall inside the beam of an image, or false if the wall cannot reflect it.
+        static bool _visible_part(Image const & image, Segment2<T> const & wall, Segment2<T>& window) {
+            Vector2<T> a = wall.start();
+            Vector2<T> b = wall.end();
+            if (image.wall >= 0) {
+                Vector2<T> apex, left, right;
+                T far_side;
+                if (!_beam(image, apex, left, right, far_side)
+                    || !_clip(a, b, (left - apex).cross(a - apex), (left - apex).cross(b - apex))
+                    || !_clip(a, b, (a - apex).cross(right - apex), (b - apex).cross(right - apex))
+                    || !_clip(a, b, far_side * image.window.side(a), far_side * image.window.side(b))) {
+                    return false;
+                }
+            }
+            // Walls seen edge-on or only touching the beam at a corner reflect nothing.
+            const Vector2<T> d = b - a;
+            const Vector2<T> full = wall.delta();
+            if (d.dot(d) <= T(1e-12) * full.dot(full) || wall.side(image.position) == 0) {
+                return false;
+            }
+            window = Segment2<T>(a, b);
+            return true;
+        }
+
+        static bool _in_beam(Image const & image, Vector2<T> const & p) {
+            if (image.wall < 0) {
+                return true;
+            }
+            Vector2<T> apex, left, right;
+            T far_side;
+            return _beam(image, apex, left, right, far_side)
+                && (left - apex).cross(p - apex) >= 0
+                && (p - apex).cross(right - apex) >= 0
+                && far_side * image.window.side(p) > 0;
+        }
+
+        // Whether a wall other than the ones the leg starts and ends on crosses the leg from p to q.
+        bool _occluded(Vector2<T> const & p, Vector2<T> const & q, int32_t skip_a, int32_t skip_b) const {
+            const T eps = T(1e-6);
+            for (size_t w = 0; w < _walls.size(); ++w) {
+                if (static_cast<int32_t>(w) == skip_a || static_cast<int32_t>(w) == skip_b) {
+                    continue;
+                }
+                const std::optional<T> t = _walls[w].segment.intersect(p, q);
+                if (t && *t > eps && *t < 1 - eps) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Follows the path of an image from the listener back to the source.
+        bool _path_clear(size_t i, Vector2<T> point) const {
+            int32_t previous_wall = -1;
+            for (int32_t k = static_cast<int32_t>(i); ; k = _images[k].parent) {
+                Image const & image = _images[k];
+                if (image.wall < 0) {
+                    return !_occluded(point, image.position, previous_wall, -1);
+                }
+                const std::optional<T> t = _walls[image.wall].segment.intersect(point, image.position);
+                if (!t) {
+                    return false;
+                }
+                const Vector2<T> reflection = point + (image.position - point) * *t;
+                if (_occluded(point, reflection, previous_wall, image.wall)) {
+                    return false;
+                }
+                previous_wall = image.wall;
+                point = reflection;
+            }
+        }
+
+    public:
+        ImageSourceModel() = default;
+        explicit ImageSourceModel(std::vector<Wall<T>> walls) : _walls(std::move(walls)) {}
+
+        // Uses the walls of a scene. Its circles are not reflectors or occluders for the model.
+        explicit ImageSourceModel(Scene<T> const & scene) {
+            for (size_t i = 0; i < scene.walls().size(); ++i) {
+                _walls.push_back(Wall<T>{ scene.walls().segment(i), scene.wall_absorption(i) });
+            }
+        }
+
+        std::vector<Wall<T>> const & walls() const { return _walls; }
+
+        // Replaces the walls. The image tree must be rebuilt before the next query.
+        void set_walls(std::vector<Wall<T>> walls) {
+            _walls = std::move(walls);
+            _images.clear();
+        }
+
+        // Builds the images of the source up to max_order reflections, stopping early once
+        // max_images images have been created. Images are stored in order of increasing
+        // reflection order, each after its parent.
+        void build(Vector2<T> const & source, uint32_t max_order, size_t max_images = size_t(1) << 20) {
+            _images.clear();
+            _images.push_back(Image{ source, Segment2<T>(source, source), T(1), -1, -1, 0 });
+            for (size_t i = 0; i < _images.size() && _images.size() < max_images; ++i) {
+                const Image parent = _images[i];
+                if (parent.order >= max_order) {
+                    break;
+                }
+                for (size_t w = 0; w < _walls.size() && _images.size() < max_images; ++w) {
+                    Segment2<T> window;
+                    if (static_cast<int32_t>(w) == parent.wall || !_visible_part(parent, _walls[w].segment, window)) {
+                        continue;
+                    }
+                    _images.push_back(Image{ _walls[w].segment.mirror(parent.position), window,
+                        parent.gain * (1 - _walls[w].absorption), static_cast<int32_t>(i), static_cast<int32_t>(w), parent.order + 1 });
+                }
+            }
+        }
+
+        std::vector<Image> const & images() const { return _images; }
+        size_t size() const { return _images.size(); }
+
+        // Calls emit(arrival) for every image with an unobstructed path to the listener, in
+        // order of reflection order. The ray index of an arrival is the index of its image.
+        template <class Emit>
+        void trace(Listener<T> const & listener, Emit&& emit) const {
+            for (size_t i = 0; i < _images.size(); ++i) {
+                Image const & image = _images[i];
+                if (!_in_beam(image, listener.position) || !_path_clear(i, listener.position)) {
+                    continue;
+                }
+                const T distance = image.position.distance_to(listener.position);
+                // Fraction of the directions from the image that cross the listener.
+                const T pi = static_cast<T>(3.14159265358979323846);
+                const T capture = distance > listener.radius ? std::asin(listener.radius / distance) / pi : T(1);
+                emit(Arrival<T>{ distance, image.gain * capture, static_cast<uint32_t>(i), image.order });
+            }
+        }
+
+        std::vector<Arrival<T>> arrivals(Listener<T> const & listener) const {
+            std::vector<Arrival<T>> result;
+            trace(listener, [&](Arrival<T> const & arrival) {
+                result.push_back(arrival);
+            });
+            return result;
+        }
+    };
+}
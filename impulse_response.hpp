@@ -0,0 +1,325 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "audio.hpp"
+#include "memory.hpp"
+#include "simd.hpp"
+#include "wavefile.hpp"
+#include "compact.hpp"
+#include "propagation.hpp"
+
+namespace JMP
+{
+    namespace detail {
+        // Converts a response reduced block by block with reduce(first, count, out), channels
+        // values per sample, into a compact array without holding it all in full precision.
+        // int16_t takes a first pass to find the scale.
+        template <typename S, typename T, class Reduce>
+        CompactArray<S> reduce_compact(size_t length, size_t channels, size_t block_size, Reduce&& reduce) {
+            block_size = std::max<size_t>(1, block_size);
+            std::vector<T> block(block_size * channels);
+            std::vector<float> values(block_size * channels);
+            const auto for_each_block = [&](auto&& f) {
+                for (size_t first = 0; first < length; first += block_size) {
+                    const size_t count = std::min(block_size, length - first) * channels;
+                    reduce(first, count / channels, block.data());
+                    std::copy_n(block.data(), count, values.data());
+                    f(first * channels, count);
+                }
+            };
+            float scale = 1;
+            if constexpr (std::is_same<S, int16_t>::value) {
+                float largest = 0;
+                for_each_block([&](size_t, size_t count) {
+                    largest = std::max(largest, fixed16_scale(values.data(), count));
+                });
+                scale = largest;
+            }
+            CompactArray<S> result(length * channels, scale);
+            for_each_block([&](size_t first, size_t count) {
+                result.store(first, values.data(), count);
+            });
+            return result;
+        }
+    }
+
+    // Builds an energy impulse response from ray arrivals. Arrival times are length / SPEED_OF_SOUND,
+    // binned at the sample rate. Every worker thread accumulates into its own histogram, so adding
+    // arrivals needs no atomics; the histograms are summed when the response is read or written.
+    // Usage:
+    //
+    // ImpulseResponseAccumulator<float> ir(pool.worker_count(), 48000, 1.0f);
+    // ir.add_early(image_sources.arrivals(listener), 3); // Optional, see ImageSourceModel.
+    // engine.run(scene, source, listener, settings, [&](size_t worker, Arrival<float> const & a) {
+    //     ir.add(worker, a);
+    // });
+    // WaveFile::Writer writer("ir.wav", 1, 48000, WaveFile::AudioFormat::FLOAT, 32);
+    // ir.write(writer);
+    //
+    template <typename T = Audio::sample_t>
+    class ImpulseResponseAccumulator {
+    public:
+        using histogram_type = std::vector<T, AlignedAllocator<T>>;
+
+    private:
+        std::vector<histogram_type> _histograms;
+        uint32_t _sample_rate = 0;
+        size_t _length = 0;
+        bool _fractional_delay = false;
+        T _samples_per_meter = 0;
+        // Ray arrivals with fewer reflections come from add_early() instead.
+        uint32_t _early_orders = 0;
+
+    public:
+        // Creates one histogram per worker, covering the given duration. With fractional_delay,
+        // each arrival is split linearly between the two nearest samples instead of being
+        // rounded down to one.
+        ImpulseResponseAccumulator(size_t worker_count, uint32_t sample_rate, T duration_seconds, bool fractional_delay = false)
+            : _histograms(std::max<size_t>(1, worker_count)), _sample_rate(sample_rate),
+              _length(static_cast<size_t>(std::ceil(duration_seconds * sample_rate))), _fractional_delay(fractional_delay),
+              _samples_per_meter(static_cast<T>(sample_rate) / static_cast<T>(Audio::SPEED_OF_SOUND)) {
+            for (histogram_type& h : _histograms) {
+                // One extra bin receives the fractional part of arrivals in the last sample.
+                h.assign(_length + 1, T(0));
+            }
+        }
+
+        uint32_t sample_rate() const { return _sample_rate; }
+        size_t size() const { return _length; }
+        size_t worker_count() const { return _histograms.size(); }
+
+        // Adds the energy of a path of the given length. Must only be called by the given worker.
+        void add(size_t worker, T length, T energy) {
+            const T position = length * _samples_per_meter;
+            if (!(position >= 0) || position >= static_cast<T>(_length)) {
+                return;
+            }
+            histogram_type& h = _histograms[worker];
+            const size_t i = static_cast<size_t>(position);
+            if (_fractional_delay) {
+                const T frac = position - static_cast<T>(i);
+                h[i] += energy * (1 - frac);
+                h[i + 1] += energy * frac;
+            }
+            else {
+                h[i] += energy;
+            }
+        }
+
+        // Adds a ray arrival, unless its reflection order is covered by add_early().
+        void add(size_t worker, Arrival<T> const & arrival) {
+            if (arrival.order >= _early_orders) {
+                add(worker, arrival.length, arrival.energy);
+            }
+        }
+
+        // Adds exact early arrivals up to max_order reflections, such as the output of
+        // ImageSourceModel::arrivals(), and from then on ignores ray arrivals of those orders
+        // so that each path is only counted once. The arrivals go to the first worker's
+        // histogram, so call this before or after tracing, not while workers add arrivals.
+        void add_early(std::vector<Arrival<T>> const & arrivals, uint32_t max_order) {
+            for (Arrival<T> const & arrival : arrivals) {
+                if (arrival.order <= max_order) {
+                    add(0, arrival.length, arrival.energy);
+                }
+            }
+            _early_orders = std::max(_early_orders, max_order + 1);
+        }
+
+        // Clears the response, including the early arrivals.
+        void clear() {
+            for (histogram_type& h : _histograms) {
+                std::fill(h.begin(), h.end(), T(0));
+            }
+            _early_orders = 0;
+        }
+
+        // Sums all worker histograms for the samples [first, first + count) into out.
+        void reduce(size_t first, size_t count, T* out) const {
+            std::copy_n(_histograms[0].data() + first, count, out);
+            for (size_t w = 1; w < _histograms.size(); ++w) {
+                T const* h = _histograms[w].data() + first;
+                simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                    using P = decltype(p);
+                    (P::load(out + i) + P::load(h + i)).store(out + i);
+                });
+            }
+        }
+
+        // Returns the summed impulse response.
+        std::vector<T> reduce() const {
+            std::vector<T> ir(_length);
+            reduce(0, _length, ir.data());
+            return ir;
+        }
+
+        // Returns the summed response in a 16-bit storage format (see CompactArray), at half
+        // the size of a float response, reducing one block at a time.
+        template <typename S>
+        CompactArray<S> reduce_compact(size_t block_size = 4096) const {
+            return detail::reduce_compact<S, T>(_length, 1, block_size, [this](size_t first, size_t count, T* out) {
+                reduce(first, count, out);
+            });
+        }
+
+        // Streams the summed response to a mono float writer, scaled by gain, reducing one block
+        // at a time so the full response is never copied. Either writer works; with AsyncWriter
+        // the disk writes overlap the reduction.
+        template <class Sink>
+        bool write(WaveFile::BasicWriter<Sink>& writer, T gain = 1, size_t block_size = 4096) const {
+            block_size = std::max<size_t>(1, block_size);
+            std::vector<T> block(block_size);
+            std::vector<float> samples(block_size);
+            for (size_t first = 0; first < _length; first += block_size) {
+                const size_t count = std::min(block_size, _length - first);
+                reduce(first, count, block.data());
+                for (size_t i = 0; i < count; ++i) {
+                    samples[i] = static_cast<float>(block[i] * gain);
+                }
+                if (!writer.write(samples.data(), count)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // Same as ImpulseResponseAccumulator with one histogram per octave band, for the arrivals of
+    // PropagationEngine::run_bands(). The bands of a sample are stored next to each other, so
+    // adding an arrival is one band vector addition (two with fractional delay) and the summed
+    // response is an interleaved signal with one channel per band.
+    // Usage:
+    //
+    // BandImpulseResponseAccumulator<float> ir(pool.worker_count(), 48000, 1.0f);
+    // engine.run_bands(scene, source, listener, settings, AirAbsorption<float>::standard(),
+    //     [&](size_t worker, BandArrival<float> const & a) { ir.add(worker, a); });
+    // WaveFile::Writer writer("ir.wav", Bands<float>::count, 48000, WaveFile::AudioFormat::FLOAT, 32);
+    // ir.write(writer);
+    //
+    template <typename T = Audio::sample_t>
+    class BandImpulseResponseAccumulator {
+    public:
+        using histogram_type = std::vector<T, AlignedAllocator<T>>;
+        static constexpr size_t band_count = Bands<T>::count;
+
+    private:
+        std::vector<histogram_type> _histograms;
+        uint32_t _sample_rate = 0;
+        size_t _length = 0;
+        bool _fractional_delay = false;
+        T _samples_per_meter = 0;
+
+    public:
+        BandImpulseResponseAccumulator(size_t worker_count, uint32_t sample_rate, T duration_seconds, bool fractional_delay = false)
+            : _histograms(std::max<size_t>(1, worker_count)), _sample_rate(sample_rate),
+              _length(static_cast<size_t>(std::ceil(duration_seconds * sample_rate))), _fractional_delay(fractional_delay),
+              _samples_per_meter(static_cast<T>(sample_rate) / static_cast<T>(Audio::SPEED_OF_SOUND)) {
+            for (histogram_type& h : _histograms) {
+                h.assign((_length + 1) * band_count, T(0));
+            }
+        }
+
+        uint32_t sample_rate() const { return _sample_rate; }
+        size_t size() const { return _length; }
+        size_t worker_count() const { return _histograms.size(); }
+
+        // Adds the band energies of a path of the given length. Must only be called by the given worker.
+        void add(size_t worker, T length, Bands<T> const & energy) {
+            const T position = length * _samples_per_meter;
+            if (!(position >= 0) || position >= static_cast<T>(_length)) {
+                return;
+            }
+            T* bin = _histograms[worker].data() + static_cast<size_t>(position) * band_count;
+            if (_fractional_delay) {
+                const T frac = position - std::floor(position);
+                (Bands<T>::load(bin) + energy * (1 - frac)).store(bin);
+                (Bands<T>::load(bin + band_count) + energy * frac).store(bin + band_count);
+            }
+            else {
+                (Bands<T>::load(bin) + energy).store(bin);
+            }
+        }
+
+        void add(size_t worker, BandArrival<T> const & arrival) {
+            add(worker, arrival.length, arrival.energy);
+        }
+
+        void clear() {
+            for (histogram_type& h : _histograms) {
+                std::fill(h.begin(), h.end(), T(0));
+            }
+        }
+
+        // Sums all worker histograms for the samples [first, first + count) into out, which
+        // receives count * band_count values, the bands of each sample next to each other.
+        void reduce(size_t first, size_t count, T* out) const {
+            const size_t values = count * band_count;
+            std::copy_n(_histograms[0].data() + first * band_count, values, out);
+            for (size_t w = 1; w < _histograms.size(); ++w) {
+                T const* h = _histograms[w].data() + first * band_count;
+                simd::for_each_pack<T>(values, [&](auto p, size_t i) {
+                    using P = decltype(p);
+                    (P::load(out + i) + P::load(h + i)).store(out + i);
+                });
+            }
+        }
+
+        // Returns the summed response with the bands of each sample next to each other.
+        std::vector<T> reduce() const {
+            std::vector<T> ir(_length * band_count);
+            reduce(0, _length, ir.data());
+            return ir;
+        }
+
+        // Same as reduce() in a 16-bit storage format, reducing one block at a time. With
+        // int16_t all bands share one scale.
+        template <typename S>
+        CompactArray<S> reduce_compact(size_t block_size = 4096) const {
+            return detail::reduce_compact<S, T>(_length, band_count, block_size, [this](size_t first, size_t count, T* out) {
+                reduce(first, count, out);
+            });
+        }
+
+        // Returns the summed response of a single band.
+        std::vector<T> band(size_t b) const {
+            std::vector<T> ir(_length, T(0));
+            for (histogram_type const & h : _histograms) {
+                for (size_t i = 0; i < _length; ++i) {
+                    ir[i] += h[i * band_count + b];
+                }
+            }
+            return ir;
+        }
+
+        // Streams the summed response to a float writer with band_count channels, scaled by gain.
+        template <class Sink>
+        bool write(WaveFile::BasicWriter<Sink>& writer, T gain = 1, size_t block_size = 4096) const {
+            block_size = std::max<size_t>(1, block_size);
+            std::vector<T> block(block_size * band_count);
+            std::vector<float> samples(block_size * band_count);
+            for (size_t first = 0; first < _length; first += block_size) {
+                const size_t count = std::min(block_size, _length - first);
+                reduce(first, count, block.data());
+                for (size_t i = 0; i < count * band_count; ++i) {
+                    samples[i] = static_cast<float>(block[i] * gain);
+                }
+                if (!writer.write(samples.data(), count * band_count)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,274 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "vectors.hpp"
+#include "propagation.hpp"
+#include "thread_pool.hpp"
+
+namespace JMP
+{
+    // Ray tracing for interactive use, where consecutive frames differ by a little movement.
+    // The path of every ray (its straight parts between bounces) is kept from one frame to the
+    // next. After circles or walls have moved, update() only retraces the rays whose path
+    // touches the old or new position of any of them; when the listener moves, only the
+    // arrivals are recomputed from the kept paths, without any intersection test. Moving the
+    // source or changing the settings invalidates every path. The cost of a frame thus grows
+    // with the amount of change rather than with the scene.
+    //
+    // Arrivals are reported as differences: update() calls on_arrival(worker, arrival) with the
+    // energy negated for each arrival of the previous frame that no longer holds, and normally for
+    // each new one. Both go straight into an ImpulseResponseAccumulator, which then holds the
+    // response of the current frame. After many frames the rounding of the subtractions adds up;
+    // clear the accumulator and call invalidate() to start over from a full trace.
+    // Usage:
+    //
+    // IncrementalPropagation<float> tracer(pool, settings);
+    // auto add = [&](size_t worker, Arrival<float> const & a) { ir.add(worker, a); };
+    // tracer.run(scene, source, listener, add);
+    // // Next frame:
+    // const Vector2<float> old_center = scene.circles().center(i);
+    // const float old_radius = scene.circles().radius(i);
+    // scene.move_circle(i, center, radius);
+    // tracer.moved_circle(i, old_center, old_radius);
+    // tracer.set_listener(listener);
+    // tracer.update(scene, add);
+    //
+    template <typename T>
+    class IncrementalPropagation {
+    public:
+        // A straight part of a kept path, see PropagationEngine::trace_segments().
+        struct Segment {
+            Ray2<T> ray;
+            T extent;
+            T energy;
+            uint32_t order;
+            // Circle or wall the part ends on, NO_HIT if the ray was dropped before reaching it.
+            int32_t hit;
+            bool wall;
+        };
+
+        struct Path {
+            std::vector<Segment> segments;
+            std::vector<Arrival<T>> arrivals;
+        };
+
+    private:
+        // Previous position of a circle or wall that has moved since the last update().
+        struct Change {
+            Vector2<T> a;   // Center of the circle, start of the wall.
+            Vector2<T> b;   // End of the wall.
+            T radius;
+            int32_t index;
+            bool wall;
+        };
+
+        ThreadPool& _pool;
+        PropagationSettings<T> _settings;
+        Vector2<T> _source;
+        Listener<T> _listener{ Vector2<T>(), 0 };
+        std::vector<Path> _paths;
+        std::vector<Change> _changes;
+        std::vector<std::vector<Arrival<T>>> _scratch;
+        bool _invalid = true;
+        bool _listener_moved = false;
+
+        static T _distance2(Vector2<T> const & p, Vector2<T> const & a, Vector2<T> const & b) {
+            const Vector2<T> ab = b - a;
+            const T length2 = ab.dot(ab);
+            const T t = length2 > 0 ? std::clamp((p - a).dot(ab) / length2, T(0), T(1)) : T(0);
+            const Vector2<T> offset = p - (a + ab * t);
+            return offset.dot(offset);
+        }
+
+        // Whether the part from p to q comes within tolerance of a wall from a to b.
+        static bool _near_wall(Vector2<T> const & p, Vector2<T> const & q, Vector2<T> const & a, Vector2<T> const & b, T tolerance) {
+            if (Segment2<T>(a, b).intersect(p, q)) {
+                return true;
+            }
+            const T t2 = tolerance * tolerance;
+            return _distance2(p, a, b) <= t2 || _distance2(q, a, b) <= t2
+                || _distance2(a, p, q) <= t2 || _distance2(b, p, q) <= t2;
+        }
+
+        // Whether a moved circle or wall can change a path: the path ends on it, or passes its
+        // old or new position. A tolerance makes rays that only graze either position count too.
+        bool _affected(Scene<T> const & scene, Path const & path) const {
+            for (Segment const & s : path.segments) {
+                const Vector2<T> p = s.ray.position();
+                const Vector2<T> q = p + s.ray.direction() * s.extent;
+                for (Change const & c : _changes) {
+                    if (s.hit == c.index && s.wall == c.wall) {
+                        return true;
+                    }
+                    if (c.wall) {
+                        const Segment2<T> now = scene.walls().segment(static_cast<size_t>(c.index));
+                        const T tolerance = _settings.min_distance + T(1e-4) * now.length();
+                        if (_near_wall(p, q, c.a, c.b, tolerance) || _near_wall(p, q, now.start(), now.end(), tolerance)) {
+                            return true;
+                        }
+                    }
+                    else {
+                        const Vector2<T> center = scene.circles().center(static_cast<size_t>(c.index));
+                        const T radius = scene.circles().radius(static_cast<size_t>(c.index));
+                        const T old_reach = c.radius * (1 + T(1e-4)) + _settings.min_distance;
+                        const T new_reach = radius * (1 + T(1e-4)) + _settings.min_distance;
+                        if (_distance2(c.a, p, q) <= old_reach * old_reach || _distance2(center, p, q) <= new_reach * new_reach) {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        void _arrivals(Path const & path, uint32_t ray, std::vector<Arrival<T>>& out) const {
+            out.clear();
+            for (Segment const & s : path.segments) {
+                Arrival<T> a;
+                if (PropagationEngine<T>::arrival(_listener, s.ray, s.extent, s.energy, s.order, ray, a)) {
+                    out.push_back(a);
+                }
+            }
+        }
+
+        static bool _same(std::vector<Arrival<T>> const & a, std::vector<Arrival<T>> const & b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](Arrival<T> const & x, Arrival<T> const & y) {
+                return x.length == y.length && x.energy == y.energy && x.order == y.order;
+            });
+        }
+
+        template <class OnArrival>
+        static void _report(std::vector<Arrival<T>> const & arrivals, T sign, size_t worker, OnArrival& on_arrival) {
+            for (Arrival<T> a : arrivals) {
+                a.energy *= sign;
+                on_arrival(worker, a);
+            }
+        }
+
+    public:
+        IncrementalPropagation(ThreadPool& pool, PropagationSettings<T> const & settings)
+            : _pool(pool), _settings(settings), _scratch(pool.worker_count()) {}
+
+        PropagationSettings<T> const & settings() const { return _settings; }
+        Vector2<T> const & source() const { return _source; }
+        Listener<T> const & listener() const { return _listener; }
+
+        // Changes the settings. All paths are retraced at the next update().
+        void set_settings(PropagationSettings<T> const & settings) {
+            _settings = settings;
+            _invalid = true;
+        }
+
+        // Moves the source. All paths are retraced at the next update().
+        void set_source(Vector2<T> const & source) {
+            _source = source;
+            _invalid = true;
+        }
+
+        // Moves the listener. Only arrivals are recomputed at the next update().
+        void set_listener(Listener<T> const & listener) {
+            _listener = listener;
+            _listener_moved = true;
+        }
+
+        // Records that circle i of the scene has moved from the given position. Call it with the
+        // position before the move, once per move, and before the next update().
+        void moved_circle(size_t i, Vector2<T> const & old_center, T old_radius) {
+            _changes.push_back(Change{ old_center, old_center, old_radius, static_cast<int32_t>(i), false });
+        }
+
+        // Same as moved_circle(), for wall i.
+        void moved_wall(size_t i, Segment2<T> const & old_wall) {
+            _changes.push_back(Change{ old_wall.start(), old_wall.end(), 0, static_cast<int32_t>(i), true });
+        }
+
+        // Retraces every path at the next update(), e.g. after adding geometry to the scene.
+        void invalidate() {
+            _invalid = true;
+        }
+
+        // Traces all rays from scratch, reporting every arrival.
+        template <class OnArrival>
+        size_t run(Scene<T> const & scene, Vector2<T> const & source, Listener<T> const & listener, OnArrival&& on_arrival) {
+            set_source(source);
+            set_listener(listener);
+            return update(scene, on_arrival);
+        }
+
+        // Brings the kept paths up to date with the scene, source and listener, reporting the
+        // arrivals that changed as described above. Returns the number of rays retraced.
+        template <class OnArrival>
+        size_t update(Scene<T> const & scene, OnArrival&& on_arrival) {
+            // Arrivals of rays dropped by a smaller ray count are removed.
+            for (size_t r = _settings.ray_count; r < _paths.size(); ++r) {
+                _report(_paths[r].arrivals, T(-1), 0, on_arrival);
+            }
+            _paths.resize(_settings.ray_count);
+
+            const size_t batch_size = std::max<size_t>(1, _settings.batch_size);
+            const size_t batch_count = (_paths.size() + batch_size - 1) / batch_size;
+            const T energy = T(1) / static_cast<T>(std::max<size_t>(1, _settings.ray_count));
+            std::atomic<size_t> retraced{ 0 };
+
+            if (_invalid || _listener_moved || !_changes.empty()) {
+                _pool.parallel_for(batch_count, [&](size_t batch, size_t worker) {
+                    const size_t first = batch * batch_size;
+                    const size_t last = std::min(first + batch_size, _paths.size());
+                    std::vector<Arrival<T>>& arrivals = _scratch[worker];
+                    size_t count = 0;
+                    for (size_t r = first; r < last; ++r) {
+                        Path& path = _paths[r];
+                        const bool retrace = _invalid || (!_changes.empty() && _affected(scene, path));
+                        if (!retrace && !_listener_moved) {
+                            continue;
+                        }
+                        if (retrace) {
+                            path.segments.clear();
+                            const Ray2<T> ray(_source, PropagationEngine<T>::direction(r, _settings));
+                            PropagationEngine<T>::trace_segments(scene, _settings, ray, energy,
+                                [&](Ray2<T> const & part, T extent, T part_energy, uint32_t order, CircleHit<T> const & hit) {
+                                    path.segments.push_back(Segment{ part, extent, part_energy, order, hit.index, hit.wall });
+                                });
+                            ++count;
+                        }
+                        _arrivals(path, static_cast<uint32_t>(r), arrivals);
+                        if (!_same(arrivals, path.arrivals)) {
+                            _report(path.arrivals, T(-1), worker, on_arrival);
+                            _report(arrivals, T(1), worker, on_arrival);
+                            path.arrivals.swap(arrivals);
+                        }
+                    }
+                    retraced.fetch_add(count, std::memory_order_relaxed);
+                });
+            }
+
+            _invalid = false;
+            _listener_moved = false;
+            _changes.clear();
+            return retraced.load();
+        }
+
+        std::vector<Path> const & paths() const { return _paths; }
+
+        // All current arrivals ordered by ray index, as returned by PropagationEngine::run().
+        std::vector<Arrival<T>> arrivals() const {
+            std::vector<Arrival<T>> result;
+            for (Path const & path : _paths) {
+                result.insert(result.end(), path.arrivals.begin(), path.arrivals.end());
+            }
+            return result;
+        }
+    };
+}
@@ -0,0 +1,306 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Opt-in instrumentation of the library's hot paths. Define JMP_INSTRUMENTATION (the same way
+// in every translation unit) to turn the hooks below on; otherwise they expand to nothing and
+// their arguments are not evaluated, so an uninstrumented build runs exactly the same code.
+//
+// JMP_COUNT(COUNTER, n) adds n to a per-thread Instrumentation::Counter.
+// JMP_TRACE_SCOPE("name") records the time until the end of the scope as a trace event.
+// JMP_TIME_SCOPE(COUNTER) adds the nanoseconds until the end of the scope to a counter.
+// JMP_THREAD_NAME(name) names the calling thread in the trace.
+//
+// Counting is a relaxed load and store on the thread's own cache line; trace events take an
+// uncontended per-thread lock, so they are kept to coarse scopes (batches of rays, blocks of
+// samples, files) rather than single intersection tests, which are only counted.
+// Usage:
+//
+// // Build with -DJMP_INSTRUMENTATION
+// engine.run(scene, source, listener, settings, add);
+// const auto totals = Instrumentation::totals();
+// Instrumentation::write_chrome_trace("trace.json"); // Open in chrome://tracing or ui.perfetto.dev.
+//
+#ifdef JMP_INSTRUMENTATION
+#define JMP_INSTRUMENTATION_CONCAT_(a, b) a##b
+#define JMP_INSTRUMENTATION_CONCAT(a, b) JMP_INSTRUMENTATION_CONCAT_(a, b)
+#define JMP_COUNT(COUNTER, n) ::JMP::Instrumentation::add(::JMP::Instrumentation::Counter::COUNTER, static_cast<uint64_t>(n))
+#define JMP_TRACE_SCOPE(name) const ::JMP::Instrumentation::Scope JMP_INSTRUMENTATION_CONCAT(jmp_trace_scope_, __LINE__)(name)
+#define JMP_TIME_SCOPE(COUNTER) const ::JMP::Instrumentation::Timer JMP_INSTRUMENTATION_CONCAT(jmp_time_scope_, __LINE__)(::JMP::Instrumentation::Counter::COUNTER)
+#define JMP_THREAD_NAME(name) ::JMP::Instrumentation::set_thread_name(name)
+#else
+#define JMP_COUNT(COUNTER, n) ((void)0)
+#define JMP_TRACE_SCOPE(name) ((void)0)
+#define JMP_TIME_SCOPE(COUNTER) ((void)0)
+#define JMP_THREAD_NAME(name) ((void)0)
+#endif
+
+namespace JMP
+{
+	namespace Instrumentation {
+
+#ifdef JMP_INSTRUMENTATION
+		constexpr bool enabled = true;
+#else
+		constexpr bool enabled = false;
+#endif
+
+		enum class Counter : uint32_t {
+			RAYS_TRACED,
+			// Ray against circle or wall, in the scene index, packets and Ray2.
+			INTERSECTION_TESTS,
+			BOUNCES,
+			ARRIVALS,
+			// Float samples converted to PCM, in bytes of input.
+			BYTES_CONVERTED,
+			// Bytes handed to files by the WaveFile writers.
+			BYTES_WRITTEN,
+			// Time producers spent waiting for AsyncFile buffers or completions.
+			IO_STALL_NANOSECONDS,
+			COUNT
+		};
+
+		constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+		inline char const* name(Counter counter) noexcept
+		{
+			static char const* const names[COUNTER_COUNT] = {
+				"rays_traced", "intersection_tests", "bounces", "arrivals",
+				"bytes_converted", "bytes_written", "io_stall_ns"
+			};
+			return names[static_cast<size_t>(counter)];
+		}
+
+		// A completed scope, in nanoseconds since the first use of the instrumentation.
+		struct Event {
+			char const* name;
+			uint64_t start;
+			uint64_t duration;
+		};
+
+		// Events kept per thread; later ones are counted as dropped.
+		constexpr size_t MAX_EVENTS_PER_THREAD = size_t(1) << 20;
+
+		namespace detail {
+
+			struct alignas(64) ThreadData {
+				std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+				std::mutex mutex;
+				std::vector<Event> events;
+				std::string name;
+				uint64_t dropped = 0;
+				uint32_t id = 0;
+			};
+
+			// Thread data outlives its thread, so that the work of a stopped thread pool
+			// still shows up in the totals and the trace.
+			struct Registry {
+				std::mutex mutex;
+				std::vector<std::shared_ptr<ThreadData>> threads;
+				const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+			};
+
+			inline Registry& registry()
+			{
+				static Registry r;
+				return r;
+			}
+
+			inline ThreadData& thread_data()
+			{
+				thread_local const std::shared_ptr<ThreadData> data = [] {
+					auto d = std::make_shared<ThreadData>();
+					Registry& r = registry();
+					std::lock_guard<std::mutex> lock(r.mutex);
+					d->id = static_cast<uint32_t>(r.threads.size());
+					r.threads.push_back(d);
+					return d;
+				}();
+				return *data;
+			}
+
+			inline std::vector<std::shared_ptr<ThreadData>> threads()
+			{
+				Registry& r = registry();
+				std::lock_guard<std::mutex> lock(r.mutex);
+				return r.threads;
+			}
+
+			inline void write_string(std::ostream& out, std::string const& s)
+			{
+				out << '"';
+				for (char c : s) {
+					if (c == '"' || c == '\\') {
+						out << '\\' << c;
+					}
+					else if (static_cast<unsigned char>(c) >= 0x20) {
+						out << c;
+					}
+				}
+				out << '"';
+			}
+		}
+
+		inline uint64_t now() noexcept
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - detail::registry().epoch).count());
+		}
+
+		inline void add(Counter counter, uint64_t n) noexcept
+		{
+			// Only the owning thread writes its counters, so no read-modify-write is needed.
+			std::atomic<uint64_t>& c = detail::thread_data().counters[static_cast<size_t>(counter)];
+			c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		// Events that cannot be stored, past MAX_EVENTS_PER_THREAD or out of memory, are dropped.
+		inline void record(char const* name, uint64_t start, uint64_t duration) noexcept
+		{
+			detail::ThreadData& data = detail::thread_data();
+			std::lock_guard<std::mutex> lock(data.mutex);
+			if (data.events.size() < MAX_EVENTS_PER_THREAD) {
+				try {
+					data.events.push_back(Event{ name, start, duration });
+					return;
+				}
+				catch (std::bad_alloc const&) {
+				}
+			}
+			++data.dropped;
+		}
+
+		inline void set_thread_name(std::string name)
+		{
+			detail::ThreadData& data = detail::thread_data();
+			std::lock_guard<std::mutex> lock(data.mutex);
+			data.name = std::move(name);
+		}
+
+		// Records a trace event for its lifetime. name must outlive the export, e.g. a literal.
+		class Scope {
+			char const* _name;
+			uint64_t _start;
+
+		public:
+			explicit Scope(char const* name) noexcept : _name(name), _start(now()) {}
+			Scope(Scope const&) = delete;
+			Scope& operator=(Scope const&) = delete;
+			~Scope() { record(_name, _start, now() - _start); }
+		};
+
+		// Adds its lifetime in nanoseconds to a counter.
+		class Timer {
+			Counter _counter;
+			uint64_t _start;
+
+		public:
+			explicit Timer(Counter counter) noexcept : _counter(counter), _start(now()) {}
+			Timer(Timer const&) = delete;
+			Timer& operator=(Timer const&) = delete;
+			~Timer() { add(_counter, now() - _start); }
+		};
+
+		using Totals = std::array<uint64_t, COUNTER_COUNT>;
+
+		// Counters summed over all threads so far.
+		inline Totals totals()
+		{
+			Totals sum{};
+			for (auto const& data : detail::threads()) {
+				for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+					sum[c] += data->counters[c].load(std::memory_order_relaxed);
+				}
+			}
+			return sum;
+		}
+
+		inline uint64_t total(Counter counter)
+		{
+			return totals()[static_cast<size_t>(counter)];
+		}
+
+		// Clears the counters and events of every thread. Counts made concurrently may be lost.
+		inline void reset()
+		{
+			for (auto const& data : detail::threads()) {
+				for (auto& c : data->counters) {
+					c.store(0, std::memory_order_relaxed);
+				}
+				std::lock_guard<std::mutex> lock(data->mutex);
+				data->events.clear();
+				data->dropped = 0;
+			}
+		}
+
+		// Writes the events as Chrome trace JSON, one track per thread, with the counters of
+		// each thread as a counter event at the time of the export. Perfetto reads the same
+		// format.
+		inline void write_chrome_trace(std::ostream& out)
+		{
+			const auto threads = detail::threads();
+			const uint64_t end = now();
+			bool first = true;
+			const auto separator = [&] {
+				out << (first ? "\n" : ",\n");
+				first = false;
+			};
+			const auto micros = [&](uint64_t ns) {
+				out << ns / 1000 << '.' << static_cast<char>('0' + ns / 100 % 10)
+					<< static_cast<char>('0' + ns / 10 % 10) << static_cast<char>('0' + ns % 10);
+			};
+			out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			for (auto const& data : threads) {
+				std::lock_guard<std::mutex> lock(data->mutex);
+				separator();
+				out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << data->id << ",\"args\":{\"name\":";
+				detail::write_string(out, data->name.empty() ? "thread " + std::to_string(data->id) : data->name);
+				out << "}}";
+				for (Event const& e : data->events) {
+					separator();
+					out << "{\"name\":";
+					detail::write_string(out, e.name);
+					out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << data->id << ",\"ts\":";
+					micros(e.start);
+					out << ",\"dur\":";
+					micros(e.duration);
+					out << '}';
+				}
+				separator();
+				out << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":" << data->id << ",\"ts\":";
+				micros(end);
+				out << ",\"args\":{";
+				for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+					out << (c > 0 ? "," : "") << '"' << name(static_cast<Counter>(c)) << "\":"
+						<< data->counters[c].load(std::memory_order_relaxed);
+				}
+				out << ",\"dropped_events\":" << data->dropped << "}}";
+			}
+			out << "\n]}\n";
+		}
+
+		inline bool write_chrome_trace(std::string const& filename)
+		{
+			std::ofstream out(filename, std::ios::binary);
+			write_chrome_trace(out);
+			return static_cast<bool>(out.flush());
+		}
+	}
+}
@@ -0,0 +1,260 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+namespace JMP
+{
+	// Cache line size assumed for padding and alignment.
+	constexpr size_t CACHE_LINE_SIZE = 64;
+
+	// Standard allocator returning memory aligned to the given boundary, which must be a power of two.
+	// Used for SIMD buffers so that packs never straddle a cache line.
+	template <typename T, size_t Alignment = CACHE_LINE_SIZE>
+	class AlignedAllocator {
+		static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two.");
+		static_assert(Alignment >= alignof(T), "Alignment must be at least the natural alignment of T.");
+	public:
+		using value_type = T;
+
+		template <typename U>
+		struct rebind {
+			using other = AlignedAllocator<U, Alignment>;
+		};
+
+		AlignedAllocator() noexcept = default;
+
+		template <typename U>
+		AlignedAllocator(AlignedAllocator<U, Alignment> const&) noexcept {}
+
+		T* allocate(size_t n)
+		{
+			if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+				throw std::bad_array_new_length();
+			}
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+		}
+
+		void deallocate(T* p, size_t) noexcept
+		{
+			::operator delete(p, std::align_val_t(Alignment));
+		}
+
+		template <typename U>
+		bool operator==(AlignedAllocator<U, Alignment> const&) const noexcept { return true; }
+
+		template <typename U>
+		bool operator!=(AlignedAllocator<U, Alignment> const&) const noexcept { return false; }
+	};
+
+	// Bump allocator for short-lived data that is released all at once, e.g. once per frame.
+	// Memory is taken from cache-line aligned chunks; reset() makes all of it available again
+	// without returning it to the heap, and merges the chunks into a single one of the same
+	// total size so that the pattern of the next frame fits without allocating. After a few
+	// frames the arena is as large as the largest frame and allocating from it never touches
+	// the heap. Only trivially destructible objects can be placed in an arena.
+	// Usage:
+	//
+	// Arena arena;
+	// for (;;) {
+	//     arena.reset();
+	//     float* scratch = arena.allocate<float>(count);
+	//     ...
+	// }
+	//
+	class Arena {
+	private:
+		struct Chunk {
+			std::byte* data;
+			size_t size;
+		};
+
+		static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+		std::vector<Chunk> _chunks;
+		size_t _current = 0;
+		size_t _offset = 0;
+		size_t _capacity = 0;
+
+		void _add_chunk(size_t size)
+		{
+			std::byte* data = static_cast<std::byte*>(::operator new(size, std::align_val_t(CACHE_LINE_SIZE)));
+			_chunks.push_back(Chunk{ data, size });
+			_capacity += size;
+		}
+
+		void _release() noexcept
+		{
+			for (Chunk const& chunk : _chunks) {
+				::operator delete(chunk.data, std::align_val_t(CACHE_LINE_SIZE));
+			}
+			_chunks.clear();
+			_capacity = 0;
+		}
+
+	public:
+		// Creates an arena, allocating a first chunk of the given size if it is not 0.
+		explicit Arena(size_t initial_size = 0)
+		{
+			if (initial_size > 0) {
+				_add_chunk(initial_size);
+			}
+		}
+
+		Arena(Arena const&) = delete;
+		Arena& operator=(Arena const&) = delete;
+
+		Arena(Arena&& other) noexcept
+			: _chunks(std::move(other._chunks)), _current(other._current), _offset(other._offset), _capacity(other._capacity)
+		{
+			other._chunks.clear();
+			other._current = other._offset = other._capacity = 0;
+		}
+
+		Arena& operator=(Arena&& other) noexcept
+		{
+			if (this != &other) {
+				_release();
+				_chunks = std::move(other._chunks);
+				_current = other._current;
+				_offset = other._offset;
+				_capacity = other._capacity;
+				other._chunks.clear();
+				other._current = other._offset = other._capacity = 0;
+			}
+			return *this;
+		}
+
+		~Arena() { _release(); }
+
+		// Returns size bytes aligned to alignment, which must be a power of two. The memory
+		// stays valid until the next reset().
+		void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+		{
+			for (;;) {
+				for (; _current < _chunks.size(); ++_current, _offset = 0) {
+					Chunk const& chunk = _chunks[_current];
+					const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data);
+					const size_t start = static_cast<size_t>(((base + _offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base);
+					if (start <= chunk.size && size <= chunk.size - start) {
+						_offset = start + size;
+						return chunk.data + start;
+					}
+				}
+				// Chunks grow geometrically so that a frame needs few of them the first time round.
+				if (size > std::numeric_limits<size_t>::max() - alignment) {
+					throw std::bad_alloc();
+				}
+				_add_chunk(std::max({ size + alignment, _capacity, MIN_CHUNK_SIZE }));
+				_current = _chunks.size() - 1;
+				_offset = 0;
+			}
+		}
+
+		// Storage for count objects of type T, left uninitialized.
+		template <typename T>
+		T* allocate(size_t count)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed.");
+			if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+				throw std::bad_array_new_length();
+			}
+			return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+		}
+
+		// Makes all memory available again. Invalidates everything allocated so far.
+		void reset()
+		{
+			if (_chunks.size() > 1) {
+				const size_t total = _capacity;
+				_release();
+				_add_chunk(total);
+			}
+			_current = 0;
+			_offset = 0;
+		}
+
+		// Frees all memory.
+		void release() noexcept
+		{
+			_release();
+			_current = 0;
+			_offset = 0;
+		}
+
+		// Total size of the chunks, including the parts that have not been handed out.
+		size_t capacity() const noexcept { return _capacity; }
+		size_t chunk_count() const noexcept { return _chunks.size(); }
+	};
+
+	// First-in first-out queue over a ring of preallocated slots. reset() only allocates when
+	// the requested capacity grows, so a queue that is refilled for every batch of work reaches
+	// a steady state without any allocation.
+	template <typename T>
+	class FixedQueue {
+	private:
+		std::vector<T, AlignedAllocator<T>> _slots;
+		size_t _head = 0;
+		size_t _size = 0;
+
+	public:
+		FixedQueue() = default;
+		explicit FixedQueue(size_t capacity) : _slots(capacity) {}
+
+		size_t capacity() const noexcept { return _slots.size(); }
+		size_t size() const noexcept { return _size; }
+		bool empty() const noexcept { return _size == 0; }
+		bool full() const noexcept { return _size == _slots.size(); }
+
+		// Empties the queue and makes room for at least capacity items.
+		void reset(size_t capacity)
+		{
+			if (capacity > _slots.size()) {
+				_slots.resize(capacity);
+			}
+			clear();
+		}
+
+		void clear() noexcept
+		{
+			_head = 0;
+			_size = 0;
+		}
+
+		// Adds an item at the back. The queue must not be full.
+		void push_back(T const& item)
+		{
+			size_t i = _head + _size;
+			if (i >= _slots.size()) {
+				i -= _slots.size();
+			}
+			_slots[i] = item;
+			++_size;
+		}
+
+		// The oldest item. The queue must not be empty.
+		T& front() { return _slots[_head]; }
+		T const& front() const { return _slots[_head]; }
+
+		void pop_front()
+		{
+			if (++_head == _slots.size()) {
+				_head = 0;
+			}
+			--_size;
+		}
+	};
+}
@@ -0,0 +1,438 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "audio.hpp"
+#include "bands.hpp"
+#include "vectors.hpp"
+#include "vector_batch.hpp"
+#include "spatial.hpp"
+#include "thread_pool.hpp"
+#include "memory.hpp"
+#include "instrumentation.hpp"
+
+namespace JMP
+{
+    // A ray crossing the listener.
+    template <typename T>
+    struct Arrival {
+        T length;        // Path length from the source to the point of closest approach.
+        T energy;        // Energy carried by the ray, after absorption.
+        uint32_t ray;    // Index of the ray that produced the arrival.
+        uint32_t order;  // Number of reflections before reaching the listener.
+    };
+
+    // A ray crossing the listener, with one energy per octave band.
+    template <typename T>
+    struct BandArrival {
+        T length;
+        Bands<T> energy; // After absorption by the surfaces and the air.
+        uint32_t ray;
+        uint32_t order;
+    };
+
+    // Absorption of sound by air, as an energy attenuation coefficient per octave band: energy
+    // decays as exp(-per_meter * length).
+    template <typename T>
+    struct AirAbsorption {
+        Bands<T> per_meter = Bands<T>::broadcast(0);
+
+        // Attenuations given in dB per kilometre, as tabulated in the literature.
+        static AirAbsorption from_decibels_per_km(Bands<T> const & db) {
+            return AirAbsorption{ db * static_cast<T>(2.302585092994045684 / 10000) };
+        }
+
+        // ISO 9613-1 values at 20 degrees C, 50% relative humidity and normal pressure.
+        static AirAbsorption standard() {
+            return from_decibels_per_km(Bands<T>{ { T(0.12), T(0.41), T(1.04), T(1.93), T(3.66), T(9.66), T(32.8), T(117) } });
+        }
+
+        // Fraction of the energy left after the given distance.
+        Bands<T> attenuation(T length) const {
+            Bands<T> r;
+            for (size_t b = 0; b < Bands<T>::count; ++b) {
+                r[b] = std::exp(-per_meter[b] * length);
+            }
+            return r;
+        }
+
+        // Fraction of the energy left after travelling for the given time, in seconds.
+        Bands<T> attenuation_after(T seconds) const {
+            return attenuation(seconds * static_cast<T>(Audio::SPEED_OF_SOUND));
+        }
+    };
+
+    template <typename T>
+    struct Listener {
+        Vector2<T> position;
+        T radius;
+    };
+
+    // Reflecting geometry for the propagation engine: circles and walls (line segments) with an
+    // absorption coefficient each, indexed by a uniform grid. A circle enclosing the source acts
+    // as a circular room; walls model rooms of any polygonal shape, convex or not. Surfaces can
+    // also absorb differently in each octave band, for PropagationEngine::run_bands(); the
+    // single coefficient of such a surface is the mean over the bands.
+    template <typename T>
+    class Scene {
+    private:
+        CircleSet<T> _circles;
+        std::vector<T> _absorption;
+        std::vector<Bands<T>> _reflectance;
+        SegmentSet<T> _walls;
+        std::vector<T> _wall_absorption;
+        std::vector<Bands<T>> _wall_reflectance;
+        CircleGrid<T> _index;
+
+    public:
+        // Adds a circle. absorption is the fraction of energy lost at each reflection.
+        // Call build() once all circles have been added.
+        size_t add_circle(Vector2<T> const & center, T radius, T absorption = 0) {
+            _circles.push_back(center, radius);
+            _absorption.push_back(absorption);
+            _reflectance.push_back(Bands<T>::broadcast(1 - absorption));
+            return _circles.size() - 1;
+        }
+
+        // Same as above, with an absorption per octave band.
+        size_t add_circle(Vector2<T> const & center, T radius, Bands<T> const & absorption) {
+            const size_t i = add_circle(center, radius, absorption.mean());
+            _reflectance[i] = Bands<T>::broadcast(1) - absorption;
+            return i;
+        }
+
+        // Adds a wall, reflecting on both sides. Call build() once all walls have been added.
+        size_t add_wall(Segment2<T> const & wall, T absorption = 0) {
+            _walls.push_back(wall);
+            _wall_absorption.push_back(absorption);
+            _wall_reflectance.push_back(Bands<T>::broadcast(1 - absorption));
+            return _walls.size() - 1;
+        }
+
+        // Same as above, with an absorption per octave band.
+        size_t add_wall(Segment2<T> const & wall, Bands<T> const & absorption) {
+            const size_t i = add_wall(wall, absorption.mean());
+            _wall_reflectance[i] = Bands<T>::broadcast(1) - absorption;
+            return i;
+        }
+
+        void build() {
+            _index.build(_circles, _walls);
+        }
+
+        // Moves a circle between frames, updating the index incrementally.
+        void move_circle(size_t i, Vector2<T> const & center, T radius) {
+            _circles.set(i, center, radius);
+            _index.update(i, center, radius);
+        }
+
+        // Moves a wall between frames, updating the index incrementally.
+        void move_wall(size_t i, Segment2<T> const & wall) {
+            _walls.set(i, wall);
+            _index.update_wall(i, wall);
+        }
+
+        CircleSet<T> const & circles() const { return _circles; }
+        SegmentSet<T> const & walls() const { return _walls; }
+        T absorption(size_t i) const { return _absorption[i]; }
+        T wall_absorption(size_t i) const { return _wall_absorption[i]; }
+
+        // Absorption of the circle or wall hit by a ray.
+        T absorption(CircleHit<T> const & hit) const {
+            return hit.wall ? _wall_absorption[hit.index] : _absorption[hit.index];
+        }
+
+        // Fraction of the energy reflected in each band by the circle or wall hit by a ray.
+        Bands<T> const & reflectance(CircleHit<T> const & hit) const {
+            return hit.wall ? _wall_reflectance[hit.index] : _reflectance[hit.index];
+        }
+
+        CircleHit<T> intersect(Ray2<T> const & ray, T min_distance) const {
+            return _index.intersect(ray, min_distance);
+        }
+
+        // Unit normal of the surface hit by a ray at the given point.
+        Vector2<T> normal(CircleHit<T> const & hit, Vector2<T> const & point) const {
+            if (hit.wall) {
+                return _walls.normal(hit.index);
+            }
+            return (point - _circles.center(hit.index)) * (1 / _circles.radius(hit.index));
+        }
+    };
+
+    template <typename T>
+    struct PropagationSettings {
+        size_t ray_count = 10000;
+        // Rays per task handed to the thread pool.
+        size_t batch_size = 256;
+        // Rays are dropped once they have travelled this far (one second of sound by default).
+        T max_length = static_cast<T>(Audio::SPEED_OF_SOUND);
+        // Rays are dropped once their energy falls below this fraction of their initial energy.
+        T min_energy = T(1e-6);
+        size_t max_reflections = 10000;
+        // Minimum distance to the next hit, which keeps rays from hitting the surface they just left.
+        T min_distance = T(1e-5);
+        // Emit rays in random directions instead of evenly spaced ones. Direction i only depends on
+        // the seed and i, so results are reproducible with any number of threads.
+        bool random_directions = false;
+        uint64_t seed = 0;
+    };
+
+    // Traces rays from a point source through a scene in parallel and reports every crossing
+    // of the listener. Rays are emitted at evenly spaced or random angles and bounce specularly until
+    // their length or energy falls past the cutoffs. Each ray starts with an energy of
+    // 1 / ray_count, so the total emitted energy is 1.
+    //
+    // Every worker keeps a workspace between batches and runs: a queue of the rays of its
+    // current batch, with their directions generated for the whole batch at once, and an arena
+    // holding the arrivals of finished batches until they are merged. Once the first run has
+    // sized them, further runs of the same size trace without any heap allocation (pass the
+    // output vector to run() to reuse its capacity too). Because of the workspaces, run() must
+    // not be called concurrently on the same engine, as for ThreadPool::parallel_for().
+    template <typename T>
+    class PropagationEngine {
+    private:
+        struct QueuedRay {
+            Ray2<T> ray;
+            uint32_t index;
+        };
+
+        struct Workspace {
+            FixedQueue<QueuedRay> rays;
+            Vector2Batch<T> directions;
+            std::vector<Arrival<T>> arrivals;
+            Arena arena;
+        };
+
+        struct BatchArrivals {
+            Arrival<T> const* data;
+            size_t count;
+        };
+
+        ThreadPool& _pool;
+        mutable std::vector<Workspace> _workspaces;
+        mutable std::vector<BatchArrivals> _batches;
+
+        static T _peak(T energy) { return energy; }
+        static T _peak(Bands<T> const & energy) { return energy.max(); }
+
+        // Calls f(batch, worker, workspace) for every batch of rays, in parallel, with the rays
+        // of the batch queued in the workspace.
+        template <class F>
+        void _for_each_batch(Vector2<T> const & source, PropagationSettings<T> const & settings, F&& f) const {
+            const size_t batch_size = std::max<size_t>(1, settings.batch_size);
+            const size_t batch_count = (settings.ray_count + batch_size - 1) / batch_size;
+            _pool.parallel_for(batch_count, [&](size_t batch, size_t worker) {
+                const size_t first = batch * batch_size;
+                const size_t last = std::min(first + batch_size, settings.ray_count);
+                JMP_TRACE_SCOPE("PropagationEngine::batch");
+                Workspace& w = _workspaces[worker];
+                _enqueue(w, source, settings, first, last);
+                f(batch, worker, w);
+            });
+        }
+
+        // Queues the rays [first, last) in the workspace.
+        static void _enqueue(Workspace& w, Vector2<T> const & source, PropagationSettings<T> const & settings, size_t first, size_t last) {
+            const size_t count = last - first;
+            w.rays.reset(count);
+            if (settings.random_directions) {
+                w.directions.resize(count);
+                Vector2Batch<T>::random_directions(w.directions.x(), w.directions.y(), count, settings.seed, first);
+                for (size_t i = 0; i < count; ++i) {
+                    w.rays.push_back(QueuedRay{ Ray2<T>(source, w.directions[i]), static_cast<uint32_t>(first + i) });
+                }
+                return;
+            }
+            for (size_t r = first; r < last; ++r) {
+                w.rays.push_back(QueuedRay{ Ray2<T>(source, direction(r, settings)), static_cast<uint32_t>(r) });
+            }
+        }
+
+    public:
+        explicit PropagationEngine(ThreadPool& pool) : _pool(pool), _workspaces(pool.worker_count()) {}
+
+        ThreadPool& pool() const { return _pool; }
+
+        // Initial direction of a ray.
+        static Vector2<T> direction(size_t ray, PropagationSettings<T> const & settings) {
+            if (settings.random_directions) {
+                return Vector2Batch<T>::RandomDirection(settings.seed, ray);
+            }
+            const T two_pi = static_cast<T>(6.283185307179586476925286766559);
+            return Vector2<T>::AngleMagnitude(two_pi * (static_cast<T>(ray) + T(0.5)) / static_cast<T>(settings.ray_count), 1);
+        }
+
+        // Follows a single ray, calling on_segment(ray, extent, energy, order, hit) for each
+        // straight part of its path: ray is the ray at the start of the part, extent the distance
+        // it covers, energy the energy it carries and hit the surface it ends on (empty for the
+        // last part if the ray is dropped before reaching a surface). Energy is either T or
+        // Bands<T>; band energies are reflected with Scene::reflectance() and the ray is dropped
+        // once its strongest band falls below the cutoff.
+        template <class Energy, class OnSegment>
+        static void trace_segments(Scene<T> const & scene, PropagationSettings<T> const & settings,
+                                   Ray2<T> ray, Energy const & initial_energy, OnSegment&& on_segment) {
+            JMP_COUNT(RAYS_TRACED, 1);
+            Energy energy = initial_energy;
+            const T min_energy = _peak(energy) * settings.min_energy;
+            uint32_t order = 0;
+
+            while (ray.length() < settings.max_length && _peak(energy) > min_energy && order <= settings.max_reflections) {
+                CircleHit<T> hit = scene.intersect(ray, settings.min_distance);
+                const T remaining = settings.max_length - ray.length();
+                on_segment(ray, std::min(hit.distance, remaining), energy, order, hit.distance <= remaining ? hit : CircleHit<T>());
+
+                if (!hit) {
+                    break;
+                }
+                JMP_COUNT(BOUNCES, 1);
+                ray.move(hit.distance);
+                ray.reflect(scene.normal(hit, ray.position()));
+                if constexpr (std::is_same<Energy, Bands<T>>::value) {
+                    energy *= scene.reflectance(hit);
+                }
+                else {
+                    energy *= 1 - scene.absorption(hit);
+                }
+                ++order;
+            }
+        }
+
+        // Distance along one part of a path (see trace_segments()) to its closest approach to
+        // the listener, or a negative value if the part does not cross the listener.
+        static T approach(Listener<T> const & listener, Ray2<T> const & ray, T extent) {
+            const Vector2<T> to_listener = listener.position - ray.position();
+            const T along = std::clamp(to_listener.dot(ray.direction()), T(0), extent);
+            const Vector2<T> offset = to_listener - ray.direction() * along;
+            return offset.dot(offset) <= listener.radius * listener.radius ? along : T(-1);
+        }
+
+        // The arrival produced by one part of a path, if it crosses the listener.
+        static bool arrival(Listener<T> const & listener, Ray2<T> const & ray, T extent, T energy, uint32_t order,
+                            uint32_t ray_index, Arrival<T>& out) {
+            const T along = approach(listener, ray, extent);
+            if (along < 0) {
+                return false;
+            }
+            JMP_COUNT(ARRIVALS, 1);
+            out = Arrival<T>{ ray.length() + along, energy, ray_index, order };
+            return true;
+        }
+
+        // Follows a single ray, calling emit(arrival) for each crossing of the listener.
+        template <class Emit>
+        static void trace(Scene<T> const & scene, Listener<T> const & listener, PropagationSettings<T> const & settings,
+                          Ray2<T> ray, T energy, uint32_t ray_index, Emit&& emit) {
+            trace_segments(scene, settings, ray, energy, [&](Ray2<T> const & part, T extent, T part_energy, uint32_t order, CircleHit<T> const &) {
+                Arrival<T> a;
+                if (arrival(listener, part, extent, part_energy, order, ray_index, a)) {
+                    emit(a);
+                }
+            });
+        }
+
+        // Same as trace(), with one energy per octave band. Surfaces reflect with their band
+        // reflectance and the air absorbs along the path, which is applied to each arrival from
+        // its length. The energy cutoff leaves out the air, so it never drops a ray too early.
+        template <class Emit>
+        static void trace_bands(Scene<T> const & scene, Listener<T> const & listener, PropagationSettings<T> const & settings,
+                                AirAbsorption<T> const & air, Ray2<T> ray, Bands<T> const & energy, uint32_t ray_index, Emit&& emit) {
+            trace_segments(scene, settings, ray, energy, [&](Ray2<T> const & part, T extent, Bands<T> const & part_energy, uint32_t order, CircleHit<T> const &) {
+                const T along = approach(listener, part, extent);
+                if (along >= 0) {
+                    JMP_COUNT(ARRIVALS, 1);
+                    const T length = part.length() + along;
+                    emit(BandArrival<T>{ length, part_energy * air.attenuation(length), ray_index, order });
+                }
+            });
+        }
+
+        // Traces all rays and calls on_arrival(worker, arrival) for each listener crossing.
+        // worker identifies the calling thread (see ThreadPool::parallel_for()), so callers can
+        // accumulate into per-worker state without locks.
+        template <class OnArrival>
+        void run(Scene<T> const & scene, Vector2<T> const & source, Listener<T> const & listener,
+                 PropagationSettings<T> const & settings, OnArrival&& on_arrival) const {
+            const T energy = T(1) / static_cast<T>(std::max<size_t>(1, settings.ray_count));
+            _for_each_batch(source, settings, [&](size_t, size_t worker, Workspace& w) {
+                for (; !w.rays.empty(); w.rays.pop_front()) {
+                    QueuedRay const & queued = w.rays.front();
+                    trace(scene, listener, settings, queued.ray, energy, queued.index, [&](Arrival<T> const & arrival) {
+                        on_arrival(worker, arrival);
+                    });
+                }
+            });
+        }
+
+        // Same as above with one energy per octave band, replacing one run per band: calls
+        // on_arrival(worker, band_arrival) for each listener crossing (see trace_bands()).
+        template <class OnArrival>
+        void run_bands(Scene<T> const & scene, Vector2<T> const & source, Listener<T> const & listener,
+                       PropagationSettings<T> const & settings, AirAbsorption<T> const & air, OnArrival&& on_arrival) const {
+            const Bands<T> energy = Bands<T>::broadcast(T(1) / static_cast<T>(std::max<size_t>(1, settings.ray_count)));
+            _for_each_batch(source, settings, [&](size_t, size_t worker, Workspace& w) {
+                for (; !w.rays.empty(); w.rays.pop_front()) {
+                    QueuedRay const & queued = w.rays.front();
+                    trace_bands(scene, listener, settings, air, queued.ray, energy, queued.index, [&](BandArrival<T> const & arrival) {
+                        on_arrival(worker, arrival);
+                    });
+                }
+            });
+        }
+
+        // Traces all rays and stores the arrivals in arrivals, ordered by ray index. Each batch
+        // collects its arrivals separately and the lists are concatenated at the end, so the
+        // result does not depend on the number of threads.
+        void run(Scene<T> const & scene, Vector2<T> const & source, Listener<T> const & listener,
+                 PropagationSettings<T> const & settings, std::vector<Arrival<T>>& arrivals) const {
+            const size_t batch_size = std::max<size_t>(1, settings.batch_size);
+            const size_t batch_count = (settings.ray_count + batch_size - 1) / batch_size;
+            const T energy = T(1) / static_cast<T>(std::max<size_t>(1, settings.ray_count));
+            for (Workspace& w : _workspaces) {
+                w.arena.reset();
+            }
+            _batches.assign(batch_count, BatchArrivals{ nullptr, 0 });
+
+            _for_each_batch(source, settings, [&](size_t batch, size_t, Workspace& w) {
+                w.arrivals.clear();
+                for (; !w.rays.empty(); w.rays.pop_front()) {
+                    QueuedRay const & queued = w.rays.front();
+                    trace(scene, listener, settings, queued.ray, energy, queued.index, [&](Arrival<T> const & arrival) {
+                        w.arrivals.push_back(arrival);
+                    });
+                }
+                Arrival<T>* out = w.arena.template allocate<Arrival<T>>(w.arrivals.size());
+                std::copy(w.arrivals.begin(), w.arrivals.end(), out);
+                _batches[batch] = BatchArrivals{ out, w.arrivals.size() };
+            });
+
+            size_t total = 0;
+            for (BatchArrivals const & b : _batches) {
+                total += b.count;
+            }
+            arrivals.clear();
+            arrivals.reserve(total);
+            for (BatchArrivals const & b : _batches) {
+                arrivals.insert(arrivals.end(), b.data, b.data + b.count);
+            }
+        }
+
+        std::vector<Arrival<T>> run(Scene<T> const & scene, Vector2<T> const & source, Listener<T> const & listener,
+                                    PropagationSettings<T> const & settings) const {
+            std::vector<Arrival<T>> arrivals;
+            run(scene, source, listener, settings, arrivals);
+            return arrivals;
+        }
+    };
+}
@@ -0,0 +1,123 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <limits>
+#include <type_traits>
+
+namespace JMP
+{
+	// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random
+	// Numbers: As Easy as 1, 2, 3", SC 2011). Each 128-bit counter is mapped to four
+	// independent 32-bit outputs by a keyed bijection, so any draw can be computed directly
+	// from its index without generator state. Using the ray index as the counter makes
+	// parallel runs reproducible regardless of how rays are split across threads.
+	//
+	// The class also satisfies UniformRandomBitGenerator for use with the standard
+	// distributions, e.g. with Vector2::Random:
+	//
+	// Philox4x32 generator(seed, ray_index);
+	// std::uniform_real_distribution<float> distribution(-M_PI, M_PI);
+	// Vector2<float> random_vector = Vector2<float>::Random(generator, distribution);
+	//
+	class Philox4x32 {
+	public:
+		using result_type = uint32_t;
+		using block_type = std::array<uint32_t, 4>;
+
+	private:
+		uint64_t _key;
+		uint64_t _stream;
+		uint64_t _counter = 0;
+		block_type _block{};
+		unsigned _index = 4;
+
+		static constexpr uint32_t M0 = 0xD2511F53u;
+		static constexpr uint32_t M1 = 0xCD9E8D57u;
+		static constexpr uint32_t W0 = 0x9E3779B9u;
+		static constexpr uint32_t W1 = 0xBB67AE85u;
+
+		static constexpr void _mul(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) noexcept
+		{
+			const uint64_t p = static_cast<uint64_t>(a) * b;
+			hi = static_cast<uint32_t>(p >> 32);
+			lo = static_cast<uint32_t>(p);
+		}
+
+	public:
+		// Maps a counter (index, stream) to four random words under the given key.
+		static constexpr block_type generate(uint64_t index, uint64_t stream, uint64_t key) noexcept
+		{
+			uint32_t c0 = static_cast<uint32_t>(index);
+			uint32_t c1 = static_cast<uint32_t>(index >> 32);
+			uint32_t c2 = static_cast<uint32_t>(stream);
+			uint32_t c3 = static_cast<uint32_t>(stream >> 32);
+			uint32_t k0 = static_cast<uint32_t>(key);
+			uint32_t k1 = static_cast<uint32_t>(key >> 32);
+			for (int round = 0; round < 10; ++round) {
+				uint32_t hi0 = 0, lo0 = 0, hi1 = 0, lo1 = 0;
+				_mul(M0, c0, hi0, lo0);
+				_mul(M1, c2, hi1, lo1);
+				c0 = hi1 ^ c1 ^ k0;
+				c1 = lo1;
+				c2 = hi0 ^ c3 ^ k1;
+				c3 = lo0;
+				k0 += W0;
+				k1 += W1;
+			}
+			return { c0, c1, c2, c3 };
+		}
+
+		explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0) noexcept : _key(seed), _stream(stream) {}
+
+		static constexpr result_type min() noexcept { return 0; }
+		static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()() noexcept
+		{
+			if (_index == 4) {
+				_block = generate(_counter++, _stream, _key);
+				_index = 0;
+			}
+			return _block[_index++];
+		}
+
+		// Positions the generator so that the next call returns the given 32-bit output of the stream.
+		void seek(uint64_t position) noexcept
+		{
+			_counter = position / 4;
+			_index = 4;
+			const unsigned skip = static_cast<unsigned>(position % 4);
+			if (skip != 0) {
+				_block = generate(_counter++, _stream, _key);
+				_index = skip;
+			}
+		}
+
+		void discard(uint64_t count) noexcept
+		{
+			seek(_counter * 4 - (4 - _index) + count);
+		}
+	};
+
+	// Converts random words to a uniformly distributed value in [0, 1). Floats use 24 bits of
+	// the first word, doubles 53 bits of the first two.
+	template <typename T, std::enable_if_t<std::is_floating_point<T>::value, bool> = true>
+	constexpr T uniform_unit(Philox4x32::block_type const& block, size_t word = 0) noexcept
+	{
+		if constexpr (sizeof(T) <= 4) {
+			return static_cast<T>(block[word] >> 8) * static_cast<T>(1.0 / 16777216.0);
+		}
+		else {
+			const uint64_t bits = (static_cast<uint64_t>(block[word]) << 21) | (block[(word + 1) % 4] >> 11);
+			return static_cast<T>(bits) * static_cast<T>(1.0 / 9007199254740992.0);
+		}
+	}
+}
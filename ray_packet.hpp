@@ -0,0 +1,369 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <limits>
+
+#include "vectors.hpp"
+#include "vector_batch.hpp"
+#include "simd.hpp"
+
+namespace JMP
+{
+    // Structure-of-arrays set of circles (e.g. scatterers).
+    template <typename T>
+    class CircleSet {
+    public:
+        using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+    private:
+        storage_type _x;
+        storage_type _y;
+        storage_type _radius;
+
+    public:
+        size_t size() const { return _x.size(); }
+        bool empty() const { return _x.empty(); }
+
+        void reserve(size_t count) {
+            _x.reserve(count);
+            _y.reserve(count);
+            _radius.reserve(count);
+        }
+
+        void clear() {
+            _x.clear();
+            _y.clear();
+            _radius.clear();
+        }
+
+        void push_back(Vector2<T> const & center, T radius) {
+            _x.push_back(center.x());
+            _y.push_back(center.y());
+            _radius.push_back(radius);
+        }
+
+        void set(size_t i, Vector2<T> const & center, T radius) {
+            _x[i] = center.x();
+            _y[i] = center.y();
+            _radius[i] = radius;
+        }
+
+        Vector2<T> center(size_t i) const { return Vector2<T>(_x[i], _y[i]); }
+        T radius(size_t i) const { return _radius[i]; }
+
+        T const* x() const { return _x.data(); }
+        T const* y() const { return _y.data(); }
+        T const* radii() const { return _radius.data(); }
+    };
+
+    // Structure-of-arrays set of line segments (e.g. walls), stored as start points and deltas.
+    template <typename T>
+    class SegmentSet {
+    public:
+        using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+    private:
+        storage_type _x;
+        storage_type _y;
+        storage_type _dx;
+        storage_type _dy;
+
+    public:
+        size_t size() const { return _x.size(); }
+        bool empty() const { return _x.empty(); }
+
+        void reserve(size_t count) {
+            _x.reserve(count);
+            _y.reserve(count);
+            _dx.reserve(count);
+            _dy.reserve(count);
+        }
+
+        void clear() {
+            _x.clear();
+            _y.clear();
+            _dx.clear();
+            _dy.clear();
+        }
+
+        void push_back(Segment2<T> const & segment) {
+            _x.push_back(segment.start().x());
+            _y.push_back(segment.start().y());
+            _dx.push_back(segment.delta().x());
+            _dy.push_back(segment.delta().y());
+        }
+
+        void set(size_t i, Segment2<T> const & segment) {
+            _x[i] = segment.start().x();
+            _y[i] = segment.start().y();
+            _dx[i] = segment.delta().x();
+            _dy[i] = segment.delta().y();
+        }
+
+        Segment2<T> segment(size_t i) const {
+            return Segment2<T>(Vector2<T>(_x[i], _y[i]), Vector2<T>(_x[i] + _dx[i], _y[i] + _dy[i]));
+        }
+
+        // Unit normal on the left of segment i, see Segment2::normal().
+        Vector2<T> normal(size_t i) const { return segment(i).normal(); }
+
+        T const* x() const { return _x.data(); }
+        T const* y() const { return _y.data(); }
+        T const* dx() const { return _dx.data(); }
+        T const* dy() const { return _dy.data(); }
+    };
+
+    // Structure-of-arrays packet of rays, processed a full SIMD register at a time.
+    template <typename T>
+    class Ray2Packet {
+    public:
+        using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+        // Hit index reported for rays that do not hit anything.
+        static constexpr int32_t NO_HIT = -1;
+
+    private:
+        Vector2Batch<T> _position;
+        Vector2Batch<T> _direction;
+        storage_type _length;
+        bool _unit_directions = true;
+
+        // Finds the nearest circle boundary crossing in front of each ray. When Unit is true the
+        // directions are assumed to be unit length and the quadratic is solved without normalization.
+        template <bool Unit>
+        void _intersect(T const* cx, T const* cy, T const* cr, size_t circle_count, size_t first, size_t count,
+                        int32_t* hit_index, T* hit_distance, T min_distance) const {
+            JMP_COUNT(INTERSECTION_TESTS, circle_count * count);
+            T const* px = _position.x() + first;
+            T const* py = _position.y() + first;
+            T const* dx = _direction.x() + first;
+            T const* dy = _direction.y() + first;
+
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P rpx = P::load(px + i);
+                const P rpy = P::load(py + i);
+                const P rdx = P::load(dx + i);
+                const P rdy = P::load(dy + i);
+                const P zero = P::broadcast(0);
+                const P t_min = P::broadcast(min_distance);
+                P a = P::broadcast(1);
+                P inv_a = a;
+                if constexpr (!Unit) {
+                    a = rdx * rdx + rdy * rdy;
+                    inv_a = P::broadcast(1) / select(a > zero, a, P::broadcast(1));
+                }
+
+                P best = P::broadcast(std::numeric_limits<T>::max());
+                P index = P::broadcast(static_cast<T>(NO_HIT));
+
+                for (size_t j = 0; j < circle_count; ++j) {
+                    const P ux = P::broadcast(cx[j]) - rpx;
+                    const P uy = P::broadcast(cy[j]) - rpy;
+                    const P r = P::broadcast(cr[j]);
+                    const P b = ux * rdx + uy * rdy;
+                    const P c = ux * ux + uy * uy - r * r;
+                    const P disc = Unit ? b * b - c : b * b - a * c;
+                    const auto hit = disc >= zero;
+                    if (!any(hit)) {
+                        continue;
+                    }
+                    const P sq = sqrt(max(disc, zero));
+                    P t0 = b - sq;
+                    P t1 = b + sq;
+                    if constexpr (!Unit) {
+                        t0 = t0 * inv_a;
+                        t1 = t1 * inv_a;
+                    }
+                    // Rays starting inside the circle hit its far side.
+                    const P t = select(t0 > t_min, t0, t1);
+                    const auto closer = hit & (t > t_min) & (t < best);
+                    best = select(closer, t, best);
+                    index = select(closer, P::broadcast(static_cast<T>(j)), index);
+                }
+
+                T index_lanes[P::width];
+                T best_lanes[P::width];
+                index.store(index_lanes);
+                best.store(best_lanes);
+                for (size_t k = 0; k < P::width; ++k) {
+                    const int32_t idx = static_cast<int32_t>(index_lanes[k]);
+                    hit_index[i + k] = idx;
+                    hit_distance[i + k] = idx == NO_HIT ? std::numeric_limits<T>::infinity() : best_lanes[k];
+                }
+            });
+        }
+
+        // Finds the nearest segment crossing in front of each ray. The distance does not depend
+        // on the direction being unit length, so there is a single version for both cases.
+        void _intersect_segments(SegmentSet<T> const & segments, size_t first, size_t count,
+                                 int32_t* hit_index, T* hit_distance, T min_distance) const {
+            JMP_COUNT(INTERSECTION_TESTS, segments.size() * count);
+            T const* px = _position.x() + first;
+            T const* py = _position.y() + first;
+            T const* dx = _direction.x() + first;
+            T const* dy = _direction.y() + first;
+            T const* sx = segments.x();
+            T const* sy = segments.y();
+            T const* sdx = segments.dx();
+            T const* sdy = segments.dy();
+
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P rpx = P::load(px + i);
+                const P rpy = P::load(py + i);
+                const P rdx = P::load(dx + i);
+                const P rdy = P::load(dy + i);
+                const P zero = P::broadcast(0);
+                const P one = P::broadcast(1);
+                const P t_min = P::broadcast(min_distance);
+
+                P best = P::broadcast(std::numeric_limits<T>::max());
+                P index = P::broadcast(static_cast<T>(NO_HIT));
+
+                for (size_t j = 0; j < segments.size(); ++j) {
+                    const P ex = P::broadcast(sdx[j]);
+                    const P ey = P::broadcast(sdy[j]);
+                    const P wx = P::broadcast(sx[j]) - rpx;
+                    const P wy = P::broadcast(sy[j]) - rpy;
+                    // Rays parallel to the segment divide by zero; the infinities and NaNs that
+                    // follow fail every comparison below, so they need no separate test.
+                    const P inv = one / (rdx * ey - rdy * ex);
+                    const P t = (wx * ey - wy * ex) * inv;
+                    const P u = (wx * rdy - wy * rdx) * inv;
+                    const auto closer = (t > t_min) & (t < best) & (u >= zero) & (u <= one);
+                    best = select(closer, t, best);
+                    index = select(closer, P::broadcast(static_cast<T>(j)), index);
+                }
+
+                T index_lanes[P::width];
+                T best_lanes[P::width];
+                index.store(index_lanes);
+                best.store(best_lanes);
+                for (size_t k = 0; k < P::width; ++k) {
+                    const int32_t idx = static_cast<int32_t>(index_lanes[k]);
+                    hit_index[i + k] = idx;
+                    hit_distance[i + k] = idx == NO_HIT ? std::numeric_limits<T>::infinity() : best_lanes[k];
+                }
+            });
+        }
+
+    public:
+        Ray2Packet() = default;
+        explicit Ray2Packet(size_t count) : _position(count), _direction(count), _length(count) {}
+
+        Ray2Packet(std::vector<Ray2<T>> const & rays) : Ray2Packet(rays.size()) {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                set(i, rays[i]);
+            }
+        }
+
+        size_t size() const { return _length.size(); }
+        bool empty() const { return _length.empty(); }
+
+        void resize(size_t count) {
+            _position.resize(count);
+            _direction.resize(count);
+            _length.resize(count);
+        }
+
+        void clear() {
+            resize(0);
+        }
+
+        void push_back(Ray2<T> const & ray) {
+            _position.push_back(ray.position());
+            _direction.push_back(ray.direction());
+            _length.push_back(ray.length());
+        }
+
+        void set(size_t i, Ray2<T> const & ray) {
+            _position.set(i, ray.position());
+            _direction.set(i, ray.direction());
+            _length[i] = ray.length();
+        }
+
+        Ray2<T> operator[](size_t i) const {
+            return Ray2<T>(_position[i], _direction[i], _length[i]);
+        }
+
+        Vector2Batch<T>& positions() { return _position; }
+        Vector2Batch<T>& directions() { return _direction; }
+        Vector2Batch<T> const& positions() const { return _position; }
+        Vector2Batch<T> const& directions() const { return _direction; }
+        T* lengths() { return _length.data(); }
+        T const* lengths() const { return _length.data(); }
+
+        // Whether all directions are known to be unit length. This is the default; clear it
+        // after storing directions that are not normalized, or call normalize_directions().
+        bool unit_directions() const { return _unit_directions; }
+        void set_unit_directions(bool unit) { _unit_directions = unit; }
+
+        void normalize_directions() {
+            _direction.normalize();
+            _unit_directions = true;
+        }
+
+        // Moves every ray along its direction by the matching distance. Rays with an infinite
+        // distance (no hit) are left in place.
+        void move(T const* distances) {
+            T* px = _position.x();
+            T* py = _position.y();
+            T const* dx = _direction.x();
+            T const* dy = _direction.y();
+            T* length = _length.data();
+            simd::for_each_pack<T>(size(), [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P d = P::load(distances + i);
+                const P step = select(d < P::broadcast(std::numeric_limits<T>::max()), d, P::broadcast(0));
+                (P::load(px + i) + P::load(dx + i) * step).store(px + i);
+                (P::load(py + i) + P::load(dy + i) * step).store(py + i);
+                (P::load(length + i) + step).store(length + i);
+            });
+        }
+
+        // Reflects every direction about the matching unit normal.
+        void reflect(Vector2Batch<T> const & normals) {
+            _direction.reflect(normals);
+        }
+
+        // For each ray, finds the nearest circle whose boundary the ray crosses at a distance
+        // greater than min_distance. Rays that start inside a circle report the far side of that
+        // circle. hit_index receives the circle index or NO_HIT, hit_distance the distance along
+        // the ray (infinity when nothing is hit). Both arrays must hold size() values.
+        void intersect(CircleSet<T> const & circles, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            intersect(circles, 0, size(), hit_index, hit_distance, min_distance);
+        }
+
+        // Same as above, for the rays [first, first + count). Results are written to hit_index[0..count).
+        void intersect(CircleSet<T> const & circles, size_t first, size_t count, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            if (_unit_directions) {
+                _intersect<true>(circles.x(), circles.y(), circles.radii(), circles.size(), first, count, hit_index, hit_distance, min_distance);
+            }
+            else {
+                _intersect<false>(circles.x(), circles.y(), circles.radii(), circles.size(), first, count, hit_index, hit_distance, min_distance);
+            }
+        }
+
+        // For each ray, finds the nearest segment it crosses at a distance greater than
+        // min_distance, testing the whole packet against every segment in one pass. This is the
+        // boundary test for rooms made of walls, convex or not. Results are reported as for circles;
+        // distances are in multiples of the direction's length.
+        void intersect(SegmentSet<T> const & segments, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            intersect(segments, 0, size(), hit_index, hit_distance, min_distance);
+        }
+
+        // Same as above, for the rays [first, first + count). Results are written to hit_index[0..count).
+        void intersect(SegmentSet<T> const & segments, size_t first, size_t count, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            _intersect_segments(segments, first, count, hit_index, hit_distance, min_distance);
+        }
+    };
+}
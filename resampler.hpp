@@ -0,0 +1,291 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#include "audio.hpp"
+#include "memory.hpp"
+#include "simd.hpp"
+#include "wavefile.hpp"
+
+namespace JMP
+{
+	namespace Audio {
+
+		// Windowed-sinc low-pass filter for a rational ratio output / input = L / M, split into
+		// its L polyphase branches. Each branch holds the taps that meet the input for one
+		// output phase, reversed so that an output sample is a plain dot product with the
+		// input, and zero-padded to a multiple of the widest SIMD register.
+		template <typename T>
+		class ResamplerTable {
+		public:
+			// Largest upsampling factor L accepted, which bounds the table to a few hundred kB.
+			static constexpr uint32_t MAX_PHASES = 4096;
+
+			uint32_t up = 1;
+			uint32_t down = 1;
+			// Taps per phase, padded.
+			size_t taps = 0;
+			// Delay of the filter at the upsampled rate.
+			size_t delay = 0;
+			std::vector<T, AlignedAllocator<T>> coefficients;
+
+			T const* phase(size_t p) const noexcept { return coefficients.data() + p * taps; }
+
+		private:
+			static double _bessel_i0(double x)
+			{
+				double sum = 1, term = 1;
+				for (int k = 1; k < 50 && term > 1e-12 * sum; ++k) {
+					term *= (x / (2 * k)) * (x / (2 * k));
+					sum += term;
+				}
+				return sum;
+			}
+
+		public:
+			// zero_crossings is the half length of the filter in zero crossings of the sinc,
+			// bandwidth the passband edge as a fraction of the lower Nyquist frequency, and
+			// beta the shape of the Kaiser window (8.6 gives about 90 dB of attenuation).
+			ResamplerTable(uint32_t up_factor, uint32_t down_factor, uint32_t zero_crossings, double bandwidth, double beta)
+				: up(up_factor), down(down_factor)
+			{
+				const double pi = 3.14159265358979323846;
+				// Cutoff in cycles per sample at the upsampled rate.
+				const double cutoff = 0.5 * bandwidth / std::max(up, down);
+				const size_t half = static_cast<size_t>(std::ceil(zero_crossings / (2 * cutoff)));
+				const size_t length = 2 * half + 1;
+				delay = half;
+				taps = ((length + up - 1) / up + 15) & ~size_t(15);
+				coefficients.assign(up * taps, T(0));
+				for (size_t m = 0; m < length; ++m) {
+					const double x = static_cast<double>(m) - static_cast<double>(half);
+					const double sinc = x == 0 ? 1 : std::sin(2 * pi * cutoff * x) / (2 * pi * cutoff * x);
+					const double r = x / static_cast<double>(half);
+					const double window = _bessel_i0(beta * std::sqrt(std::max(0.0, 1 - r * r))) / _bessel_i0(beta);
+					// Gain up keeps the level of the zero-stuffed signal.
+					const double h = up * 2 * cutoff * sinc * window;
+					// Tap m meets input k = m / up back from the newest for phase m % up.
+					const size_t p = m % up;
+					const size_t k = m / up;
+					coefficients[p * taps + (taps - 1 - k)] = static_cast<T>(h);
+				}
+			}
+		};
+
+		// Streaming sample-rate conversion by a rational ratio with a polyphase windowed-sinc
+		// filter, e.g. from an impulse response rendered at 96 kHz to a file at 44.1 kHz.
+		// Every output sample costs one SIMD dot product over taps() input samples, whatever
+		// the ratio. The filter tables are cached per ratio and quality and shared between
+		// resamplers, so a resampler per channel costs a table only once.
+		//
+		// process() takes any number of input samples and writes the output they complete;
+		// the output lags by latency() samples, unless compensate_latency is set, in which
+		// case the first output waits for half a filter of input but lines up with the
+		// first input sample. flush() then writes the tail as if the input were followed
+		// by silence.
+		// Usage:
+		//
+		// Audio::Resampler<float> resampler(96000, 48000, true);
+		// std::vector<float> out(resampler.max_output(block.size()));
+		// out.resize(resampler.process(block.data(), block.size(), out.data()));
+		//
+		template <typename T = sample_t>
+		class Resampler {
+			using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+			// Input samples buffered per step of process().
+			static constexpr size_t CHUNK = 4096;
+
+			std::shared_ptr<ResamplerTable<T> const> _table;
+			storage_type _buffer;
+			storage_type _zeros;
+			size_t _fill = 0;
+			// Start in the buffer of the input window of the next output, and its phase.
+			size_t _index = 0;
+			size_t _phase = 0;
+			bool _compensate = false;
+
+			T _dot(T const* a, T const* b) const noexcept
+			{
+				using P = simd::Pack<T>;
+				P sum = P::broadcast(T(0));
+				for (size_t i = 0; i < _table->taps; i += P::width) {
+					sum = fmadd(P::load(a + i), P::load(b + i), sum);
+				}
+				alignas(64) T lanes[P::width];
+				sum.store(lanes);
+				T total = 0;
+				for (size_t i = 0; i < P::width; ++i) {
+					total += lanes[i];
+				}
+				return total;
+			}
+
+		public:
+			static constexpr uint32_t DEFAULT_ZERO_CROSSINGS = 16;
+
+			// The shared filter table for a conversion, built on first use. Thread-safe.
+			static std::shared_ptr<ResamplerTable<T> const> table(uint32_t input_rate, uint32_t output_rate,
+				uint32_t zero_crossings = DEFAULT_ZERO_CROSSINGS, double bandwidth = 0.9, double beta = 8.6)
+			{
+				if (input_rate == 0 || output_rate == 0) {
+					throw std::invalid_argument("Resampler rates must not be zero");
+				}
+				const uint32_t divisor = std::gcd(input_rate, output_rate);
+				const uint32_t up = output_rate / divisor;
+				const uint32_t down = input_rate / divisor;
+				if (up > ResamplerTable<T>::MAX_PHASES) {
+					throw std::invalid_argument("Resampler ratio needs too many phases");
+				}
+				using Key = std::tuple<uint32_t, uint32_t, uint32_t, double, double>;
+				static std::mutex mutex;
+				static std::map<Key, std::shared_ptr<ResamplerTable<T> const>> cache;
+				std::lock_guard<std::mutex> lock(mutex);
+				auto& entry = cache[Key(up, down, zero_crossings, bandwidth, beta)];
+				if (!entry) {
+					entry = std::make_shared<ResamplerTable<T> const>(up, down, zero_crossings, bandwidth, beta);
+				}
+				return entry;
+			}
+
+			Resampler(uint32_t input_rate, uint32_t output_rate, bool compensate_latency = false,
+				uint32_t zero_crossings = DEFAULT_ZERO_CROSSINGS)
+				: _table(table(input_rate, output_rate, zero_crossings)), _compensate(compensate_latency)
+			{
+				_buffer.resize(_table->taps - 1 + CHUNK);
+				_zeros.resize(_table->taps - 1);
+				reset();
+			}
+
+			uint32_t up() const noexcept { return _table->up; }
+			uint32_t down() const noexcept { return _table->down; }
+			size_t taps() const noexcept { return _table->taps; }
+
+			// Delay of the output in output samples, see compensate_latency. May be fractional.
+			double latency() const noexcept
+			{
+				return _compensate ? 0 : static_cast<double>(_table->delay) / _table->down;
+			}
+
+			// Forgets the input so far.
+			void reset()
+			{
+				// The window of the first output covers taps() - 1 samples of silence before the input.
+				std::fill(_buffer.begin(), _buffer.end(), T(0));
+				_fill = _table->taps - 1;
+				const size_t start = _compensate ? _table->delay : 0;
+				_index = start / _table->up;
+				_phase = start % _table->up;
+			}
+
+			// Upper bound on the number of samples process() writes for count input samples.
+			size_t max_output(size_t count) const noexcept
+			{
+				return static_cast<size_t>((static_cast<uint64_t>(_fill + count) * _table->up) / _table->down) + 1;
+			}
+
+			// Resamples count input samples into output, which must have room for
+			// max_output(count) samples. Returns the number of samples written.
+			size_t process(T const* input, size_t count, T* output)
+			{
+				ResamplerTable<T> const& table = *_table;
+				size_t written = 0;
+				while (count > 0) {
+					const size_t n = std::min(count, _buffer.size() - _fill);
+					std::copy_n(input, n, _buffer.data() + _fill);
+					_fill += n;
+					input += n;
+					count -= n;
+					while (_index + table.taps <= _fill) {
+						output[written++] = _dot(table.phase(_phase), _buffer.data() + _index);
+						_phase += table.down;
+						_index += _phase / table.up;
+						_phase %= table.up;
+					}
+					// Keep the input from the next window on.
+					const size_t shift = std::min(_index, _fill);
+					std::copy(_buffer.begin() + shift, _buffer.begin() + _fill, _buffer.begin());
+					_fill -= shift;
+					_index -= shift;
+				}
+				return written;
+			}
+
+			// Writes the output still depending on the input so far, as if followed by silence,
+			// into output with room for max_output(taps()) samples. Returns the number written.
+			size_t flush(T* output)
+			{
+				return process(_zeros.data(), _zeros.size(), output);
+			}
+		};
+
+		namespace detail {
+			// Resamples a signal with the latency compensated, in blocks of block_size input
+			// samples, calling emit(samples, count) for ceil(count * output_rate / input_rate)
+			// samples in all. Stops early if emit returns false.
+			template <typename T, class Emit>
+			bool resample_blocks(T const* input, size_t count, uint32_t input_rate, uint32_t output_rate, size_t block_size, Emit&& emit)
+			{
+				block_size = std::max<size_t>(1, block_size);
+				Resampler<T> resampler(input_rate, output_rate, true);
+				uint64_t remaining = (static_cast<uint64_t>(count) * resampler.up() + resampler.down() - 1) / resampler.down();
+				std::vector<T> output(resampler.max_output(std::max(block_size, resampler.taps())));
+				for (size_t first = 0; remaining > 0; first += block_size) {
+					const size_t n = first < count ? std::min(block_size, count - first) : 0;
+					const size_t produced = n > 0 ? resampler.process(input + first, n, output.data()) : resampler.flush(output.data());
+					const size_t kept = static_cast<size_t>(std::min<uint64_t>(produced, remaining));
+					if (kept > 0 && !emit(output.data(), kept)) {
+						return false;
+					}
+					remaining -= kept;
+				}
+				return true;
+			}
+		}
+
+		// Resamples a whole signal with the latency compensated, giving
+		// ceil(count * output_rate / input_rate) samples.
+		template <typename T>
+		std::vector<T> resample(T const* input, size_t count, uint32_t input_rate, uint32_t output_rate)
+		{
+			std::vector<T> result;
+			detail::resample_blocks(input, count, input_rate, output_rate, 4096, [&](T const* samples, size_t n) {
+				result.insert(result.end(), samples, samples + n);
+				return true;
+			});
+			return result;
+		}
+
+		// Streams a mono signal resampled to output_rate, the rate of the writer, into a float
+		// writer, scaled by gain, one block at a time. The latency is compensated.
+		template <class Sink, typename T>
+		bool resample(WaveFile::BasicWriter<Sink>& writer, T const* input, size_t count, uint32_t input_rate,
+			uint32_t output_rate, T gain = 1, size_t block_size = 4096)
+		{
+			std::vector<float> block;
+			return detail::resample_blocks(input, count, input_rate, output_rate, block_size, [&](T const* samples, size_t n) {
+				block.resize(n);
+				for (size_t i = 0; i < n; ++i) {
+					block[i] = static_cast<float>(samples[i] * gain);
+				}
+				return writer.write(block.data(), n);
+			});
+		}
+	}
+}
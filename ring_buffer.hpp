@@ -0,0 +1,194 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "audio.hpp"
+#include "memory.hpp"
+#include "wavefile.hpp"
+
+namespace JMP
+{
+	namespace Audio {
+
+		// Lock-free ring buffer of samples between one producer thread and one consumer
+		// thread, e.g. to move audio from a real-time callback to a WaveFile writer on another
+		// thread. Neither side ever blocks or allocates: write() copies as many samples as fit
+		// and read() as many as are there. The capacity is rounded up to a power of two.
+		//
+		// The read and write positions only grow, each on its own cache line together with the
+		// last position seen of the other side, so a side only touches the other's line when
+		// its cached view says the buffer is full (or empty).
+		//
+		// write_region() and read_region() expose the free or filled part in place, as at most
+		// two contiguous spans (the second one after wrapping around), for zero-copy use
+		// followed by commit_write() or commit_read(). The producer only calls the write
+		// functions and the consumer only the read ones.
+		// Usage:
+		//
+		// Audio::RingBuffer<float> ring(1 << 16);
+		// // Audio callback:
+		// if (ring.write(block, frames * channels) < frames * channels) { ++overruns; }
+		// // Disk thread:
+		// WaveFile::AsyncWriter writer("capture.wav", channels, 48000, WaveFile::AudioFormat::FLOAT, 32);
+		// while (recording) { ring.drain(writer); sleep(); }
+		// ring.drain(writer);
+		//
+		template <typename T = sample_t>
+		class RingBuffer {
+		public:
+			template <typename U>
+			struct Span {
+				U* data;
+				size_t size;
+			};
+
+			// The samples of a region are first, then second.
+			template <typename U>
+			struct Region {
+				Span<U> first;
+				Span<U> second;
+
+				size_t size() const noexcept { return first.size + second.size; }
+			};
+
+		private:
+			struct alignas(CACHE_LINE_SIZE) Side {
+				std::atomic<uint64_t> position{ 0 };
+				// Position of the other side when last loaded, only used by this side.
+				uint64_t other = 0;
+			};
+
+			std::vector<T, AlignedAllocator<T>> _buffer;
+			size_t _mask = 0;
+			Side _write;
+			Side _read;
+
+			template <typename U>
+			Region<U> _region(U* data, uint64_t position, size_t count) const noexcept
+			{
+				const size_t start = static_cast<size_t>(position) & _mask;
+				const size_t first = std::min(count, _buffer.size() - start);
+				return Region<U>{ Span<U>{ data + start, first }, Span<U>{ data, count - first } };
+			}
+
+		public:
+			explicit RingBuffer(size_t capacity)
+			{
+				size_t size = 1;
+				while (size < capacity) {
+					size *= 2;
+				}
+				_buffer.resize(size);
+				_mask = size - 1;
+			}
+
+			RingBuffer(RingBuffer const&) = delete;
+			RingBuffer& operator=(RingBuffer const&) = delete;
+
+			size_t capacity() const noexcept { return _buffer.size(); }
+
+			// Producer side.
+
+			// Number of samples that can be written now; the consumer may free more meanwhile.
+			size_t write_available() noexcept
+			{
+				const uint64_t position = _write.position.load(std::memory_order_relaxed);
+				_write.other = _read.position.load(std::memory_order_acquire);
+				return _buffer.size() - static_cast<size_t>(position - _write.other);
+			}
+
+			// Free space to fill in place, at most count samples. Publish it with commit_write().
+			Region<T> write_region(size_t count = std::numeric_limits<size_t>::max()) noexcept
+			{
+				const uint64_t position = _write.position.load(std::memory_order_relaxed);
+				if (count > _buffer.size() - static_cast<size_t>(position - _write.other)) {
+					_write.other = _read.position.load(std::memory_order_acquire);
+				}
+				count = std::min(count, _buffer.size() - static_cast<size_t>(position - _write.other));
+				return _region(_buffer.data(), position, count);
+			}
+
+			// Makes the first count samples of the last write_region() visible to the consumer.
+			void commit_write(size_t count) noexcept
+			{
+				_write.position.store(_write.position.load(std::memory_order_relaxed) + count, std::memory_order_release);
+			}
+
+			// Copies as many of the samples as fit, returns how many.
+			size_t write(T const* samples, size_t count) noexcept
+			{
+				const Region<T> region = write_region(count);
+				std::copy_n(samples, region.first.size, region.first.data);
+				std::copy_n(samples + region.first.size, region.second.size, region.second.data);
+				commit_write(region.size());
+				return region.size();
+			}
+
+			// Consumer side.
+
+			// Number of samples that can be read now; the producer may add more meanwhile.
+			size_t read_available() noexcept
+			{
+				const uint64_t position = _read.position.load(std::memory_order_relaxed);
+				_read.other = _write.position.load(std::memory_order_acquire);
+				return static_cast<size_t>(_read.other - position);
+			}
+
+			// Filled samples to use in place, at most count. Free them with commit_read().
+			Region<T const> read_region(size_t count = std::numeric_limits<size_t>::max()) noexcept
+			{
+				const uint64_t position = _read.position.load(std::memory_order_relaxed);
+				if (static_cast<size_t>(_read.other - position) < count) {
+					_read.other = _write.position.load(std::memory_order_acquire);
+				}
+				count = std::min(count, static_cast<size_t>(_read.other - position));
+				return _region(static_cast<T const*>(_buffer.data()), position, count);
+			}
+
+			// Frees the first count samples of the last read_region() for the producer.
+			void commit_read(size_t count) noexcept
+			{
+				_read.position.store(_read.position.load(std::memory_order_relaxed) + count, std::memory_order_release);
+			}
+
+			// Copies at most count samples out, returns how many.
+			size_t read(T* samples, size_t count) noexcept
+			{
+				const Region<T const> region = read_region(count);
+				std::copy_n(region.first.data, region.first.size, samples);
+				std::copy_n(region.second.data, region.second.size, samples + region.first.size);
+				commit_read(region.size());
+				return region.size();
+			}
+
+			// Writes all the samples available now to a writer straight from the buffer, whose
+			// format must match T. Returns false if the writer failed, in which case the samples
+			// are still consumed so that the producer is not stalled.
+			template <class Sink>
+			bool drain(WaveFile::BasicWriter<Sink>& writer) noexcept
+			{
+				const Region<T const> region = read_region();
+				bool ok = true;
+				if (region.first.size > 0) {
+					ok = writer.write(region.first.data, region.first.size);
+				}
+				if (ok && region.second.size > 0) {
+					ok = writer.write(region.second.data, region.second.size);
+				}
+				commit_read(region.size());
+				return ok;
+			}
+		};
+	}
+}
@@ -0,0 +1,487 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+// Detects the SIMD instruction sets enabled for the current target and includes
+// the matching intrinsics headers. Each JMP_SIMD_* macro is defined to 1 when the
+// corresponding code path can be used. Define JMP_NO_SIMD to force the scalar paths.
+
+#ifndef JMP_NO_SIMD
+
+#if defined(__AVX512F__)
+#define JMP_SIMD_AVX512 1
+#endif
+
+#if defined(__AVX2__)
+#define JMP_SIMD_AVX2 1
+#endif
+
+#if defined(__FMA__) || (defined(JMP_SIMD_AVX2) && defined(_MSC_VER))
+#define JMP_SIMD_FMA 1
+#endif
+
+#if defined(__F16C__) || (defined(JMP_SIMD_AVX2) && defined(_MSC_VER))
+#define JMP_SIMD_F16C 1
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define JMP_SIMD_SSSE3 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JMP_SIMD_SSE2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define JMP_SIMD_NEON 1
+#endif
+
+// The floating point packs below need the AArch64 additions to NEON (division, square root, float64).
+#if defined(JMP_SIMD_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define JMP_SIMD_NEON64 1
+#endif
+
+#if defined(JMP_SIMD_SSE2)
+#include <immintrin.h>
+#endif
+
+#if defined(JMP_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace JMP
+{
+	// Thin wrappers over floating point SIMD registers, used to write a kernel once
+	// and instantiate it for every instruction set. Pack<T> is the widest register
+	// available for T on the current target and Scalar<T> processes one value at a
+	// time, which is what loops use for their remainder. All packs share the same
+	// interface: load(), broadcast(), store(), arithmetic operators, sqrt(), min(),
+	// max(), abs(), floor(), fmadd(), comparisons returning a mask, select(), any() and all().
+	namespace simd
+	{
+		template <typename T>
+		struct ScalarMask {
+			bool m;
+			ScalarMask operator&(ScalarMask o) const { return { m && o.m }; }
+			ScalarMask operator|(ScalarMask o) const { return { m || o.m }; }
+			ScalarMask operator~() const { return { !m }; }
+		};
+
+		template <typename T>
+		struct Scalar {
+			using value_type = T;
+			using mask_type = ScalarMask<T>;
+			static constexpr size_t width = 1;
+			T v;
+
+			static Scalar load(T const* p) { return { *p }; }
+			static Scalar broadcast(T x) { return { x }; }
+			void store(T* p) const { *p = v; }
+			T lane(size_t) const { return v; }
+
+			Scalar operator+(Scalar o) const { return { v + o.v }; }
+			Scalar operator-(Scalar o) const { return { v - o.v }; }
+			Scalar operator*(Scalar o) const { return { v * o.v }; }
+			Scalar operator/(Scalar o) const { return { v / o.v }; }
+			Scalar operator-() const { return { -v }; }
+			mask_type operator<(Scalar o) const { return { v < o.v }; }
+			mask_type operator<=(Scalar o) const { return { v <= o.v }; }
+			mask_type operator>(Scalar o) const { return { v > o.v }; }
+			mask_type operator>=(Scalar o) const { return { v >= o.v }; }
+		};
+
+		template <typename T> inline Scalar<T> sqrt(Scalar<T> a) { return { std::sqrt(a.v) }; }
+		template <typename T> inline Scalar<T> min(Scalar<T> a, Scalar<T> b) { return { b.v < a.v ? b.v : a.v }; }
+		template <typename T> inline Scalar<T> max(Scalar<T> a, Scalar<T> b) { return { a.v < b.v ? b.v : a.v }; }
+		template <typename T> inline Scalar<T> abs(Scalar<T> a) { return { std::abs(a.v) }; }
+		template <typename T> inline Scalar<T> floor(Scalar<T> a) { return { std::floor(a.v) }; }
+		template <typename T> inline Scalar<T> fmadd(Scalar<T> a, Scalar<T> b, Scalar<T> c) { return { a.v * b.v + c.v }; }
+		template <typename T> inline Scalar<T> select(ScalarMask<T> m, Scalar<T> a, Scalar<T> b) { return m.m ? a : b; }
+		template <typename T> inline bool any(ScalarMask<T> m) { return m.m; }
+		template <typename T> inline bool all(ScalarMask<T> m) { return m.m; }
+
+#if defined(JMP_SIMD_AVX512)
+		struct MaskF32x16 {
+			__mmask16 m;
+			MaskF32x16 operator&(MaskF32x16 o) const { return { static_cast<__mmask16>(m & o.m) }; }
+			MaskF32x16 operator|(MaskF32x16 o) const { return { static_cast<__mmask16>(m | o.m) }; }
+			MaskF32x16 operator~() const { return { static_cast<__mmask16>(~m) }; }
+		};
+
+		struct F32x16 {
+			using value_type = float;
+			using mask_type = MaskF32x16;
+			static constexpr size_t width = 16;
+			__m512 v;
+
+			static F32x16 load(float const* p) { return { _mm512_loadu_ps(p) }; }
+			static F32x16 broadcast(float x) { return { _mm512_set1_ps(x) }; }
+			void store(float* p) const { _mm512_storeu_ps(p, v); }
+			float lane(size_t i) const { alignas(64) float t[16]; _mm512_store_ps(t, v); return t[i]; }
+
+			F32x16 operator+(F32x16 o) const { return { _mm512_add_ps(v, o.v) }; }
+			F32x16 operator-(F32x16 o) const { return { _mm512_sub_ps(v, o.v) }; }
+			F32x16 operator*(F32x16 o) const { return { _mm512_mul_ps(v, o.v) }; }
+			F32x16 operator/(F32x16 o) const { return { _mm512_div_ps(v, o.v) }; }
+			F32x16 operator-() const { return { _mm512_sub_ps(_mm512_setzero_ps(), v) }; }
+			mask_type operator<(F32x16 o) const { return { _mm512_cmp_ps_mask(v, o.v, _CMP_LT_OQ) }; }
+			mask_type operator<=(F32x16 o) const { return { _mm512_cmp_ps_mask(v, o.v, _CMP_LE_OQ) }; }
+			mask_type operator>(F32x16 o) const { return { _mm512_cmp_ps_mask(v, o.v, _CMP_GT_OQ) }; }
+			mask_type operator>=(F32x16 o) const { return { _mm512_cmp_ps_mask(v, o.v, _CMP_GE_OQ) }; }
+		};
+
+		inline F32x16 sqrt(F32x16 a) { return { _mm512_sqrt_ps(a.v) }; }
+		inline F32x16 min(F32x16 a, F32x16 b) { return { _mm512_min_ps(a.v, b.v) }; }
+		inline F32x16 max(F32x16 a, F32x16 b) { return { _mm512_max_ps(a.v, b.v) }; }
+		inline F32x16 abs(F32x16 a) { return { _mm512_abs_ps(a.v) }; }
+		inline F32x16 floor(F32x16 a) { return { _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+		inline F32x16 fmadd(F32x16 a, F32x16 b, F32x16 c) { return { _mm512_fmadd_ps(a.v, b.v, c.v) }; }
+		inline F32x16 select(MaskF32x16 m, F32x16 a, F32x16 b) { return { _mm512_mask_blend_ps(m.m, b.v, a.v) }; }
+		inline bool any(MaskF32x16 m) { return m.m != 0; }
+		inline bool all(MaskF32x16 m) { return m.m == 0xFFFF; }
+
+		struct MaskF64x8 {
+			__mmask8 m;
+			MaskF64x8 operator&(MaskF64x8 o) const { return { static_cast<__mmask8>(m & o.m) }; }
+			MaskF64x8 operator|(MaskF64x8 o) const { return { static_cast<__mmask8>(m | o.m) }; }
+			MaskF64x8 operator~() const { return { static_cast<__mmask8>(~m) }; }
+		};
+
+		struct F64x8 {
+			using value_type = double;
+			using mask_type = MaskF64x8;
+			static constexpr size_t width = 8;
+			__m512d v;
+
+			static F64x8 load(double const* p) { return { _mm512_loadu_pd(p) }; }
+			static F64x8 broadcast(double x) { return { _mm512_set1_pd(x) }; }
+			void store(double* p) const { _mm512_storeu_pd(p, v); }
+			double lane(size_t i) const { alignas(64) double t[8]; _mm512_store_pd(t, v); return t[i]; }
+
+			F64x8 operator+(F64x8 o) const { return { _mm512_add_pd(v, o.v) }; }
+			F64x8 operator-(F64x8 o) const { return { _mm512_sub_pd(v, o.v) }; }
+			F64x8 operator*(F64x8 o) const { return { _mm512_mul_pd(v, o.v) }; }
+			F64x8 operator/(F64x8 o) const { return { _mm512_div_pd(v, o.v) }; }
+			F64x8 operator-() const { return { _mm512_sub_pd(_mm512_setzero_pd(), v) }; }
+			mask_type operator<(F64x8 o) const { return { _mm512_cmp_pd_mask(v, o.v, _CMP_LT_OQ) }; }
+			mask_type operator<=(F64x8 o) const { return { _mm512_cmp_pd_mask(v, o.v, _CMP_LE_OQ) }; }
+			mask_type operator>(F64x8 o) const { return { _mm512_cmp_pd_mask(v, o.v, _CMP_GT_OQ) }; }
+			mask_type operator>=(F64x8 o) const { return { _mm512_cmp_pd_mask(v, o.v, _CMP_GE_OQ) }; }
+		};
+
+		inline F64x8 sqrt(F64x8 a) { return { _mm512_sqrt_pd(a.v) }; }
+		inline F64x8 min(F64x8 a, F64x8 b) { return { _mm512_min_pd(a.v, b.v) }; }
+		inline F64x8 max(F64x8 a, F64x8 b) { return { _mm512_max_pd(a.v, b.v) }; }
+		inline F64x8 abs(F64x8 a) { return { _mm512_abs_pd(a.v) }; }
+		inline F64x8 floor(F64x8 a) { return { _mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+		inline F64x8 fmadd(F64x8 a, F64x8 b, F64x8 c) { return { _mm512_fmadd_pd(a.v, b.v, c.v) }; }
+		inline F64x8 select(MaskF64x8 m, F64x8 a, F64x8 b) { return { _mm512_mask_blend_pd(m.m, b.v, a.v) }; }
+		inline bool any(MaskF64x8 m) { return m.m != 0; }
+		inline bool all(MaskF64x8 m) { return m.m == 0xFF; }
+
+		template <typename T> struct native_pack { using type = Scalar<T>; };
+		template <> struct native_pack<float> { using type = F32x16; };
+		template <> struct native_pack<double> { using type = F64x8; };
+
+#elif defined(JMP_SIMD_AVX2)
+		struct MaskF32x8 {
+			__m256 m;
+			MaskF32x8 operator&(MaskF32x8 o) const { return { _mm256_and_ps(m, o.m) }; }
+			MaskF32x8 operator|(MaskF32x8 o) const { return { _mm256_or_ps(m, o.m) }; }
+			MaskF32x8 operator~() const { return { _mm256_xor_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+		};
+
+		struct F32x8 {
+			using value_type = float;
+			using mask_type = MaskF32x8;
+			static constexpr size_t width = 8;
+			__m256 v;
+
+			static F32x8 load(float const* p) { return { _mm256_loadu_ps(p) }; }
+			static F32x8 broadcast(float x) { return { _mm256_set1_ps(x) }; }
+			void store(float* p) const { _mm256_storeu_ps(p, v); }
+			float lane(size_t i) const { alignas(32) float t[8]; _mm256_store_ps(t, v); return t[i]; }
+
+			F32x8 operator+(F32x8 o) const { return { _mm256_add_ps(v, o.v) }; }
+			F32x8 operator-(F32x8 o) const { return { _mm256_sub_ps(v, o.v) }; }
+			F32x8 operator*(F32x8 o) const { return { _mm256_mul_ps(v, o.v) }; }
+			F32x8 operator/(F32x8 o) const { return { _mm256_div_ps(v, o.v) }; }
+			F32x8 operator-() const { return { _mm256_sub_ps(_mm256_setzero_ps(), v) }; }
+			mask_type operator<(F32x8 o) const { return { _mm256_cmp_ps(v, o.v, _CMP_LT_OQ) }; }
+			mask_type operator<=(F32x8 o) const { return { _mm256_cmp_ps(v, o.v, _CMP_LE_OQ) }; }
+			mask_type operator>(F32x8 o) const { return { _mm256_cmp_ps(v, o.v, _CMP_GT_OQ) }; }
+			mask_type operator>=(F32x8 o) const { return { _mm256_cmp_ps(v, o.v, _CMP_GE_OQ) }; }
+		};
+
+		inline F32x8 sqrt(F32x8 a) { return { _mm256_sqrt_ps(a.v) }; }
+		inline F32x8 min(F32x8 a, F32x8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+		inline F32x8 max(F32x8 a, F32x8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+		inline F32x8 abs(F32x8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+		inline F32x8 floor(F32x8 a) { return { _mm256_floor_ps(a.v) }; }
+#if defined(JMP_SIMD_FMA)
+		inline F32x8 fmadd(F32x8 a, F32x8 b, F32x8 c) { return { _mm256_fmadd_ps(a.v, b.v, c.v) }; }
+#else
+		inline F32x8 fmadd(F32x8 a, F32x8 b, F32x8 c) { return a * b + c; }
+#endif
+		inline F32x8 select(MaskF32x8 m, F32x8 a, F32x8 b) { return { _mm256_blendv_ps(b.v, a.v, m.m) }; }
+		inline bool any(MaskF32x8 m) { return _mm256_movemask_ps(m.m) != 0; }
+		inline bool all(MaskF32x8 m) { return _mm256_movemask_ps(m.m) == 0xFF; }
+
+		struct MaskF64x4 {
+			__m256d m;
+			MaskF64x4 operator&(MaskF64x4 o) const { return { _mm256_and_pd(m, o.m) }; }
+			MaskF64x4 operator|(MaskF64x4 o) const { return { _mm256_or_pd(m, o.m) }; }
+			MaskF64x4 operator~() const { return { _mm256_xor_pd(m, _mm256_castsi256_pd(_mm256_set1_epi32(-1))) }; }
+		};
+
+		struct F64x4 {
+			using value_type = double;
+			using mask_type = MaskF64x4;
+			static constexpr size_t width = 4;
+			__m256d v;
+
+			static F64x4 load(double const* p) { return { _mm256_loadu_pd(p) }; }
+			static F64x4 broadcast(double x) { return { _mm256_set1_pd(x) }; }
+			void store(double* p) const { _mm256_storeu_pd(p, v); }
+			double lane(size_t i) const { alignas(32) double t[4]; _mm256_store_pd(t, v); return t[i]; }
+
+			F64x4 operator+(F64x4 o) const { return { _mm256_add_pd(v, o.v) }; }
+			F64x4 operator-(F64x4 o) const { return { _mm256_sub_pd(v, o.v) }; }
+			F64x4 operator*(F64x4 o) const { return { _mm256_mul_pd(v, o.v) }; }
+			F64x4 operator/(F64x4 o) const { return { _mm256_div_pd(v, o.v) }; }
+			F64x4 operator-() const { return { _mm256_sub_pd(_mm256_setzero_pd(), v) }; }
+			mask_type operator<(F64x4 o) const { return { _mm256_cmp_pd(v, o.v, _CMP_LT_OQ) }; }
+			mask_type operator<=(F64x4 o) const { return { _mm256_cmp_pd(v, o.v, _CMP_LE_OQ) }; }
+			mask_type operator>(F64x4 o) const { return { _mm256_cmp_pd(v, o.v, _CMP_GT_OQ) }; }
+			mask_type operator>=(F64x4 o) const { return { _mm256_cmp_pd(v, o.v, _CMP_GE_OQ) }; }
+		};
+
+		inline F64x4 sqrt(F64x4 a) { return { _mm256_sqrt_pd(a.v) }; }
+		inline F64x4 min(F64x4 a, F64x4 b) { return { _mm256_min_pd(a.v, b.v) }; }
+		inline F64x4 max(F64x4 a, F64x4 b) { return { _mm256_max_pd(a.v, b.v) }; }
+		inline F64x4 abs(F64x4 a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+		inline F64x4 floor(F64x4 a) { return { _mm256_floor_pd(a.v) }; }
+#if defined(JMP_SIMD_FMA)
+		inline F64x4 fmadd(F64x4 a, F64x4 b, F64x4 c) { return { _mm256_fmadd_pd(a.v, b.v, c.v) }; }
+#else
+		inline F64x4 fmadd(F64x4 a, F64x4 b, F64x4 c) { return a * b + c; }
+#endif
+		inline F64x4 select(MaskF64x4 m, F64x4 a, F64x4 b) { return { _mm256_blendv_pd(b.v, a.v, m.m) }; }
+		inline bool any(MaskF64x4 m) { return _mm256_movemask_pd(m.m) != 0; }
+		inline bool all(MaskF64x4 m) { return _mm256_movemask_pd(m.m) == 0xF; }
+
+		template <typename T> struct native_pack { using type = Scalar<T>; };
+		template <> struct native_pack<float> { using type = F32x8; };
+		template <> struct native_pack<double> { using type = F64x4; };
+
+#elif defined(JMP_SIMD_SSE2)
+		struct MaskF32x4 {
+			__m128 m;
+			MaskF32x4 operator&(MaskF32x4 o) const { return { _mm_and_ps(m, o.m) }; }
+			MaskF32x4 operator|(MaskF32x4 o) const { return { _mm_or_ps(m, o.m) }; }
+			MaskF32x4 operator~() const { return { _mm_xor_ps(m, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+		};
+
+		struct F32x4 {
+			using value_type = float;
+			using mask_type = MaskF32x4;
+			static constexpr size_t width = 4;
+			__m128 v;
+
+			static F32x4 load(float const* p) { return { _mm_loadu_ps(p) }; }
+			static F32x4 broadcast(float x) { return { _mm_set1_ps(x) }; }
+			void store(float* p) const { _mm_storeu_ps(p, v); }
+			float lane(size_t i) const { alignas(16) float t[4]; _mm_store_ps(t, v); return t[i]; }
+
+			F32x4 operator+(F32x4 o) const { return { _mm_add_ps(v, o.v) }; }
+			F32x4 operator-(F32x4 o) const { return { _mm_sub_ps(v, o.v) }; }
+			F32x4 operator*(F32x4 o) const { return { _mm_mul_ps(v, o.v) }; }
+			F32x4 operator/(F32x4 o) const { return { _mm_div_ps(v, o.v) }; }
+			F32x4 operator-() const { return { _mm_sub_ps(_mm_setzero_ps(), v) }; }
+			mask_type operator<(F32x4 o) const { return { _mm_cmplt_ps(v, o.v) }; }
+			mask_type operator<=(F32x4 o) const { return { _mm_cmple_ps(v, o.v) }; }
+			mask_type operator>(F32x4 o) const { return { _mm_cmpgt_ps(v, o.v) }; }
+			mask_type operator>=(F32x4 o) const { return { _mm_cmpge_ps(v, o.v) }; }
+		};
+
+		inline F32x4 sqrt(F32x4 a) { return { _mm_sqrt_ps(a.v) }; }
+		inline F32x4 min(F32x4 a, F32x4 b) { return { _mm_min_ps(a.v, b.v) }; }
+		inline F32x4 max(F32x4 a, F32x4 b) { return { _mm_max_ps(a.v, b.v) }; }
+		inline F32x4 abs(F32x4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+		// SSE2 has no rounding instructions: truncate and correct negative values. Only valid for |a| < 2^31.
+		inline F32x4 floor(F32x4 a) {
+			const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+			return { _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f))) };
+		}
+		inline F32x4 fmadd(F32x4 a, F32x4 b, F32x4 c) { return a * b + c; }
+		inline F32x4 select(MaskF32x4 m, F32x4 a, F32x4 b) { return { _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)) }; }
+		inline bool any(MaskF32x4 m) { return _mm_movemask_ps(m.m) != 0; }
+		inline bool all(MaskF32x4 m) { return _mm_movemask_ps(m.m) == 0xF; }
+
+		struct MaskF64x2 {
+			__m128d m;
+			MaskF64x2 operator&(MaskF64x2 o) const { return { _mm_and_pd(m, o.m) }; }
+			MaskF64x2 operator|(MaskF64x2 o) const { return { _mm_or_pd(m, o.m) }; }
+			MaskF64x2 operator~() const { return { _mm_xor_pd(m, _mm_castsi128_pd(_mm_set1_epi32(-1))) }; }
+		};
+
+		struct F64x2 {
+			using value_type = double;
+			using mask_type = MaskF64x2;
+			static constexpr size_t width = 2;
+			__m128d v;
+
+			static F64x2 load(double const* p) { return { _mm_loadu_pd(p) }; }
+			static F64x2 broadcast(double x) { return { _mm_set1_pd(x) }; }
+			void store(double* p) const { _mm_storeu_pd(p, v); }
+			double lane(size_t i) const { alignas(16) double t[2]; _mm_store_pd(t, v); return t[i]; }
+
+			F64x2 operator+(F64x2 o) const { return { _mm_add_pd(v, o.v) }; }
+			F64x2 operator-(F64x2 o) const { return { _mm_sub_pd(v, o.v) }; }
+			F64x2 operator*(F64x2 o) const { return { _mm_mul_pd(v, o.v) }; }
+			F64x2 operator/(F64x2 o) const { return { _mm_div_pd(v, o.v) }; }
+			F64x2 operator-() const { return { _mm_sub_pd(_mm_setzero_pd(), v) }; }
+			mask_type operator<(F64x2 o) const { return { _mm_cmplt_pd(v, o.v) }; }
+			mask_type operator<=(F64x2 o) const { return { _mm_cmple_pd(v, o.v) }; }
+			mask_type operator>(F64x2 o) const { return { _mm_cmpgt_pd(v, o.v) }; }
+			mask_type operator>=(F64x2 o) const { return { _mm_cmpge_pd(v, o.v) }; }
+		};
+
+		inline F64x2 sqrt(F64x2 a) { return { _mm_sqrt_pd(a.v) }; }
+		inline F64x2 min(F64x2 a, F64x2 b) { return { _mm_min_pd(a.v, b.v) }; }
+		inline F64x2 max(F64x2 a, F64x2 b) { return { _mm_max_pd(a.v, b.v) }; }
+		inline F64x2 abs(F64x2 a) { return { _mm_andnot_pd(_mm_set1_pd(-0.0), a.v) }; }
+		// SSE2 has no rounding instructions: truncate and correct negative values. Only valid for |a| < 2^31.
+		inline F64x2 floor(F64x2 a) {
+			const __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a.v));
+			return { _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, a.v), _mm_set1_pd(1.0))) };
+		}
+		inline F64x2 fmadd(F64x2 a, F64x2 b, F64x2 c) { return a * b + c; }
+		inline F64x2 select(MaskF64x2 m, F64x2 a, F64x2 b) { return { _mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)) }; }
+		inline bool any(MaskF64x2 m) { return _mm_movemask_pd(m.m) != 0; }
+		inline bool all(MaskF64x2 m) { return _mm_movemask_pd(m.m) == 0x3; }
+
+		template <typename T> struct native_pack { using type = Scalar<T>; };
+		template <> struct native_pack<float> { using type = F32x4; };
+		template <> struct native_pack<double> { using type = F64x2; };
+
+#elif defined(JMP_SIMD_NEON64)
+		struct MaskF32x4 {
+			uint32x4_t m;
+			MaskF32x4 operator&(MaskF32x4 o) const { return { vandq_u32(m, o.m) }; }
+			MaskF32x4 operator|(MaskF32x4 o) const { return { vorrq_u32(m, o.m) }; }
+			MaskF32x4 operator~() const { return { vmvnq_u32(m) }; }
+		};
+
+		struct F32x4 {
+			using value_type = float;
+			using mask_type = MaskF32x4;
+			static constexpr size_t width = 4;
+			float32x4_t v;
+
+			static F32x4 load(float const* p) { return { vld1q_f32(p) }; }
+			static F32x4 broadcast(float x) { return { vdupq_n_f32(x) }; }
+			void store(float* p) const { vst1q_f32(p, v); }
+			float lane(size_t i) const { float t[4]; vst1q_f32(t, v); return t[i]; }
+
+			F32x4 operator+(F32x4 o) const { return { vaddq_f32(v, o.v) }; }
+			F32x4 operator-(F32x4 o) const { return { vsubq_f32(v, o.v) }; }
+			F32x4 operator*(F32x4 o) const { return { vmulq_f32(v, o.v) }; }
+			F32x4 operator/(F32x4 o) const { return { vdivq_f32(v, o.v) }; }
+			F32x4 operator-() const { return { vnegq_f32(v) }; }
+			mask_type operator<(F32x4 o) const { return { vcltq_f32(v, o.v) }; }
+			mask_type operator<=(F32x4 o) const { return { vcleq_f32(v, o.v) }; }
+			mask_type operator>(F32x4 o) const { return { vcgtq_f32(v, o.v) }; }
+			mask_type operator>=(F32x4 o) const { return { vcgeq_f32(v, o.v) }; }
+		};
+
+		inline F32x4 sqrt(F32x4 a) { return { vsqrtq_f32(a.v) }; }
+		inline F32x4 min(F32x4 a, F32x4 b) { return { vminq_f32(a.v, b.v) }; }
+		inline F32x4 max(F32x4 a, F32x4 b) { return { vmaxq_f32(a.v, b.v) }; }
+		inline F32x4 abs(F32x4 a) { return { vabsq_f32(a.v) }; }
+		inline F32x4 floor(F32x4 a) { return { vrndmq_f32(a.v) }; }
+		inline F32x4 fmadd(F32x4 a, F32x4 b, F32x4 c) { return { vfmaq_f32(c.v, a.v, b.v) }; }
+		inline F32x4 select(MaskF32x4 m, F32x4 a, F32x4 b) { return { vbslq_f32(m.m, a.v, b.v) }; }
+		inline bool any(MaskF32x4 m) { return vmaxvq_u32(m.m) != 0; }
+		inline bool all(MaskF32x4 m) { return vminvq_u32(m.m) != 0; }
+
+		struct MaskF64x2 {
+			uint64x2_t m;
+			MaskF64x2 operator&(MaskF64x2 o) const { return { vandq_u64(m, o.m) }; }
+			MaskF64x2 operator|(MaskF64x2 o) const { return { vorrq_u64(m, o.m) }; }
+			MaskF64x2 operator~() const { return { vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(m))) }; }
+		};
+
+		struct F64x2 {
+			using value_type = double;
+			using mask_type = MaskF64x2;
+			static constexpr size_t width = 2;
+			float64x2_t v;
+
+			static F64x2 load(double const* p) { return { vld1q_f64(p) }; }
+			static F64x2 broadcast(double x) { return { vdupq_n_f64(x) }; }
+			void store(double* p) const { vst1q_f64(p, v); }
+			double lane(size_t i) const { double t[2]; vst1q_f64(t, v); return t[i]; }
+
+			F64x2 operator+(F64x2 o) const { return { vaddq_f64(v, o.v) }; }
+			F64x2 operator-(F64x2 o) const { return { vsubq_f64(v, o.v) }; }
+			F64x2 operator*(F64x2 o) const { return { vmulq_f64(v, o.v) }; }
+			F64x2 operator/(F64x2 o) const { return { vdivq_f64(v, o.v) }; }
+			F64x2 operator-() const { return { vnegq_f64(v) }; }
+			mask_type operator<(F64x2 o) const { return { vcltq_f64(v, o.v) }; }
+			mask_type operator<=(F64x2 o) const { return { vcleq_f64(v, o.v) }; }
+			mask_type operator>(F64x2 o) const { return { vcgtq_f64(v, o.v) }; }
+			mask_type operator>=(F64x2 o) const { return { vcgeq_f64(v, o.v) }; }
+		};
+
+		inline F64x2 sqrt(F64x2 a) { return { vsqrtq_f64(a.v) }; }
+		inline F64x2 min(F64x2 a, F64x2 b) { return { vminq_f64(a.v, b.v) }; }
+		inline F64x2 max(F64x2 a, F64x2 b) { return { vmaxq_f64(a.v, b.v) }; }
+		inline F64x2 abs(F64x2 a) { return { vabsq_f64(a.v) }; }
+		inline F64x2 floor(F64x2 a) { return { vrndmq_f64(a.v) }; }
+		inline F64x2 fmadd(F64x2 a, F64x2 b, F64x2 c) { return { vfmaq_f64(c.v, a.v, b.v) }; }
+		inline F64x2 select(MaskF64x2 m, F64x2 a, F64x2 b) { return { vbslq_f64(m.m, a.v, b.v) }; }
+		inline bool any(MaskF64x2 m) { return vmaxvq_u32(vreinterpretq_u32_u64(m.m)) != 0; }
+		inline bool all(MaskF64x2 m) { return vminvq_u32(vreinterpretq_u32_u64(m.m)) != 0; }
+
+		template <typename T> struct native_pack { using type = Scalar<T>; };
+		template <> struct native_pack<float> { using type = F32x4; };
+		template <> struct native_pack<double> { using type = F64x2; };
+
+#else
+		template <typename T> struct native_pack { using type = Scalar<T>; };
+#endif
+
+		// The widest pack of T available on the current target.
+		template <typename T>
+		using Pack = typename native_pack<T>::type;
+
+		// Calls f(P{}, i) for each index i in steps of P::width, where P is Pack<T>
+		// for the bulk of the range and Scalar<T> for the remaining elements.
+		template <typename T, typename F>
+		inline void for_each_pack(size_t count, F&& f)
+		{
+			using P = Pack<T>;
+			size_t i = 0;
+			if constexpr (P::width > 1) {
+				for (; i + P::width <= count; i += P::width) {
+					f(P{}, i);
+				}
+			}
+			for (; i < count; ++i) {
+				f(Scalar<T>{}, i);
+			}
+		}
+	}
+}
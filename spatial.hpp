@@ -0,0 +1,616 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "vectors.hpp"
+#include "ray_packet.hpp"
+
+namespace JMP
+{
+    // Nearest circle or wall hit along a ray. The distance is measured in units of the ray's
+    // direction length, i.e. it is a plain distance for unit-length directions. When wall is
+    // set, index refers to the walls of the index instead of its circles.
+    template <typename T>
+    struct CircleHit {
+        int32_t index = Ray2Packet<T>::NO_HIT;
+        T distance = std::numeric_limits<T>::infinity();
+        bool wall = false;
+
+        explicit operator bool() const { return index != Ray2Packet<T>::NO_HIT; }
+    };
+
+    namespace detail {
+        // Ray data shared by all tests of a single query.
+        template <typename T>
+        struct RayQuery {
+            T px, py, dx, dy;
+            T a, inv_a;
+            T inv_dx, inv_dy;
+            T min_distance;
+
+            RayQuery(Ray2<T> const & ray, T min_dist) {
+                px = ray.position().x();
+                py = ray.position().y();
+                dx = ray.direction().x();
+                dy = ray.direction().y();
+                a = dx * dx + dy * dy;
+                inv_a = a > 0 ? 1 / a : 1;
+                inv_dx = dx != 0 ? 1 / dx : std::numeric_limits<T>::infinity();
+                inv_dy = dy != 0 ? 1 / dy : std::numeric_limits<T>::infinity();
+                min_distance = min_dist;
+            }
+
+            // Distance to the first crossing of the circle boundary beyond min_distance, or infinity.
+            // Same convention as Ray2Packet::intersect(): rays inside the circle hit its far side.
+            T circle(T cx, T cy, T r) const {
+                const T ux = cx - px;
+                const T uy = cy - py;
+                const T b = ux * dx + uy * dy;
+                const T c = ux * ux + uy * uy - r * r;
+                const T disc = b * b - a * c;
+                if (disc < 0) {
+                    return std::numeric_limits<T>::infinity();
+                }
+                const T sq = std::sqrt(disc);
+                const T t0 = (b - sq) * inv_a;
+                if (t0 > min_distance) {
+                    return t0;
+                }
+                const T t1 = (b + sq) * inv_a;
+                return t1 > min_distance ? t1 : std::numeric_limits<T>::infinity();
+            }
+
+            // Distance to the crossing of the segment from (ax, ay) along (ex, ey) beyond min_distance,
+            // or infinity. Same arithmetic as Ray2Packet::intersect() for segments.
+            T segment(T ax, T ay, T ex, T ey) const {
+                const T wx = ax - px;
+                const T wy = ay - py;
+                const T inv = 1 / (dx * ey - dy * ex);
+                const T t = (wx * ey - wy * ex) * inv;
+                const T u = (wx * dy - wy * dx) * inv;
+                return (t > min_distance && u >= 0 && u <= 1) ? t : std::numeric_limits<T>::infinity();
+            }
+
+            // Slab test against an axis-aligned box. Returns the entry and exit distances in t0, t1.
+            bool box(T min_x, T min_y, T max_x, T max_y, T& t0, T& t1) const {
+                T tx0 = (min_x - px) * inv_dx;
+                T tx1 = (max_x - px) * inv_dx;
+                if (tx0 > tx1) std::swap(tx0, tx1);
+                T ty0 = (min_y - py) * inv_dy;
+                T ty1 = (max_y - py) * inv_dy;
+                if (ty0 > ty1) std::swap(ty0, ty1);
+                // Rays parallel to an axis that start exactly on a slab plane produce NaN and miss.
+                t0 = std::max(tx0, ty0);
+                t1 = std::min(tx1, ty1);
+                return t0 <= t1;
+            }
+        };
+
+        template <typename T>
+        inline void test_circles(RayQuery<T> const & q, CircleSet<T> const & circles, int32_t const* indices, size_t count, CircleHit<T>& best) {
+            JMP_COUNT(INTERSECTION_TESTS, count);
+            for (size_t k = 0; k < count; ++k) {
+                const int32_t j = indices[k];
+                const T t = q.circle(circles.x()[j], circles.y()[j], circles.radii()[j]);
+                if (t < best.distance) {
+                    best.distance = t;
+                    best.index = j;
+                    best.wall = false;
+                }
+            }
+        }
+
+        template <typename T>
+        inline void test_segments(RayQuery<T> const & q, SegmentSet<T> const & segments, int32_t const* indices, size_t count, CircleHit<T>& best) {
+            JMP_COUNT(INTERSECTION_TESTS, count);
+            for (size_t k = 0; k < count; ++k) {
+                const int32_t j = indices[k];
+                const T t = q.segment(segments.x()[j], segments.y()[j], segments.dx()[j], segments.dy()[j]);
+                if (t < best.distance) {
+                    best.distance = t;
+                    best.index = j;
+                    best.wall = true;
+                }
+            }
+        }
+    }
+
+    // Uniform grid over circles and walls, traversed with a 3D-DDA style walk (Amanatides & Woo)
+    // in 2D. Each circle is registered in every cell its bounding box overlaps, each wall in the
+    // cells it crosses. Circles that would cover too many cells (e.g. an enclosing room) and
+    // circles or walls that have moved outside the grid are kept in separate lists that are
+    // tested once per query.
+    template <typename T>
+    class CircleGrid {
+    private:
+        CircleSet<T> _circles;
+        SegmentSet<T> _walls;
+        std::vector<std::vector<int32_t>> _cells;
+        std::vector<std::vector<int32_t>> _wall_cells;
+        std::vector<int32_t> _large;
+        std::vector<int32_t> _large_walls;
+        std::vector<uint8_t> _is_large;
+        std::vector<uint8_t> _wall_is_large;
+        T _min_x = 0;
+        T _min_y = 0;
+        T _cell_size = 1;
+        T _inv_cell_size = 1;
+        int32_t _nx = 0;
+        int32_t _ny = 0;
+        size_t _max_cells_per_circle = 16;
+
+        int32_t _cell_x(T x) const { return static_cast<int32_t>(std::floor((x - _min_x) * _inv_cell_size)); }
+        int32_t _cell_y(T y) const { return static_cast<int32_t>(std::floor((y - _min_y) * _inv_cell_size)); }
+
+        // Cell range covered by a circle. Returns false if the circle belongs in the large list.
+        bool _range(size_t i, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const {
+            const T cx = _circles.x()[i];
+            const T cy = _circles.y()[i];
+            const T r = _circles.radii()[i];
+            x0 = _cell_x(cx - r);
+            x1 = _cell_x(cx + r);
+            y0 = _cell_y(cy - r);
+            y1 = _cell_y(cy + r);
+            if (x0 < 0 || y0 < 0 || x1 >= _nx || y1 >= _ny) {
+                return false;
+            }
+            const size_t covered = static_cast<size_t>(x1 - x0 + 1) * static_cast<size_t>(y1 - y0 + 1);
+            return covered <= _max_cells_per_circle;
+        }
+
+        void _insert(size_t i) {
+            int32_t x0, y0, x1, y1;
+            if (!_range(i, x0, y0, x1, y1)) {
+                _large.push_back(static_cast<int32_t>(i));
+                _is_large[i] = 1;
+                return;
+            }
+            _is_large[i] = 0;
+            for (int32_t y = y0; y <= y1; ++y) {
+                for (int32_t x = x0; x <= x1; ++x) {
+                    _cells[static_cast<size_t>(y) * _nx + x].push_back(static_cast<int32_t>(i));
+                }
+            }
+        }
+
+        static void _erase(std::vector<int32_t>& list, int32_t i) {
+            auto it = std::find(list.begin(), list.end(), i);
+            if (it != list.end()) {
+                *it = list.back();
+                list.pop_back();
+            }
+        }
+
+        void _remove(size_t i) {
+            if (_is_large[i]) {
+                _erase(_large, static_cast<int32_t>(i));
+                return;
+            }
+            int32_t x0, y0, x1, y1;
+            _range(i, x0, y0, x1, y1);
+            for (int32_t y = y0; y <= y1; ++y) {
+                for (int32_t x = x0; x <= x1; ++x) {
+                    _erase(_cells[static_cast<size_t>(y) * _nx + x], static_cast<int32_t>(i));
+                }
+            }
+        }
+
+        // Calls visit(cell) for every cell that wall i crosses. Cells are found column by column
+        // from the part of the wall inside each column, widened by a small tolerance so that a
+        // wall running along a cell boundary is registered on both sides and rays hitting it near
+        // the boundary still find it. Returns false if the wall belongs in the large list.
+        template <class Visit>
+        bool _wall_cells_of(size_t i, Visit&& visit) const {
+            const T ax = _walls.x()[i];
+            const T ay = _walls.y()[i];
+            const T ex = _walls.dx()[i];
+            const T ey = _walls.dy()[i];
+            const T tol = _cell_size * T(1e-3);
+            const T min_x = std::min(ax, ax + ex) - tol;
+            const T max_x = std::max(ax, ax + ex) + tol;
+            const T min_y = std::min(ay, ay + ey) - tol;
+            const T max_y = std::max(ay, ay + ey) + tol;
+            const int32_t x0 = _cell_x(min_x);
+            const int32_t x1 = _cell_x(max_x);
+            const int32_t y0 = _cell_y(min_y);
+            const int32_t y1 = _cell_y(max_y);
+            if (x0 < 0 || y0 < 0 || x1 >= _nx || y1 >= _ny) {
+                return false;
+            }
+            for (int32_t x = x0; x <= x1; ++x) {
+                const T lo = std::max(min_x, _min_x + x * _cell_size - tol);
+                const T hi = std::min(max_x, _min_x + (x + 1) * _cell_size + tol);
+                T ya = min_y;
+                T yb = max_y;
+                if (ex != 0) {
+                    ya = ay + (lo - ax) * (ey / ex);
+                    yb = ay + (hi - ax) * (ey / ex);
+                }
+                const int32_t r0 = std::max(y0, _cell_y(std::min(ya, yb) - tol));
+                const int32_t r1 = std::min(y1, _cell_y(std::max(ya, yb) + tol));
+                for (int32_t y = r0; y <= r1; ++y) {
+                    visit(static_cast<size_t>(y) * _nx + x);
+                }
+            }
+            return true;
+        }
+
+        void _insert_wall(size_t i) {
+            const bool inside = _wall_cells_of(i, [&](size_t cell) {
+                _wall_cells[cell].push_back(static_cast<int32_t>(i));
+            });
+            _wall_is_large[i] = inside ? 0 : 1;
+            if (!inside) {
+                _large_walls.push_back(static_cast<int32_t>(i));
+            }
+        }
+
+        void _remove_wall(size_t i) {
+            if (_wall_is_large[i]) {
+                _erase(_large_walls, static_cast<int32_t>(i));
+                return;
+            }
+            _wall_cells_of(i, [&](size_t cell) {
+                _erase(_wall_cells[cell], static_cast<int32_t>(i));
+            });
+        }
+
+    public:
+        CircleGrid() = default;
+
+        explicit CircleGrid(CircleSet<T> const & circles, T cell_size = 0) {
+            build(circles, cell_size);
+        }
+
+        CircleGrid(CircleSet<T> const & circles, SegmentSet<T> const & walls, T cell_size = 0) {
+            build(circles, walls, cell_size);
+        }
+
+        // Builds the grid over the current extent of the circles. With a cell size of 0, cells are
+        // sized to hold a few circles each on average.
+        void build(CircleSet<T> const & circles, T cell_size = 0) {
+            build(circles, SegmentSet<T>(), cell_size);
+        }
+
+        // Same as above, over the extent of both the circles and the walls. Walls count like
+        // circles when sizing cells automatically.
+        void build(CircleSet<T> const & circles, SegmentSet<T> const & walls, T cell_size = 0) {
+            _circles = circles;
+            _walls = walls;
+            _cells.clear();
+            _wall_cells.clear();
+            _large.clear();
+            _large_walls.clear();
+            _is_large.assign(circles.size(), 0);
+            _wall_is_large.assign(walls.size(), 0);
+            _nx = _ny = 0;
+            if (circles.empty() && walls.empty()) {
+                return;
+            }
+
+            T min_x = std::numeric_limits<T>::max();
+            T min_y = std::numeric_limits<T>::max();
+            T max_x = std::numeric_limits<T>::lowest();
+            T max_y = std::numeric_limits<T>::lowest();
+            std::vector<T> radii(circles.radii(), circles.radii() + circles.size());
+            for (size_t i = 0; i < circles.size(); ++i) {
+                const T r = radii[i];
+                min_x = std::min(min_x, circles.x()[i] - r);
+                min_y = std::min(min_y, circles.y()[i] - r);
+                max_x = std::max(max_x, circles.x()[i] + r);
+                max_y = std::max(max_y, circles.y()[i] + r);
+            }
+            for (size_t i = 0; i < walls.size(); ++i) {
+                const T ax = walls.x()[i];
+                const T ay = walls.y()[i];
+                min_x = std::min({ min_x, ax, ax + walls.dx()[i] });
+                min_y = std::min({ min_y, ay, ay + walls.dy()[i] });
+                max_x = std::max({ max_x, ax, ax + walls.dx()[i] });
+                max_y = std::max({ max_y, ay, ay + walls.dy()[i] });
+            }
+            if (cell_size <= 0) {
+                T median_radius = 0;
+                if (!radii.empty()) {
+                    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+                    median_radius = radii[radii.size() / 2];
+                }
+                const T area = (max_x - min_x) * (max_y - min_y);
+                cell_size = std::max(std::sqrt(area * 4 / static_cast<T>(circles.size() + walls.size())), 2 * median_radius);
+            }
+
+            const T max_cells = 4096;
+            cell_size = std::max({ cell_size, (max_x - min_x) / max_cells, (max_y - min_y) / max_cells, std::numeric_limits<T>::min() });
+            // Walls are registered with a tolerance around them, which must stay inside the grid.
+            if (!walls.empty()) {
+                const T margin = cell_size * T(2e-3);
+                min_x -= margin;
+                min_y -= margin;
+                max_x += margin;
+                max_y += margin;
+            }
+            _cell_size = cell_size;
+            _inv_cell_size = 1 / cell_size;
+            _min_x = min_x;
+            _min_y = min_y;
+            _nx = std::max<int32_t>(1, static_cast<int32_t>(std::ceil((max_x - min_x) * _inv_cell_size)));
+            _ny = std::max<int32_t>(1, static_cast<int32_t>(std::ceil((max_y - min_y) * _inv_cell_size)));
+            _cells.resize(static_cast<size_t>(_nx) * _ny);
+            _wall_cells.resize(walls.empty() ? 0 : _cells.size());
+
+            for (size_t i = 0; i < circles.size(); ++i) {
+                _insert(i);
+            }
+            for (size_t i = 0; i < walls.size(); ++i) {
+                _insert_wall(i);
+            }
+        }
+
+        // Moves or resizes a circle, updating only the cells it leaves and enters.
+        void update(size_t i, Vector2<T> const & center, T radius) {
+            _remove(i);
+            _circles.set(i, center, radius);
+            _insert(i);
+        }
+
+        // Moves a wall, updating only the cells it leaves and enters.
+        void update_wall(size_t i, Segment2<T> const & wall) {
+            _remove_wall(i);
+            _walls.set(i, wall);
+            _insert_wall(i);
+        }
+
+        CircleSet<T> const & circles() const { return _circles; }
+        SegmentSet<T> const & walls() const { return _walls; }
+
+        CircleHit<T> intersect(Ray2<T> const & ray, T min_distance = T(1e-5)) const {
+            const detail::RayQuery<T> q(ray, min_distance);
+            CircleHit<T> best;
+            detail::test_circles(q, _circles, _large.data(), _large.size(), best);
+            detail::test_segments(q, _walls, _large_walls.data(), _large_walls.size(), best);
+            if (_cells.empty()) {
+                return best;
+            }
+
+            T t_enter, t_exit;
+            if (!q.box(_min_x, _min_y, _min_x + _nx * _cell_size, _min_y + _ny * _cell_size, t_enter, t_exit) || t_exit < 0) {
+                return best;
+            }
+            const T t_start = std::max(t_enter, T(0));
+            if (t_start >= best.distance) {
+                return best;
+            }
+
+            int32_t ix = std::clamp(_cell_x(q.px + q.dx * t_start), 0, _nx - 1);
+            int32_t iy = std::clamp(_cell_y(q.py + q.dy * t_start), 0, _ny - 1);
+            const int32_t step_x = q.dx > 0 ? 1 : -1;
+            const int32_t step_y = q.dy > 0 ? 1 : -1;
+            const T inf = std::numeric_limits<T>::infinity();
+            const T delta_x = q.dx != 0 ? _cell_size * std::abs(q.inv_dx) : inf;
+            const T delta_y = q.dy != 0 ? _cell_size * std::abs(q.inv_dy) : inf;
+            T next_x = q.dx != 0 ? (_min_x + (ix + (q.dx > 0 ? 1 : 0)) * _cell_size - q.px) * q.inv_dx : inf;
+            T next_y = q.dy != 0 ? (_min_y + (iy + (q.dy > 0 ? 1 : 0)) * _cell_size - q.py) * q.inv_dy : inf;
+
+            for (;;) {
+                const size_t c = static_cast<size_t>(iy) * _nx + ix;
+                detail::test_circles(q, _circles, _cells[c].data(), _cells[c].size(), best);
+                if (!_wall_cells.empty()) {
+                    detail::test_segments(q, _walls, _wall_cells[c].data(), _wall_cells[c].size(), best);
+                }
+
+                // Any hit in a later cell is further than the exit of this cell.
+                const T t_cell_exit = std::min(next_x, next_y);
+                if (best.distance <= t_cell_exit || t_cell_exit > t_exit) {
+                    break;
+                }
+                if (next_x < next_y) {
+                    ix += step_x;
+                    next_x += delta_x;
+                    if (ix < 0 || ix >= _nx) break;
+                }
+                else {
+                    iy += step_y;
+                    next_y += delta_y;
+                    if (iy < 0 || iy >= _ny) break;
+                }
+            }
+            return best;
+        }
+
+        // Nearest hit for every ray of the packet, with the same outputs as Ray2Packet::intersect().
+        void intersect(Ray2Packet<T> const & rays, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                const CircleHit<T> hit = intersect(rays[i], min_distance);
+                hit_index[i] = hit.index;
+                hit_distance[i] = hit.distance;
+            }
+        }
+    };
+
+    // Bounding volume hierarchy over circles, built by median splits along the longest axis.
+    // Queries visit O(log N) nodes for typical scenes. When circles move, update() them and
+    // call refit() once per frame; call build() again if the circles have moved so far that
+    // queries slow down.
+    template <typename T>
+    class CircleBVH {
+    private:
+        struct Node {
+            T min_x, min_y, max_x, max_y;
+            // For leaves, the first entry in _indices; for inner nodes, the index of the left
+            // child (the right child follows it).
+            int32_t first;
+            // Number of circles in a leaf, 0 for inner nodes.
+            int32_t count;
+        };
+
+        static constexpr int32_t LEAF_SIZE = 4;
+        static constexpr size_t MAX_DEPTH = 64;
+
+        CircleSet<T> _circles;
+        std::vector<Node> _nodes;
+        std::vector<int32_t> _indices;
+
+        void _bound_leaf(Node& node) const {
+            node.min_x = node.min_y = std::numeric_limits<T>::max();
+            node.max_x = node.max_y = std::numeric_limits<T>::lowest();
+            for (int32_t k = 0; k < node.count; ++k) {
+                const int32_t j = _indices[node.first + k];
+                const T r = _circles.radii()[j];
+                node.min_x = std::min(node.min_x, _circles.x()[j] - r);
+                node.min_y = std::min(node.min_y, _circles.y()[j] - r);
+                node.max_x = std::max(node.max_x, _circles.x()[j] + r);
+                node.max_y = std::max(node.max_y, _circles.y()[j] + r);
+            }
+        }
+
+        void _bound_inner(Node& node) const {
+            Node const & l = _nodes[node.first];
+            Node const & r = _nodes[node.first + 1];
+            node.min_x = std::min(l.min_x, r.min_x);
+            node.min_y = std::min(l.min_y, r.min_y);
+            node.max_x = std::max(l.max_x, r.max_x);
+            node.max_y = std::max(l.max_y, r.max_y);
+        }
+
+        void _split(size_t node_index, int32_t first, int32_t count, size_t depth) {
+            if (count <= LEAF_SIZE || depth + 1 >= MAX_DEPTH) {
+                _nodes[node_index].first = first;
+                _nodes[node_index].count = count;
+                _bound_leaf(_nodes[node_index]);
+                return;
+            }
+
+            T min_x = std::numeric_limits<T>::max();
+            T min_y = std::numeric_limits<T>::max();
+            T max_x = std::numeric_limits<T>::lowest();
+            T max_y = std::numeric_limits<T>::lowest();
+            for (int32_t k = first; k < first + count; ++k) {
+                const int32_t j = _indices[k];
+                min_x = std::min(min_x, _circles.x()[j]);
+                min_y = std::min(min_y, _circles.y()[j]);
+                max_x = std::max(max_x, _circles.x()[j]);
+                max_y = std::max(max_y, _circles.y()[j]);
+            }
+            T const* axis = (max_x - min_x) >= (max_y - min_y) ? _circles.x() : _circles.y();
+            const int32_t half = count / 2;
+            std::nth_element(_indices.begin() + first, _indices.begin() + first + half, _indices.begin() + first + count,
+                [axis](int32_t a, int32_t b) { return axis[a] < axis[b]; });
+
+            const int32_t left = static_cast<int32_t>(_nodes.size());
+            _nodes.emplace_back();
+            _nodes.emplace_back();
+            _nodes[node_index].first = left;
+            _nodes[node_index].count = 0;
+            _split(left, first, half, depth + 1);
+            _split(left + 1, first + half, count - half, depth + 1);
+            _bound_inner(_nodes[node_index]);
+        }
+
+    public:
+        CircleBVH() = default;
+
+        explicit CircleBVH(CircleSet<T> const & circles) {
+            build(circles);
+        }
+
+        void build(CircleSet<T> const & circles) {
+            _circles = circles;
+            build();
+        }
+
+        // Rebuilds the hierarchy from the current circles.
+        void build() {
+            _nodes.clear();
+            _indices.resize(_circles.size());
+            for (size_t i = 0; i < _indices.size(); ++i) {
+                _indices[i] = static_cast<int32_t>(i);
+            }
+            if (_circles.empty()) {
+                return;
+            }
+            _nodes.reserve(2 * _circles.size() / LEAF_SIZE + 1);
+            _nodes.emplace_back();
+            _split(0, 0, static_cast<int32_t>(_circles.size()), 0);
+        }
+
+        // Moves or resizes a circle. The tree is invalid for queries until refit() is called.
+        void update(size_t i, Vector2<T> const & center, T radius) {
+            _circles.set(i, center, radius);
+        }
+
+        // Recomputes all node bounds bottom-up without changing the tree topology.
+        void refit() {
+            // Children are always stored after their parent.
+            for (size_t n = _nodes.size(); n-- > 0;) {
+                if (_nodes[n].count > 0) {
+                    _bound_leaf(_nodes[n]);
+                }
+                else {
+                    _bound_inner(_nodes[n]);
+                }
+            }
+        }
+
+        CircleSet<T> const & circles() const { return _circles; }
+
+        CircleHit<T> intersect(Ray2<T> const & ray, T min_distance = T(1e-5)) const {
+            CircleHit<T> best;
+            if (_nodes.empty()) {
+                return best;
+            }
+            const detail::RayQuery<T> q(ray, min_distance);
+
+            int32_t stack[MAX_DEPTH * 2];
+            size_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                Node const & node = _nodes[stack[--top]];
+                T t0, t1;
+                if (!q.box(node.min_x, node.min_y, node.max_x, node.max_y, t0, t1) || t1 < 0 || t0 >= best.distance) {
+                    continue;
+                }
+                if (node.count > 0) {
+                    detail::test_circles(q, _circles, _indices.data() + node.first, static_cast<size_t>(node.count), best);
+                    continue;
+                }
+                // Visit the nearer child first so that the far one can be culled by the best hit.
+                Node const & l = _nodes[node.first];
+                Node const & r = _nodes[node.first + 1];
+                T l0, l1, r0, r1;
+                const bool hit_l = q.box(l.min_x, l.min_y, l.max_x, l.max_y, l0, l1) && l1 >= 0;
+                const bool hit_r = q.box(r.min_x, r.min_y, r.max_x, r.max_y, r0, r1) && r1 >= 0;
+                if (hit_l && hit_r) {
+                    const bool left_first = l0 <= r0;
+                    stack[top++] = left_first ? node.first + 1 : node.first;
+                    stack[top++] = left_first ? node.first : node.first + 1;
+                }
+                else if (hit_l) {
+                    stack[top++] = node.first;
+                }
+                else if (hit_r) {
+                    stack[top++] = node.first + 1;
+                }
+            }
+            return best;
+        }
+
+        // Nearest hit for every ray of the packet, with the same outputs as Ray2Packet::intersect().
+        void intersect(Ray2Packet<T> const & rays, int32_t* hit_index, T* hit_distance, T min_distance = T(1e-5)) const {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                const CircleHit<T> hit = intersect(rays[i], min_distance);
+                hit_index[i] = hit.index;
+                hit_distance[i] = hit.distance;
+            }
+        }
+    };
+}
@@ -0,0 +1,177 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "memory.hpp"
+#include "instrumentation.hpp"
+
+namespace JMP
+{
+	// Fixed-size pool of worker threads running parallel loops with work stealing.
+	// A loop over N tasks is split into one contiguous range per worker. Workers claim
+	// tasks from the front of their own range and, once it is exhausted, steal tasks from
+	// the ranges of other workers. Claims are a single atomic increment on a cache-line
+	// padded counter, so there are no locks on the task path.
+	// Usage:
+	//
+	// ThreadPool pool; // One worker per hardware thread.
+	// pool.parallel_for(batch_count, [&](size_t batch, size_t worker) {
+	//     process(batch, results[worker]);
+	// });
+	//
+	class ThreadPool {
+	private:
+		struct alignas(CACHE_LINE_SIZE) Range {
+			std::atomic<size_t> next{ 0 };
+			size_t end = 0;
+		};
+
+		std::vector<std::thread> _threads;
+		std::unique_ptr<Range[]> _ranges;
+		size_t _worker_count = 1;
+
+		std::mutex _mutex;
+		std::condition_variable _start;
+		std::condition_variable _done;
+		std::function<void(size_t, size_t)> _task;
+		uint64_t _generation = 0;
+		size_t _active = 0;
+		bool _stop = false;
+
+		bool _claim(Range& range, size_t& task) noexcept
+		{
+			if (range.next.load(std::memory_order_relaxed) >= range.end) {
+				return false;
+			}
+			task = range.next.fetch_add(1, std::memory_order_relaxed);
+			return task < range.end;
+		}
+
+		void _run(size_t worker)
+		{
+			size_t task;
+			while (_claim(_ranges[worker], task)) {
+				_task(task, worker);
+			}
+			for (size_t k = 1; k < _worker_count; ++k) {
+				Range& victim = _ranges[(worker + k) % _worker_count];
+				while (_claim(victim, task)) {
+					_task(task, worker);
+				}
+			}
+		}
+
+		void _worker_loop(size_t worker)
+		{
+			JMP_THREAD_NAME("ThreadPool worker " + std::to_string(worker));
+			uint64_t seen = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_start.wait(lock, [&] { return _stop || _generation != seen; });
+					if (_stop) {
+						return;
+					}
+					seen = _generation;
+				}
+				_run(worker);
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					if (--_active == 0) {
+						_done.notify_one();
+					}
+				}
+			}
+		}
+
+	public:
+		// Creates a pool with the given number of workers, including the calling thread.
+		// 0 uses one worker per hardware thread.
+		explicit ThreadPool(size_t worker_count = 0)
+		{
+			if (worker_count == 0) {
+				worker_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+			}
+			_worker_count = worker_count;
+			_ranges.reset(new Range[worker_count]);
+			_threads.reserve(worker_count - 1);
+			for (size_t w = 1; w < worker_count; ++w) {
+				_threads.emplace_back([this, w] { _worker_loop(w); });
+			}
+		}
+
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool& operator=(ThreadPool const&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_start.notify_all();
+			for (std::thread& t : _threads) {
+				t.join();
+			}
+		}
+
+		// Number of workers, including the thread that calls parallel_for().
+		size_t worker_count() const noexcept { return _worker_count; }
+
+		// Calls f(task, worker) for every task in [0, task_count) and returns once all tasks
+		// are done. worker is in [0, worker_count()) and identifies the thread running the task,
+		// so it can index per-worker state without synchronization. The calling thread is worker 0.
+		// parallel_for() must not be called concurrently or from within a task.
+		template <typename F>
+		void parallel_for(size_t task_count, F&& f)
+		{
+			if (task_count == 0) {
+				return;
+			}
+			if (_worker_count == 1 || task_count == 1) {
+				for (size_t t = 0; t < task_count; ++t) {
+					f(t, size_t(0));
+				}
+				return;
+			}
+
+			const size_t per_worker = task_count / _worker_count;
+			const size_t remainder = task_count % _worker_count;
+			size_t begin = 0;
+			for (size_t w = 0; w < _worker_count; ++w) {
+				const size_t size = per_worker + (w < remainder ? 1 : 0);
+				_ranges[w].next.store(begin, std::memory_order_relaxed);
+				_ranges[w].end = begin + size;
+				begin += size;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_task = [&f](size_t task, size_t worker) { f(task, worker); };
+				_active = _worker_count - 1;
+				++_generation;
+			}
+			_start.notify_all();
+
+			_run(0);
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_done.wait(lock, [&] { return _active == 0; });
+			_task = nullptr;
+		}
+	};
+}
@@ -0,0 +1,361 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+
+#include "vectors.hpp"
+#include "memory.hpp"
+#include "simd.hpp"
+#include "compact.hpp"
+#include "random.hpp"
+
+namespace JMP
+{
+    // Structure-of-arrays container of 2D vectors. The x and y components are kept in
+    // separate cache-line aligned arrays so that the batch operations below process a
+    // full SIMD register of vectors per instruction.
+    //
+    // Batch operations compute magnitudes as sqrt(x*x + y*y) rather than with std::hypot,
+    // so results can differ from Vector2 in the last bits and overflow for components
+    // larger than about sqrt(std::numeric_limits<T>::max()).
+    //
+    // RandomDirections() provides reproducible random directions indexed by a counter.
+    //
+    // The static kernels operate on raw component arrays and can be used by other SoA
+    // containers (e.g. ray packets).
+    template <typename T, std::enable_if_t<std::is_floating_point<T>::value, bool> = true>
+    class Vector2Batch {
+    public:
+        using storage_type = std::vector<T, AlignedAllocator<T>>;
+
+    private:
+        storage_type _x;
+        storage_type _y;
+
+    public:
+        // Creates a batch of vectors pointing in uniformly distributed random directions.
+        // Vector i of the batch is the direction with index first_index + i for the given seed,
+        // so batches generated in any order or on any thread produce the same directions.
+        // Pass FastMath to evaluate the sines and cosines with SIMD polynomials.
+        template <class Math = StdMath>
+        static Vector2Batch RandomDirections(size_t count, uint64_t seed, uint64_t first_index = 0, T length = 1) {
+            Vector2Batch batch(count);
+            random_directions<Math>(batch.x(), batch.y(), count, seed, first_index, length);
+            return batch;
+        }
+
+        // The direction with the given index, identical to element i of RandomDirections(n, seed, index - i)
+        // with the same math policy.
+        template <class Math = StdMath>
+        static Vector2<T> RandomDirection(uint64_t seed, uint64_t index, T length = 1) {
+            T x, y;
+            random_directions<Math>(&x, &y, 1, seed, index, length);
+            return Vector2<T>(x, y);
+        }
+
+        Vector2Batch() = default;
+        explicit Vector2Batch(size_t count) : _x(count), _y(count) {}
+
+        Vector2Batch(std::vector<Vector2<T>> const & vectors) : _x(vectors.size()), _y(vectors.size()) {
+            for (size_t i = 0; i < vectors.size(); ++i) {
+                _x[i] = vectors[i].x();
+                _y[i] = vectors[i].y();
+            }
+        }
+
+        size_t size() const { return _x.size(); }
+        bool empty() const { return _x.empty(); }
+
+        void resize(size_t count) {
+            _x.resize(count);
+            _y.resize(count);
+        }
+
+        void reserve(size_t count) {
+            _x.reserve(count);
+            _y.reserve(count);
+        }
+
+        void clear() {
+            _x.clear();
+            _y.clear();
+        }
+
+        void push_back(Vector2<T> const & v) {
+            _x.push_back(v.x());
+            _y.push_back(v.y());
+        }
+
+        Vector2<T> operator[](size_t i) const { return Vector2<T>(_x[i], _y[i]); }
+
+        void set(size_t i, Vector2<T> const & v) {
+            _x[i] = v.x();
+            _y[i] = v.y();
+        }
+
+        T* x() { return _x.data(); }
+        T* y() { return _y.data(); }
+        T const* x() const { return _x.data(); }
+        T const* y() const { return _y.data(); }
+
+        std::vector<Vector2<T>> to_vectors() const {
+            std::vector<Vector2<T>> vectors;
+            vectors.reserve(size());
+            for (size_t i = 0; i < size(); ++i) {
+                vectors.emplace_back(_x[i], _y[i]);
+            }
+            return vectors;
+        }
+
+        void rotate(Rotation2<T> const & rotation) {
+            rotate(x(), y(), rotation, size());
+        }
+
+        void scale(T s) {
+            scale(x(), y(), s, size());
+        }
+
+        // Writes the magnitude of every vector to out, which must hold size() values.
+        void magnitudes(T* out) const {
+            magnitudes(x(), y(), out, size());
+        }
+
+        void normalize() {
+            normalize(x(), y(), size());
+        }
+
+        Vector2Batch normalized() const {
+            Vector2Batch result(*this);
+            result.normalize();
+            return result;
+        }
+
+        // Writes the dot product of each vector with the matching vector of v to out.
+        void dot(Vector2Batch const & v, T* out) const {
+            dot(x(), y(), v.x(), v.y(), out, std::min(size(), v.size()));
+        }
+
+        // Writes the dot product of each vector with v to out.
+        void dot(Vector2<T> const & v, T* out) const {
+            dot(x(), y(), v.x(), v.y(), out, size());
+        }
+
+        // Reflects each vector about the matching (unit length) normal.
+        void reflect(Vector2Batch const & normals) {
+            reflect(x(), y(), normals.x(), normals.y(), std::min(size(), normals.size()));
+        }
+
+        // Reflects every vector about the same (unit length) normal.
+        void reflect(Vector2<T> const & normal) {
+            reflect(x(), y(), normal.x(), normal.y(), size());
+        }
+
+        // Fills the component arrays with random directions drawn from a Philox4x32 stream keyed by seed.
+        template <class Math = StdMath>
+        static void random_directions(T* xs, T* ys, size_t count, uint64_t seed, uint64_t first_index, T length = 1) {
+            const T two_pi = static_cast<T>(6.283185307179586476925286766559);
+            // Angles go in ys first, in a loop with no dependencies between elements, then the batch trig.
+            for (size_t i = 0; i < count; ++i) {
+                ys[i] = two_pi * uniform_unit<T>(Philox4x32::generate(first_index + i, 0, seed));
+            }
+            Math::sincos(ys, ys, xs, count);
+            if (length != 1) {
+                scale(xs, ys, length, count);
+            }
+        }
+
+        // Multiplies every vector by s.
+        static void scale(T* xs, T* ys, T s, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                (P::load(xs + i) * P::broadcast(s)).store(xs + i);
+                (P::load(ys + i) * P::broadcast(s)).store(ys + i);
+            });
+        }
+
+        // Rotates every vector by the same rotation.
+        static void rotate(T* xs, T* ys, Rotation2<T> const & rotation, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = P::load(xs + i);
+                const P vy = P::load(ys + i);
+                const P c = P::broadcast(rotation.cos());
+                const P s = P::broadcast(rotation.sin());
+                (c * vx - s * vy).store(xs + i);
+                (s * vx + c * vy).store(ys + i);
+            });
+        }
+
+        static void magnitudes(T const* xs, T const* ys, T* out, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = P::load(xs + i);
+                const P vy = P::load(ys + i);
+                sqrt(vx * vx + vy * vy).store(out + i);
+            });
+        }
+
+        static void normalize(T* xs, T* ys, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = P::load(xs + i);
+                const P vy = P::load(ys + i);
+                const P zero = P::broadcast(0);
+                const P l = sqrt(vx * vx + vy * vy);
+                const auto valid = l > zero;
+                const P inv_l = P::broadcast(1) / select(valid, l, P::broadcast(1));
+                select(valid, vx * inv_l, zero).store(xs + i);
+                select(valid, vy * inv_l, zero).store(ys + i);
+            });
+        }
+
+        static void dot(T const* xs, T const* ys, T const* vxs, T const* vys, T* out, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                (P::load(xs + i) * P::load(vxs + i) + P::load(ys + i) * P::load(vys + i)).store(out + i);
+            });
+        }
+
+        static void dot(T const* xs, T const* ys, T vx, T vy, T* out, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                (P::load(xs + i) * P::broadcast(vx) + P::load(ys + i) * P::broadcast(vy)).store(out + i);
+            });
+        }
+
+        static void reflect(T* xs, T* ys, T const* nxs, T const* nys, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = P::load(xs + i);
+                const P vy = P::load(ys + i);
+                const P nx = P::load(nxs + i);
+                const P ny = P::load(nys + i);
+                const P d2 = (vx * nx + vy * ny) * P::broadcast(2);
+                (vx - nx * d2).store(xs + i);
+                (vy - ny * d2).store(ys + i);
+            });
+        }
+
+        static void reflect(T* xs, T* ys, T nx, T ny, size_t count) {
+            simd::for_each_pack<T>(count, [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = P::load(xs + i);
+                const P vy = P::load(ys + i);
+                const P px = P::broadcast(nx);
+                const P py = P::broadcast(ny);
+                const P d2 = (vx * px + vy * py) * P::broadcast(2);
+                (vx - px * d2).store(xs + i);
+                (vy - py * d2).store(ys + i);
+            });
+        }
+    };
+
+    // Storage-only batch of 2D vectors in a 16-bit format S (Half, BFloat16 or int16_t fixed
+    // point, see compact.hpp), 4 bytes per vector instead of 8 for large, memory-bound scenes.
+    // The kernels below decode the components in registers as they load them and compute in
+    // float; anything else works on a Vector2Batch<float> from decode().
+    //
+    // With int16_t both components share one scale, so the error is the same in every direction.
+    // It is set from the largest component when the batch is built; later writes with set()
+    // saturate at that range.
+    // Usage:
+    //
+    // CompactVector2Batch<int16_t> positions{ Vector2Batch<float>(points) };
+    // positions.dot(direction, projections.data());
+    //
+    template <typename S>
+    class CompactVector2Batch {
+    private:
+        CompactArray<S> _x;
+        CompactArray<S> _y;
+
+        // What a decoded value is multiplied by.
+        float _unit() const { return std::is_same<S, int16_t>::value ? _x.scale() : 1.0f; }
+
+    public:
+        CompactVector2Batch() = default;
+
+        // count zero vectors, with a fixed-point step of scale.
+        explicit CompactVector2Batch(size_t count, float scale = 1) : _x(count, scale), _y(count, scale) {}
+
+        explicit CompactVector2Batch(Vector2Batch<float> const & batch) {
+            float scale = 1;
+            if constexpr (std::is_same<S, int16_t>::value) {
+                scale = std::max(fixed16_scale(batch.x(), batch.size()), fixed16_scale(batch.y(), batch.size()));
+            }
+            _x.assign(batch.x(), batch.size(), scale);
+            _y.assign(batch.y(), batch.size(), scale);
+        }
+
+        size_t size() const { return _x.size(); }
+        bool empty() const { return _x.empty(); }
+        size_t bytes() const { return _x.bytes() + _y.bytes(); }
+        float scale() const { return _x.scale(); }
+
+        CompactArray<S> const & x() const { return _x; }
+        CompactArray<S> const & y() const { return _y; }
+
+        Vector2<float> operator[](size_t i) const { return Vector2<float>(_x[i], _y[i]); }
+
+        void set(size_t i, Vector2<float> const & v) {
+            _x.set(i, v.x());
+            _y.set(i, v.y());
+        }
+
+        // Decodes the vectors [first, first + count) into component arrays.
+        void decode(size_t first, size_t count, float* xs, float* ys) const {
+            _x.decode(first, count, xs);
+            _y.decode(first, count, ys);
+        }
+
+        Vector2Batch<float> decode() const {
+            Vector2Batch<float> batch(size());
+            decode(0, size(), batch.x(), batch.y());
+            return batch;
+        }
+
+        // The kernels work on the stored integers and fold the fixed-point scale into their
+        // constants, which saves a multiplication per component.
+
+        // Writes the magnitude of every vector to out, which must hold size() values.
+        void magnitudes(float* out) const {
+            const float unit = _unit();
+            simd::for_each_pack<float>(size(), [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P vx = simd::decode(P{}, _x.data() + i);
+                const P vy = simd::decode(P{}, _y.data() + i);
+                (sqrt(vx * vx + vy * vy) * P::broadcast(unit)).store(out + i);
+            });
+        }
+
+        // Writes the dot product of each vector with v to out.
+        void dot(Vector2<float> const & v, float* out) const {
+            const float vx = v.x() * _unit();
+            const float vy = v.y() * _unit();
+            simd::for_each_pack<float>(size(), [&](auto p, size_t i) {
+                using P = decltype(p);
+                (simd::decode(P{}, _x.data() + i) * P::broadcast(vx) + simd::decode(P{}, _y.data() + i) * P::broadcast(vy)).store(out + i);
+            });
+        }
+
+        // Writes the squared distance of each vector to point to out.
+        void distances_squared(Vector2<float> const & point, float* out) const {
+            const float unit = _unit();
+            const float px = point.x() / unit;
+            const float py = point.y() / unit;
+            simd::for_each_pack<float>(size(), [&](auto p, size_t i) {
+                using P = decltype(p);
+                const P dx = simd::decode(P{}, _x.data() + i) - P::broadcast(px);
+                const P dy = simd::decode(P{}, _y.data() + i) - P::broadcast(py);
+                ((dx * dx + dy * dy) * P::broadcast(unit * unit)).store(out + i);
+            });
+        }
+    };
+}
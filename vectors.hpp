@@ -10,9 +10,22 @@
 #include <cmath>
 #include <random>
 #include <optional>
+#include <ostream>
+
+#include "fast_math.hpp"
+#include "instrumentation.hpp"
 
 namespace JMP
 {
+    template <typename T>
+    class Rotation2;
+
+    // The trigonometric and magnitude functions take an optional math policy, StdMath by
+    // default. Pass FastMath (see fast_math.hpp) to use polynomial approximations in hot paths:
+    //
+    // T length = v.magnitude<FastMath>();
+    // Vector2<T> r = v.rotate<FastMath>(angle);
+    //
     template <typename T, std::enable_if_t<std::is_floating_point<T>::value, bool> = true>
     class Vector2 {
     private:
@@ -27,8 +40,11 @@ namespace JMP
         static Vector2 Left() { return Vector2(-1, 0); }
 
         // Creates a vector with the given angle in radians and magnitude.
+        template <class Math = StdMath>
         static Vector2 AngleMagnitude(T angleRadians, T magnitude) {
-            return Vector2(std::cos(angleRadians) * magnitude, std::sin(angleRadians) * magnitude);
+            T s, c;
+            Math::sincos(angleRadians, s, c);
+            return Vector2(c * magnitude, s * magnitude);
         }
 
         // Generate a vector pointing in a random direction with a fixed length.
@@ -71,12 +87,14 @@ namespace JMP
             _y = y;
         }
 
+        template <class Math = StdMath>
         T magnitude() const {
-            return std::hypot(_x, _y);
+            return Math::hypot(_x, _y);
         }
 
+        template <class Math = StdMath>
         Vector2 normalized() const {
-            const T l = magnitude();
+            const T l = magnitude<Math>();
             if (l > 0) {
                 const T inv_l = 1 / l;
                 return Vector2(_x * inv_l, _y * inv_l);
@@ -90,12 +108,14 @@ namespace JMP
             return Vector2(-_y, _x);
         }
 
+        template <class Math = StdMath>
         T angle() const {
-            return std::atan2(_y, _x);
+            return Math::atan2(_y, _x);
         }
 
+        template <class Math = StdMath>
         void normalize() {
-            *this = this->normalized();
+            *this = this->template normalized<Math>();
         }
 
         Vector2 translate(T dx, T dy) const {
@@ -118,14 +138,20 @@ namespace JMP
             return Vector2(_x * scale, _y * scale);
         }
 
+        template <class Math = StdMath>
         T distance_to(Vector2 const & v) const {
-            return (v - *this).magnitude();
+            return (v - *this).template magnitude<Math>();
         }
 
         T dot(Vector2 const & v) const {
             return _x * v._x + _y * v._y;
         }
 
+        // The z component of the 3D cross product, positive when v points counterclockwise of this vector.
+        T cross(Vector2 const & v) const {
+            return _x * v._y - _y * v._x;
+        }
+
         T scalar_projection(Vector2 const & v) const {
             return dot(v.normalized());
         }
@@ -145,8 +171,13 @@ namespace JMP
             return *this - proj;
         }
 
+        // Rotates the vector counterclockwise. This applies a 2x2 rotation matrix; use Rotation2
+        // to rotate many vectors by the same angle without recomputing the sine and cosine.
+        template <class Math = StdMath>
         Vector2 rotate(T radians) const {
-            return Vector2::AngleMagnitude(angle() + radians, magnitude());
+            T s, c;
+            Math::sincos(radians, s, c);
+            return Vector2(c * _x - s * _y, s * _x + c * _y);
         }
 
         bool isNaN() const {
@@ -154,12 +185,111 @@ namespace JMP
         }
     };
 
+    // A precomputed rotation, stored as the cosine and sine of its angle.
+    template <typename T>
+    class Rotation2 {
+    private:
+        T _cos;
+        T _sin;
+    public:
+        static Rotation2 Identity() { return Rotation2(1, 0); }
+
+        // Creates a counterclockwise rotation by the given angle.
+        template <class Math = StdMath>
+        static Rotation2 Angle(T radians) {
+            T s, c;
+            Math::sincos(radians, s, c);
+            return Rotation2(c, s);
+        }
+
+        // Creates the rotation that maps the x axis onto the given direction.
+        static Rotation2 Direction(Vector2<T> const & direction) {
+            const Vector2<T> d = direction.normalized();
+            return Rotation2(d.x(), d.y());
+        }
+
+        Rotation2() : _cos(1), _sin(0) {}
+        Rotation2(T cosine, T sine) : _cos(cosine), _sin(sine) {}
+
+        T cos() const { return _cos; }
+        T sin() const { return _sin; }
+
+        template <class Math = StdMath>
+        T angle() const { return Math::atan2(_sin, _cos); }
+
+        Rotation2 inverse() const { return Rotation2(_cos, -_sin); }
+
+        // Composition: (a * b).apply(v) == a.apply(b.apply(v)).
+        Rotation2 operator*(Rotation2 const & r) const {
+            return Rotation2(_cos * r._cos - _sin * r._sin, _sin * r._cos + _cos * r._sin);
+        }
+
+        Vector2<T> apply(Vector2<T> const & v) const {
+            return Vector2<T>(_cos * v.x() - _sin * v.y(), _sin * v.x() + _cos * v.y());
+        }
+
+        Vector2<T> operator*(Vector2<T> const & v) const {
+            return apply(v);
+        }
+    };
+
     template <typename T>
     std::ostream& operator << ( std::ostream& outs, const Vector2<T> & v)
     {
         return outs << "(" << v.x() << "," << v.y() << ")";
     }
 
+    // A line segment between two points, e.g. a wall of a room.
+    template <typename T>
+    class Segment2 {
+    private:
+        Vector2<T> _a;
+        Vector2<T> _b;
+    public:
+        Segment2() = default;
+        Segment2(Vector2<T> const & a, Vector2<T> const & b) : _a(a), _b(b) {}
+
+        const Vector2<T>& start() const { return _a; }
+        const Vector2<T>& end() const { return _b; }
+
+        // Vector from the start to the end point.
+        Vector2<T> delta() const { return _b - _a; }
+
+        template <class Math = StdMath>
+        T length() const { return delta().template magnitude<Math>(); }
+
+        // Unit normal, pointing to the left when looking from the start to the end point.
+        template <class Math = StdMath>
+        Vector2<T> normal() const { return delta().tangent().template normalized<Math>(); }
+
+        // Signed distance of a point from the segment's line, times the segment length.
+        // Positive on the side the normal points to.
+        T side(Vector2<T> const & p) const { return delta().cross(p - _a); }
+
+        // Mirror image of a point across the segment's line.
+        Vector2<T> mirror(Vector2<T> const & p) const {
+            return _a + (p - _a).reflect(normal());
+        }
+
+        // Crossing with the segment from p to q. Returns the fraction of the way from p to q at
+        // which the segments cross, or an empty std::optional if they do not cross or are parallel.
+        std::optional<T> intersect(Vector2<T> const & p, Vector2<T> const & q) const {
+            const Vector2<T> d = q - p;
+            const Vector2<T> e = delta();
+            const T denom = d.cross(e);
+            if (denom == 0) {
+                return {};
+            }
+            const Vector2<T> w = _a - p;
+            const T t = w.cross(e) / denom;
+            const T u = w.cross(d) / denom;
+            if (t < 0 || t > 1 || u < 0 || u > 1) {
+                return {};
+            }
+            return t;
+        }
+    };
+
     template <typename T>
     class Ray2 {
     private:
@@ -169,6 +299,7 @@ namespace JMP
     public:
         Ray2() : _position(), _direction(1, 0), _length(0) {}
         Ray2(Vector2<T> const & position, Vector2<T> const & direction) : _position(position), _direction(direction), _length(0) {}
+        Ray2(Vector2<T> const & position, Vector2<T> const & direction, T length) : _position(position), _direction(direction), _length(length) {}
 
         const Vector2<T>& position() const { return _position; }
         const Vector2<T>& direction() const { return _direction; }
@@ -194,6 +325,7 @@ namespace JMP
         // Returns the closest point on a circle that intersects the ray.
         // Returns an empty std::optional if there is no intersection.
         std::optional<Vector2<T>> intersect_circle(Vector2<T> const & origin, T radius) const {
+            JMP_COUNT(INTERSECTION_TESTS, 1);
             Vector2<T> U = origin - _position;
             Vector2<T> U1 = U.project_on(_direction);
             Vector2<T> U2 = U - U1;
@@ -208,5 +340,42 @@ namespace JMP
 
             return p;
         }
+
+        // Returns the point where the ray crosses a segment, or an empty std::optional if it
+        // misses the segment or runs parallel to it.
+        std::optional<Vector2<T>> intersect_segment(Segment2<T> const & segment) const {
+            JMP_COUNT(INTERSECTION_TESTS, 1);
+            const Vector2<T> e = segment.delta();
+            const T denom = _direction.cross(e);
+            if (denom == 0) {
+                return {};
+            }
+            const Vector2<T> w = segment.start() - _position;
+            const T t = w.cross(e) / denom;
+            const T u = w.cross(_direction) / denom;
+            if (t < 0 || u < 0 || u > 1) {
+                return {};
+            }
+            return _position + _direction * t;
+        }
+
+        // Same as intersect_circle(), for rays whose direction is known to be unit length.
+        // The projection onto the direction is a single dot product, without normalizing the direction.
+        std::optional<Vector2<T>> intersect_circle_unit(Vector2<T> const & origin, T radius) const {
+            JMP_COUNT(INTERSECTION_TESTS, 1);
+            Vector2<T> U = origin - _position;
+            Vector2<T> U1 = _direction * U.dot(_direction);
+            Vector2<T> U2 = U - U1;
+            T d2 = U2.dot(U2);
+
+            if (d2 > radius * radius) {
+                return {};
+            }
+
+            T m = std::sqrt(radius * radius - d2);
+            Vector2<T> p = _position + U1 + _direction * m;
+
+            return p;
+        }
     };
 }
\ No newline at end of file
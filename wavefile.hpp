@@ -6,10 +6,35 @@
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <fstream>
+#include <limits>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <cerrno>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 #include "endians.hpp"
+#include "audio.hpp"
+#include "async_file.hpp"
 
 namespace JMP
 {
@@ -20,12 +45,71 @@ namespace JMP
 			PCM = 0x0001,
 			FLOAT = 0x0003,
 			ALAW = 0x0006,
-			MULAW = 0x0007
+			MULAW = 0x0007,
+			EXTENSIBLE = 0xFFFE
 		};
+
+		// Bit depth of Audio::sample_t: 64 with JMP_64_BIT_AUDIO, 32 otherwise. Files opened as
+		// AudioFormat::FLOAT with this depth accept sample_t buffers directly.
+		static constexpr uint16_t SAMPLE_BITS = sizeof(Audio::sample_t) * 8;
+
+		// Speaker assignment written to WAVE_FORMAT_EXTENSIBLE headers, following the usual
+		// layouts up to 7.1. Other channel counts are left unassigned.
+		static constexpr uint32_t default_channel_mask(uint16_t channels) noexcept
+		{
+			switch (channels) {
+			case 1: return 0x4;		// FC
+			case 2: return 0x3;		// FL FR
+			case 3: return 0x7;		// FL FR FC
+			case 4: return 0x33;	// FL FR BL BR
+			case 5: return 0x37;	// FL FR FC BL BR
+			case 6: return 0x3F;	// FL FR FC LFE BL BR
+			case 7: return 0x13F;	// FL FR FC LFE BL BR BC
+			case 8: return 0x63F;	// FL FR FC LFE BL BR SL SR
+			default: return 0;
+			}
+		}
+		// A read-only view over a contiguous range of samples, such as the samples stored in a
+		// file or one channel of planar audio. The view does not own the samples; views returned
+		// by a Reader are only valid while the Reader that created it is alive.
+		template <typename T>
+		class SampleView {
+		private:
+			T const* _data = nullptr;
+			size_t _size = 0;
+		public:
+			SampleView() = default;
+			SampleView(T const* data, size_t size) : _data(data), _size(size) {}
+			SampleView(std::vector<T> const& samples) : _data(samples.data()), _size(samples.size()) {}
+
+			T const* data() const noexcept { return _data; }
+			size_t size() const noexcept { return _size; }
+			bool empty() const noexcept { return _size == 0; }
+			T const* begin() const noexcept { return _data; }
+			T const* end() const noexcept { return _data + _size; }
+			T const& operator[](size_t i) const noexcept { return _data[i]; }
+		};
+
 	private:
 		using RiffID = BigEndian<uint32_t>;
 		using RiffVal_16 = LittleEndian<uint16_t>;
 		using RiffVal_32 = LittleEndian<uint32_t>;
+		// 64-bit ds64 values sit on 4-byte boundaries inside the packed header, so they are
+		// stored as two little-endian halves rather than a misaligned LittleEndian<uint64_t>.
+		struct RiffVal_64 {
+			RiffVal_32 lo = 0;
+			RiffVal_32 hi = 0;
+
+			constexpr RiffVal_64& operator=(uint64_t v) noexcept {
+				lo = static_cast<uint32_t>(v);
+				hi = static_cast<uint32_t>(v >> 32);
+				return *this;
+			}
+
+			constexpr operator uint64_t() const noexcept {
+				return (static_cast<uint64_t>(hi) << 32) | static_cast<uint32_t>(lo);
+			}
+		};
 
 		#pragma pack(push)
 		#pragma pack (2)
@@ -33,6 +117,15 @@ namespace JMP
 			RiffID riff_id = 'RIFF';
 			RiffVal_32 riff_chunk_size = 0;
 			RiffID wave_id = 'WAVE';
+			// Room for the RF64 ds64 chunk, only written when reserve_ds64 is set. It starts
+			// out as a JUNK chunk that readers skip and is turned into ds64 in place if the
+			// file outgrows the 32-bit chunk sizes (EBU Tech 3306, ITU-R BS.2088).
+			RiffID ds64_id = 'JUNK';
+			RiffVal_32 ds64_size = 28;
+			RiffVal_64 riff_size_64;
+			RiffVal_64 data_size_64;
+			RiffVal_64 sample_count_64;
+			RiffVal_32 table_length = 0;
 			RiffID fmt_id = 'fmt ';
 			RiffVal_32 fmt_size = 16;
 			RiffVal_16 audio_format = static_cast<uint16_t>(AudioFormat::PCM);
@@ -41,65 +134,974 @@ namespace JMP
 			RiffVal_32 byte_rate = 44100 * 2;
 			RiffVal_16 block_align = 2;
 			RiffVal_16 bits_per_sample = 16;
+			// WAVE_FORMAT_EXTENSIBLE fields, only written when fmt_size is 40. The sub format
+			// GUID is the format code followed by the fixed KSDATAFORMAT_SUBTYPE suffix.
+			RiffVal_16 extension_size = 22;
+			RiffVal_16 valid_bits_per_sample = 16;
+			RiffVal_32 channel_mask = 0;
+			RiffVal_16 sub_format = static_cast<uint16_t>(AudioFormat::PCM);
+			uint8_t sub_format_suffix[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
 			RiffID data_id = 'data';
 			RiffVal_32 data_chunk_size = 0;
+			// Not part of the file.
+			bool reserve_ds64 = false;
+
+			static constexpr size_t DS64_OFFSET = 12;
+			static constexpr size_t DS64_SIZE = 36;
+			static constexpr size_t EXTENSION_OFFSET = 72;
+			static constexpr size_t EXTENSION_SIZE = 24;
+			static constexpr size_t FILE_SIZE = 104;
+			// Chunk size written when the real size is in the ds64 chunk.
+			static constexpr uint32_t SIZE_IN_DS64 = 0xFFFFFFFF;
 
 			Header() = delete;
 
-			Header(uint16_t channels, uint32_t sr, uint16_t bit_depth, AudioFormat format, uint32_t sample_count)
+			// Files with more than two channels get a WAVE_FORMAT_EXTENSIBLE header. With
+			// reserve_ds64, or when the data does not fit in a plain RIFF file, the header
+			// includes the ds64 chunk. Header is a literal type, so the header of a fixed
+			// format can be built at compile time.
+			constexpr Header(uint16_t channels, uint32_t sr, uint16_t bit_depth, AudioFormat format, uint64_t sample_count, bool reserve = false)
 			{
 				num_channels = channels;
 				sample_rate = sr;
 				bits_per_sample = bit_depth;
 				audio_format = static_cast<uint16_t>(format);
+				if (channels > 2) {
+					fmt_size = 16 + EXTENSION_SIZE;
+					audio_format = static_cast<uint16_t>(AudioFormat::EXTENSIBLE);
+					valid_bits_per_sample = bit_depth;
+					channel_mask = default_channel_mask(channels);
+					sub_format = static_cast<uint16_t>(format);
+				}
 				const uint16_t bytes_per_sample = bits_per_sample >> 3;
 				block_align = num_channels * bytes_per_sample;
 				byte_rate = sample_rate * block_align;
-				data_chunk_size = sample_count * bytes_per_sample;
-				riff_chunk_size = sizeof(Header) + data_chunk_size - 8;
+				const uint64_t data_bytes = sample_count * bytes_per_sample;
+				reserve_ds64 = reserve || !_fits_riff(size() + data_bytes);
+				set_data_size(data_bytes);
+			}
+
+			constexpr bool extensible() const noexcept
+			{
+				return fmt_size != 16;
+			}
+
+			constexpr bool rf64() const noexcept
+			{
+				return riff_id == 'RF64';
+			}
+
+			// The sample format, looking through the extensible wrapper.
+			constexpr AudioFormat format() const noexcept
+			{
+				return static_cast<AudioFormat>(static_cast<uint16_t>(extensible() ? sub_format : audio_format));
+			}
+
+			// Number of bytes the header takes in the file.
+			constexpr size_t size() const noexcept
+			{
+				return FILE_SIZE - (reserve_ds64 ? 0 : DS64_SIZE) - (extensible() ? 0 : EXTENSION_SIZE);
+			}
+
+			// Copies the header as laid out in the file to out, which must hold FILE_SIZE
+			// bytes, and returns its size.
+			size_t serialize(char* out) const noexcept
+			{
+				char const* bytes = reinterpret_cast<char const*>(this);
+				const auto copy = [&](size_t first, size_t last) {
+					std::memcpy(out, bytes + first, last - first);
+					out += last - first;
+				};
+				copy(0, DS64_OFFSET);
+				copy(reserve_ds64 ? DS64_OFFSET : DS64_OFFSET + DS64_SIZE, EXTENSION_OFFSET);
+				copy(extensible() ? EXTENSION_OFFSET : EXTENSION_OFFSET + EXTENSION_SIZE, FILE_SIZE);
+				return size();
+			}
+
+			// Updates the chunk sizes for a data chunk of the given size in bytes. The RIFF
+			// size accounts for the pad byte that follows odd-sized chunks. Data that does not
+			// fit in 32-bit chunk sizes turns the file into RF64, which needs the ds64 chunk
+			// to be reserved; returns false if it is not.
+			constexpr bool set_data_size(uint64_t data_bytes) noexcept
+			{
+				const uint64_t riff_bytes = size() + data_bytes + (data_bytes & 1) - 8;
+				if (_fits_riff(riff_bytes + 8)) {
+					riff_id = 'RIFF';
+					ds64_id = 'JUNK';
+					riff_chunk_size = static_cast<uint32_t>(riff_bytes);
+					data_chunk_size = static_cast<uint32_t>(data_bytes);
+					return true;
+				}
+				if (!reserve_ds64) {
+					return false;
+				}
+				riff_id = 'RF64';
+				ds64_id = 'ds64';
+				riff_chunk_size = SIZE_IN_DS64;
+				data_chunk_size = SIZE_IN_DS64;
+				riff_size_64 = riff_bytes;
+				data_size_64 = data_bytes;
+				sample_count_64 = block_align > 0 ? data_bytes / block_align : 0;
+				return true;
+			}
+
+			bool write(std::ostream& out) const
+			{
+				char bytes[FILE_SIZE];
+				out.write(bytes, static_cast<std::streamsize>(serialize(bytes)));
+				return static_cast<bool>(out);
+			}
+
+		private:
+			// Whether a file of this many bytes can use the 32-bit RIFF sizes.
+			static constexpr bool _fits_riff(uint64_t file_bytes) noexcept
+			{
+				return file_bytes - 8 < SIZE_IN_DS64;
 			}
 		};
 		#pragma pack(pop)
+		static_assert(offsetof(Header, ds64_id) == Header::DS64_OFFSET && offsetof(Header, fmt_id) == Header::DS64_OFFSET + Header::DS64_SIZE
+			&& offsetof(Header, extension_size) == Header::EXTENSION_OFFSET && offsetof(Header, reserve_ds64) == Header::FILE_SIZE,
+			"Header must match the RF64 / WAVE_FORMAT_EXTENSIBLE file layout");
+		// Headers of fixed formats built by constant evaluation, so that the header code has to
+		// stay constexpr. The checks sit in a function body, the only place inside WaveFile
+		// where Header is complete enough to be evaluated.
+		static constexpr void _check_constant_headers() noexcept
+		{
+			constexpr Header stereo(2, 48000, 16, AudioFormat::PCM, 0);
+			static_assert(stereo.size() == 44 && !stereo.extensible() && !stereo.rf64(), "A stereo PCM header is the canonical 44 bytes");
+			constexpr Header surround(6, 48000, 24, AudioFormat::PCM, 0);
+			static_assert(surround.size() == 44 + Header::EXTENSION_SIZE && surround.extensible() && surround.format() == AudioFormat::PCM,
+				"More than two channels use WAVE_FORMAT_EXTENSIBLE");
+			constexpr Header large(2, 48000, 16, AudioFormat::PCM, uint64_t(1) << 31);
+			static_assert(large.rf64() && large.size() == 44 + Header::DS64_SIZE, "Data past 4 GB makes an RF64 header with a ds64 chunk");
+			constexpr Header reserved(2, 48000, 64, AudioFormat::FLOAT, 0, true);
+			static_assert(reserved.size() % sizeof(double) == 0, "64-bit samples need their data 8-byte aligned");
+		}
 
+		// Whether T is a sample type the static write functions store as is: unsigned 8-bit and
+		// signed 16/32-bit PCM, or 32/64-bit FLOAT.
 		template <typename T>
-		static inline bool _write_file(std::string const& filename, Header const& header, std::vector<T> const& samples)
-		{
-			std::ofstream out_stream(filename, std::ios::binary);
-			if (out_stream) {
-				out_stream.write(reinterpret_cast<char const*>(&header), static_cast<std::streamsize>(sizeof(header)));
-				
-				const std::streamsize sample_bytes = static_cast<std::streamsize>(sizeof(T)) * static_cast<std::streamsize>(samples.size());
-				out_stream.write(reinterpret_cast<char const*>(&samples.front()), sample_bytes);
-				out_stream.close();
+		static constexpr bool _is_stored_sample() noexcept
+		{
+			return std::is_same<T, uint8_t>::value || std::is_same<T, int16_t>::value || std::is_same<T, int32_t>::value
+				|| std::is_same<T, float>::value || std::is_same<T, double>::value;
+		}
+
+		// Writes the header followed by the parts of the data chunk and the pad byte that
+		// follows odd-sized chunks. On POSIX systems the parts go straight from the caller's
+		// buffers to the file through writev(), without copying or allocating.
+		// Whether the header of the static writers reserves the ds64 chunk for samples of T.
+		// With the ds64 (or JUNK) chunk the data starts at 80, or 104 when extensible, both
+		// multiples of 8, so that Reader can map 64-bit samples in place; without it the data
+		// is 4 bytes off.
+		template <typename T>
+		static constexpr bool _reserve_ds64() noexcept
+		{
+			return sizeof(T) == 8;
+		}
+
+		template <typename T>
+		static bool _write_file(std::string const& filename, Header const& header, SampleView<T> const* parts, size_t part_count) noexcept
+		{
+			JMP_TRACE_SCOPE("WaveFile::_write_file");
+			char header_bytes[Header::FILE_SIZE];
+			const size_t header_size = header.serialize(header_bytes);
+			uint64_t data_bytes = 0;
+			for (size_t i = 0; i < part_count; ++i) {
+				data_bytes += sizeof(T) * static_cast<uint64_t>(parts[i].size());
+			}
+			JMP_COUNT(BYTES_WRITTEN, header_size + data_bytes + (data_bytes & 1));
+			const char pad = 0;
+#ifdef _WIN32
+			const HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			const auto put = [file](void const* data, uint64_t bytes) {
+				char const* next = static_cast<char const*>(data);
+				while (bytes > 0) {
+					DWORD written = 0;
+					const DWORD chunk = static_cast<DWORD>(std::min<uint64_t>(bytes, 1u << 30));
+					if (!WriteFile(file, next, chunk, &written, nullptr) || written == 0) {
+						return false;
+					}
+					next += written;
+					bytes -= written;
+				}
 				return true;
+			};
+			bool ok = put(header_bytes, header_size);
+			for (size_t i = 0; ok && i < part_count; ++i) {
+				ok = put(parts[i].data(), sizeof(T) * static_cast<uint64_t>(parts[i].size()));
+			}
+			if (ok && (data_bytes & 1)) {
+				ok = put(&pad, 1);
 			}
-			else {
+			return CloseHandle(file) && ok;
+#else
+			const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd < 0) {
 				return false;
 			}
+			// Parts are gathered a batch at a time so any number of them fits on the stack.
+			constexpr size_t BATCH = 64;
+			iovec batch[BATCH];
+			size_t queued = 0;
+			bool ok = true;
+			const auto queue = [&](void const* data, size_t bytes) {
+				if (bytes == 0 || !ok) {
+					return;
+				}
+				batch[queued].iov_base = const_cast<void*>(data);
+				batch[queued].iov_len = bytes;
+				if (++queued == BATCH) {
+					ok = _writev_all(fd, batch, queued);
+					queued = 0;
+				}
+			};
+			queue(header_bytes, header_size);
+			for (size_t i = 0; i < part_count; ++i) {
+				queue(parts[i].data(), sizeof(T) * parts[i].size());
+			}
+			if (data_bytes & 1) {
+				queue(&pad, 1);
+			}
+			if (ok && queued > 0) {
+				ok = _writev_all(fd, batch, queued);
+			}
+			return ::close(fd) == 0 && ok;
+#endif
 		}
 
+#ifndef _WIN32
+		// Writes all of iov, resuming after short writes. The entries are consumed in the process.
+		static bool _writev_all(int fd, iovec* iov, size_t count) noexcept
+		{
+			while (count > 0) {
+				const ssize_t written = ::writev(fd, iov, static_cast<int>(count));
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					return false;
+				}
+				size_t remaining = static_cast<size_t>(written);
+				while (count > 0 && remaining >= iov->iov_len) {
+					remaining -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count > 0) {
+					iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+					iov->iov_len -= remaining;
+				}
+			}
+			return true;
+		}
+#endif
+
+		// Blocking output through std::ofstream, the default sink of Writer.
+		class StreamSink {
+		private:
+			std::ofstream _stream;
+		public:
+			struct Options {};
+
+			StreamSink(std::string const& filename, Options) : _stream(filename, std::ios::binary) {}
+
+			bool is_open() const noexcept
+			{
+				return _stream.is_open();
+			}
+
+			bool write(void const* data, size_t bytes)
+			{
+				_stream.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+				return static_cast<bool>(_stream);
+			}
+
+			bool write_at(uint64_t offset, void const* data, size_t bytes)
+			{
+				_stream.seekp(static_cast<std::streamoff>(offset));
+				return write(data, bytes);
+			}
+
+			bool close()
+			{
+				_stream.close();
+				return !_stream.fail();
+			}
+		};
+
 	public:
 		WaveFile() = delete;
 
+		// Streams interleaved samples to a WAV file block by block, so that the
+		// whole signal never needs to be held in memory. The header is written
+		// with empty chunk sizes when the file is opened and patched on close.
+		// Room for an RF64 ds64 chunk is reserved up front, so if the data grows past
+		// 4 GB the file is promoted to RF64 on close without moving the samples.
+		//
+		// Writer blocks while the data is written. AsyncWriter hands the data to a
+		// background I/O thread through a pool of buffers instead (see AsyncFile), and
+		// takes the pool configuration as an extra constructor argument.
+		// Usage:
+		//
+		// WaveFile::Writer writer("out.wav", 2, 48000, WaveFile::AudioFormat::FLOAT, 32);
+		// while (render(block)) {
+		//     writer.write(block);
+		// }
+		// writer.close(); // Or let the destructor close the file.
+		//
+		template <class Sink>
+		class BasicWriter {
+		private:
+			Sink _sink;
+			Header _header;
+			uint64_t _data_bytes = 0;
+			bool _good = false;
+
+			std::vector<uint8_t> _packed;
+			std::vector<float const*> _planar;
+			std::vector<float> _interleaved;
+			std::vector<uint64_t> _converted;
+
+			static constexpr size_t PACK_BLOCK = 4096;
+
+			bool _accepts(uint16_t bit_depth, AudioFormat format) const noexcept
+			{
+				return _good && _header.bits_per_sample == bit_depth && _header.format() == format;
+			}
+
+			bool _write_bytes(void const* data, uint64_t bytes) noexcept
+			{
+				if (bytes > 0) {
+					if (!_sink.write(data, static_cast<size_t>(bytes))) {
+						_good = false;
+						return false;
+					}
+					JMP_COUNT(BYTES_WRITTEN, bytes);
+					_data_bytes += bytes;
+				}
+				return true;
+			}
+
+			template <typename T>
+			bool _append(T const* samples, size_t count, uint16_t bit_depth, AudioFormat format) noexcept
+			{
+				const uint64_t block_bytes = static_cast<uint64_t>(sizeof(T)) * count;
+				if (!_accepts(bit_depth, format)) {
+					return false;
+				}
+				return _write_bytes(samples, block_bytes);
+			}
+
+			bool _append_int24(int32_t const* samples, size_t count) noexcept
+			{
+				if (!_accepts(24, AudioFormat::PCM)) {
+					return false;
+				}
+				if (_packed.size() < 3 * PACK_BLOCK) {
+					_packed.resize(3 * PACK_BLOCK);
+				}
+				for (size_t i = 0; i < count; i += PACK_BLOCK) {
+					const size_t n = std::min(PACK_BLOCK, count - i);
+					Audio::pack_int24(samples + i, _packed.data(), n);
+					if (!_write_bytes(_packed.data(), 3 * static_cast<uint64_t>(n))) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			// Interleaves count samples of the channels in _planar and appends them in the file format.
+			bool _append_planar(size_t count) noexcept
+			{
+				const size_t channels = _planar.size();
+				const size_t frames = count / channels;
+				if (_converted.size() < count) {
+					_converted.resize(count);
+				}
+				// _converted is 8-byte aligned scratch for whichever sample type the format needs.
+				void* converted = _converted.data();
+				if (_header.format() == AudioFormat::PCM && _header.bits_per_sample == 16) {
+					int16_t* pcm = static_cast<int16_t*>(converted);
+					Audio::interleave(_planar.data(), channels, pcm, frames);
+					return write(pcm, count);
+				}
+
+				if (_interleaved.size() < count) {
+					_interleaved.resize(count);
+				}
+				float* interleaved = _interleaved.data();
+				Audio::interleave(_planar.data(), channels, interleaved, frames);
+				if (_header.format() == AudioFormat::FLOAT) {
+					if (_header.bits_per_sample == 64) {
+						double* wide = static_cast<double*>(converted);
+						std::copy(interleaved, interleaved + count, wide);
+						return write(wide, count);
+					}
+					return write(interleaved, count);
+				}
+				if (_header.bits_per_sample == 8) {
+					uint8_t* pcm = static_cast<uint8_t*>(converted);
+					Audio::convert(interleaved, pcm, count);
+					return write(pcm, count);
+				}
+				int32_t* pcm = static_cast<int32_t*>(converted);
+				Audio::convert(interleaved, pcm, count, _header.bits_per_sample);
+				return write(pcm, count);
+			}
+
+		public:
+			BasicWriter() = delete;
+			BasicWriter(BasicWriter const&) = delete;
+			BasicWriter& operator=(BasicWriter const&) = delete;
+			BasicWriter(BasicWriter&&) = default;
+
+			// Closes the file written so far, finishing its header, before taking over other.
+			BasicWriter& operator=(BasicWriter&& other)
+			{
+				if (this != &other) {
+					close();
+					_sink = std::move(other._sink);
+					_header = other._header;
+					_data_bytes = other._data_bytes;
+					_good = other._good;
+					_packed = std::move(other._packed);
+					_planar = std::move(other._planar);
+					_interleaved = std::move(other._interleaved);
+					_converted = std::move(other._converted);
+					other._good = false;
+				}
+				return *this;
+			}
+
+			// Opens the file and writes a placeholder header. Check is_open() before writing.
+			// PCM files take 8, 16, 24 or 32 bits and FLOAT files 32 or 64 bits per sample.
+			// Files with more than two channels get a WAVE_FORMAT_EXTENSIBLE header with the
+			// default_channel_mask() speaker layout.
+			BasicWriter(std::string const& filename, uint16_t channels, uint32_t sample_rate, AudioFormat format = AudioFormat::PCM,
+				uint16_t bit_depth = 16, typename Sink::Options options = {}) noexcept
+				: _sink(filename, options), _header(channels, sample_rate, bit_depth, format, 0, true)
+			{
+				if (_sink.is_open()) {
+					char bytes[Header::FILE_SIZE];
+					_good = _sink.write(bytes, _header.serialize(bytes));
+				}
+			}
+
+			~BasicWriter()
+			{
+				close();
+			}
+
+			bool is_open() const noexcept
+			{
+				return _sink.is_open();
+			}
+
+			// Number of interleaved samples written so far.
+			uint64_t sample_count() const noexcept
+			{
+				return _header.bits_per_sample >= 8 ? _data_bytes / (_header.bits_per_sample >> 3) : 0;
+			}
+
+			// Append interleaved samples. The sample type must match the format the file was opened with.
+			bool write(uint8_t const* samples, size_t count) noexcept
+			{
+				return _append(samples, count, 8, AudioFormat::PCM);
+			}
+
+			// Append interleaved samples. The sample type must match the format the file was opened with.
+			bool write(int16_t const* samples, size_t count) noexcept
+			{
+				return _append(samples, count, 16, AudioFormat::PCM);
+			}
+
+			// Append interleaved samples. For 24-bit files the low 24 bits of each sample are
+			// packed, so samples must be in [-2^23, 2^23), see Audio::convert(..., 24).
+			bool write(int32_t const* samples, size_t count) noexcept
+			{
+				if (_header.bits_per_sample == 24) {
+					return _append_int24(samples, count);
+				}
+				return _append(samples, count, 32, AudioFormat::PCM);
+			}
+
+			// Append interleaved samples. The sample type must match the format the file was opened with.
+			bool write(float const* samples, size_t count) noexcept
+			{
+				return _append(samples, count, 32, AudioFormat::FLOAT);
+			}
+
+			// Append interleaved samples. The sample type must match the format the file was opened with.
+			bool write(double const* samples, size_t count) noexcept
+			{
+				return _append(samples, count, 64, AudioFormat::FLOAT);
+			}
+
+			// Append planar samples, one view of the same length per channel of the file. The
+			// samples are interleaved and converted to the file format block by block, with
+			// 16-bit PCM converted while interleaving (see Audio::interleave()).
+			bool write(SampleView<float> const* channels, size_t channel_count) noexcept
+			{
+				if (!_good || channel_count == 0 || channel_count != _header.num_channels) {
+					return false;
+				}
+				const size_t frames = channels[0].size();
+				for (size_t c = 1; c < channel_count; ++c) {
+					if (channels[c].size() != frames) {
+						return false;
+					}
+				}
+
+				_planar.resize(channel_count);
+				const size_t block = std::max<size_t>(1, PACK_BLOCK / channel_count);
+				for (size_t begin = 0; begin < frames; begin += block) {
+					const size_t n = std::min(block, frames - begin);
+					for (size_t c = 0; c < channel_count; ++c) {
+						_planar[c] = channels[c].data() + begin;
+					}
+					if (!_append_planar(n * channel_count)) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			template <typename T>
+			bool write(std::vector<T> const& samples) noexcept
+			{
+				return write(samples.data(), samples.size());
+			}
+
+			// Pads the data chunk if needed, patches the chunk sizes in the header and closes the file.
+			// Returns false if any write failed. Calling close() more than once is harmless.
+			bool close() noexcept
+			{
+				if (!_sink.is_open()) {
+					return false;
+				}
+
+				bool ok = _good;
+				if (ok) {
+					const char pad = 0;
+					_header.set_data_size(_data_bytes);
+					char bytes[Header::FILE_SIZE];
+					ok = ((_data_bytes & 1) == 0 || _sink.write(&pad, 1)) && _sink.write_at(0, bytes, _header.serialize(bytes));
+				}
+				_good = false;
+				return _sink.close() && ok;
+			}
+		};
+
+		using Writer = BasicWriter<StreamSink>;
+		using AsyncWriter = BasicWriter<AsyncFile>;
+
+		// Memory-maps a WAV file and exposes its samples without copying them.
+		// Only the chunk headers are parsed on open, so opening takes the same time
+		// regardless of file size and pages are loaded lazily as samples are accessed.
+		// Usage:
+		//
+		// WaveFile::Reader reader("in.wav");
+		// auto samples = reader.samples<int16_t>();
+		// for (int16_t s : samples) { ... }
+		//
+		class Reader {
+		private:
+			uint8_t const* _map = nullptr;
+			size_t _map_size = 0;
+#ifdef _WIN32
+			HANDLE _file = INVALID_HANDLE_VALUE;
+			HANDLE _mapping = nullptr;
+#else
+			int _fd = -1;
+#endif
+			size_t _data_offset = 0;
+			size_t _data_size = 0;
+			uint16_t _audio_format = 0;
+			uint16_t _num_channels = 0;
+			uint32_t _sample_rate = 0;
+			uint16_t _bits_per_sample = 0;
+			uint16_t _valid_bits_per_sample = 0;
+			uint32_t _channel_mask = 0;
+
+			template <typename W>
+			W _read(size_t offset) const noexcept
+			{
+				W value;
+				std::memcpy(&value, _map + offset, sizeof(W));
+				return value;
+			}
+
+			bool _map_file(std::string const& filename) noexcept
+			{
+#ifdef _WIN32
+				_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (_file == INVALID_HANDLE_VALUE) {
+					return false;
+				}
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+					return false;
+				}
+				_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (_mapping == nullptr) {
+					return false;
+				}
+				_map = static_cast<uint8_t const*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+				_map_size = static_cast<size_t>(size.QuadPart);
+#else
+				_fd = ::open(filename.c_str(), O_RDONLY);
+				if (_fd < 0) {
+					return false;
+				}
+				struct stat st;
+				if (::fstat(_fd, &st) != 0 || st.st_size <= 0) {
+					return false;
+				}
+				void* map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, _fd, 0);
+				if (map == MAP_FAILED) {
+					return false;
+				}
+				_map = static_cast<uint8_t const*>(map);
+				_map_size = static_cast<size_t>(st.st_size);
+#endif
+				return _map != nullptr;
+			}
+
+			void _unmap() noexcept
+			{
+#ifdef _WIN32
+				if (_map) UnmapViewOfFile(_map);
+				if (_mapping) CloseHandle(_mapping);
+				if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+				_mapping = nullptr;
+				_file = INVALID_HANDLE_VALUE;
+#else
+				if (_map) ::munmap(const_cast<uint8_t*>(_map), _map_size);
+				if (_fd >= 0) ::close(_fd);
+				_fd = -1;
+#endif
+				_map = nullptr;
+				_map_size = 0;
+				_data_offset = 0;
+				_data_size = 0;
+			}
+
+			// Walks the RIFF chunks looking for the fmt and data chunks. RF64 and BW64 files
+			// keep the real data size in the ds64 chunk.
+			bool _parse() noexcept
+			{
+				if (_map_size < 12 || _read<RiffID>(8) != 'WAVE') {
+					return false;
+				}
+				const uint32_t riff = _read<RiffID>(0);
+				const bool rf64 = riff == 'RF64' || riff == 'BW64';
+				if (riff != 'RIFF' && !rf64) {
+					return false;
+				}
+
+				bool have_fmt = false;
+				bool have_data = false;
+				uint64_t data_size_64 = 0;
+				size_t offset = 12;
+				while (offset + 8 <= _map_size && !(have_fmt && have_data)) {
+					const uint32_t id = _read<RiffID>(offset);
+					uint64_t size = _read<RiffVal_32>(offset + 4);
+					const size_t body = offset + 8;
+					const size_t available = _map_size - body;
+
+					if (id == 'ds64' && rf64) {
+						if (size < 28 || available < 28) {
+							return false;
+						}
+						data_size_64 = _read<RiffVal_64>(body + 8);
+					}
+					else if (id == 'fmt ') {
+						if (size < 16 || available < 16) {
+							return false;
+						}
+						_audio_format = _read<RiffVal_16>(body);
+						_num_channels = _read<RiffVal_16>(body + 2);
+						_sample_rate = _read<RiffVal_32>(body + 4);
+						_bits_per_sample = _read<RiffVal_16>(body + 14);
+						_valid_bits_per_sample = _bits_per_sample;
+						_channel_mask = 0;
+						if (_audio_format == static_cast<uint16_t>(AudioFormat::EXTENSIBLE)) {
+							if (size < 16 + Header::EXTENSION_SIZE || available < 16 + Header::EXTENSION_SIZE) {
+								return false;
+							}
+							_valid_bits_per_sample = _read<RiffVal_16>(body + 18);
+							_channel_mask = _read<RiffVal_32>(body + 20);
+							_audio_format = _read<RiffVal_16>(body + 24);
+						}
+						have_fmt = true;
+					}
+					else if (id == 'data') {
+						if (rf64 && size == Header::SIZE_IN_DS64) {
+							size = data_size_64;
+						}
+						// Files that were not closed properly may have a missing or bogus size.
+						_data_offset = body;
+						_data_size = size == 0 || size > available ? available : static_cast<size_t>(size);
+						have_data = true;
+					}
+
+					if (size > available) {
+						break;
+					}
+					// Chunks are padded to an even size.
+					offset = body + static_cast<size_t>(size) + static_cast<size_t>(size & 1);
+				}
+				return have_fmt && have_data;
+			}
+
+			void _move_from(Reader& other) noexcept
+			{
+				_map = other._map;
+				_map_size = other._map_size;
+#ifdef _WIN32
+				_file = other._file;
+				_mapping = other._mapping;
+				other._file = INVALID_HANDLE_VALUE;
+				other._mapping = nullptr;
+#else
+				_fd = other._fd;
+				other._fd = -1;
+#endif
+				_data_offset = other._data_offset;
+				_data_size = other._data_size;
+				_audio_format = other._audio_format;
+				_num_channels = other._num_channels;
+				_sample_rate = other._sample_rate;
+				_bits_per_sample = other._bits_per_sample;
+				_valid_bits_per_sample = other._valid_bits_per_sample;
+				_channel_mask = other._channel_mask;
+				other._map = nullptr;
+				other._map_size = 0;
+			}
+
+		public:
+			Reader() = default;
+			Reader(Reader const&) = delete;
+			Reader& operator=(Reader const&) = delete;
+
+			Reader(Reader&& other) noexcept
+			{
+				_move_from(other);
+			}
+
+			Reader& operator=(Reader&& other) noexcept
+			{
+				if (this != &other) {
+					_unmap();
+					_move_from(other);
+				}
+				return *this;
+			}
+
+			// Maps the file and parses its header. Check is_open() before reading samples.
+			explicit Reader(std::string const& filename) noexcept
+			{
+				open(filename);
+			}
+
+			~Reader()
+			{
+				_unmap();
+			}
+
+			bool open(std::string const& filename) noexcept
+			{
+				_unmap();
+				if (!_map_file(filename) || !_parse()) {
+					_unmap();
+					return false;
+				}
+				return true;
+			}
+
+			void close() noexcept
+			{
+				_unmap();
+			}
+
+			bool is_open() const noexcept { return _map != nullptr; }
+
+			// The sample format. For WAVE_FORMAT_EXTENSIBLE files this is the sub format.
+			AudioFormat format() const noexcept { return static_cast<AudioFormat>(_audio_format); }
+			uint16_t channels() const noexcept { return _num_channels; }
+			uint32_t sample_rate() const noexcept { return _sample_rate; }
+			// Size of each sample in the file, of which valid_bits_per_sample() are significant.
+			uint16_t bits_per_sample() const noexcept { return _bits_per_sample; }
+			uint16_t valid_bits_per_sample() const noexcept { return _valid_bits_per_sample; }
+			// Speaker assignment of WAVE_FORMAT_EXTENSIBLE files, 0 otherwise.
+			uint32_t channel_mask() const noexcept { return _channel_mask; }
+
+			// Number of interleaved samples in the data chunk.
+			size_t sample_count() const noexcept
+			{
+				return _bits_per_sample >= 8 ? _data_size / (_bits_per_sample >> 3) : 0;
+			}
+
+			// Number of sample frames (samples per channel).
+			size_t frame_count() const noexcept
+			{
+				return _num_channels > 0 ? sample_count() / _num_channels : 0;
+			}
+
+			// Raw bytes of the data chunk.
+			SampleView<uint8_t> data() const noexcept
+			{
+				return SampleView<uint8_t>(_map ? _map + _data_offset : nullptr, _data_size);
+			}
+
+			// Returns a view over the samples of the data chunk. The view is empty if T does
+			// not match the sample format of the file, or if the data chunk is not suitably
+			// aligned for T in the file. Sample values are in the file's (little-endian) byte order.
+			template <typename T>
+			SampleView<T> samples() const noexcept
+			{
+				constexpr AudioFormat expected = std::is_floating_point<T>::value ? AudioFormat::FLOAT : AudioFormat::PCM;
+				const bool signedness_ok = std::is_floating_point<T>::value || (sizeof(T) == 1) == std::is_unsigned<T>::value;
+				if (!_map || format() != expected || _bits_per_sample != sizeof(T) * 8 || !signedness_ok) {
+					return {};
+				}
+				uint8_t const* first = _map + _data_offset;
+				if (reinterpret_cast<uintptr_t>(first) % alignof(T) != 0) {
+					return {};
+				}
+				return SampleView<T>(reinterpret_cast<T const*>(first), _data_size / sizeof(T));
+			}
+		};
+
+		// Output samples to a WAV file in the format of their type: unsigned 8-bit, 16-bit or
+		// 32-bit PCM, or 32-bit or 64-bit FLOAT. The parts are written back to back as a single
+		// data chunk straight from the caller's buffers, gathered into as few writev() calls as
+		// possible on POSIX systems, so the samples are neither copied nor allocated.
+		template <typename T>
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, SampleView<T> const* parts, size_t part_count) noexcept
+		{
+			static_assert(_is_stored_sample<T>(), "Samples must be uint8_t, int16_t, int32_t, float or double.");
+			uint64_t sample_count = 0;
+			for (size_t i = 0; i < part_count; ++i) {
+				sample_count += parts[i].size();
+			}
+			const AudioFormat format = std::is_floating_point<T>::value ? AudioFormat::FLOAT : AudioFormat::PCM;
+			const Header header(channels, sample_rate, static_cast<uint16_t>(8 * sizeof(T)), format, sample_count, _reserve_ds64<T>());
+			return _write_file(filename, header, parts, part_count);
+		}
+
+		// Output samples to a WAV file in the format of their type, see above.
+		template <typename T>
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, T const* samples, size_t count) noexcept
+		{
+			const SampleView<T> part(samples, count);
+			return write(filename, channels, sample_rate, &part, 1);
+		}
+
+		// One of the files written by write_batch(): its name and interleaved samples.
+		template <typename T>
+		struct BatchFile {
+			std::string filename;
+			SampleView<T> samples;
+		};
+
+		// Writes many short files with the same format, such as debug dumps or sliced stems.
+		// The header is built once and only its size fields are patched for each file, and
+		// each file is written with one gathered write of header and samples. Returns the
+		// number of files written; if it is less than file_count, writing files[result] failed.
+		template <typename T>
+		static size_t write_batch(uint16_t channels, uint32_t sample_rate, BatchFile<T> const* files, size_t file_count) noexcept
+		{
+			static_assert(_is_stored_sample<T>(), "Samples must be uint8_t, int16_t, int32_t, float or double.");
+			const AudioFormat format = std::is_floating_point<T>::value ? AudioFormat::FLOAT : AudioFormat::PCM;
+			const Header base(channels, sample_rate, static_cast<uint16_t>(8 * sizeof(T)), format, 0, _reserve_ds64<T>());
+			for (size_t i = 0; i < file_count; ++i) {
+				Header header = base;
+				if (!header.set_data_size(sizeof(T) * static_cast<uint64_t>(files[i].samples.size()))) {
+					// Too large for the template, which has no room for the ds64 chunk.
+					header = Header(channels, sample_rate, static_cast<uint16_t>(8 * sizeof(T)), format, files[i].samples.size(), true);
+				}
+				if (!_write_file(files[i].filename, header, &files[i].samples, 1)) {
+					return i;
+				}
+			}
+			return file_count;
+		}
+
+		template <typename T>
+		static size_t write_batch(uint16_t channels, uint32_t sample_rate, std::vector<BatchFile<T>> const& files) noexcept
+		{
+			return write_batch(channels, sample_rate, files.data(), files.size());
+		}
+
+		// Output samples to a WAV file as 24-bit or 32-bit PCM. For 24-bit output the samples
+		// must be in [-2^23, 2^23) and are packed to three bytes each, which goes through a
+		// Writer and so allocates its packing buffer.
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, SampleView<int32_t> const* parts, size_t part_count,
+			uint16_t bit_depth = 32) noexcept
+		{
+			if (bit_depth == 24) {
+				Writer writer(filename, channels, sample_rate, AudioFormat::PCM, 24);
+				bool ok = true;
+				for (size_t i = 0; ok && i < part_count; ++i) {
+					ok = writer.write(parts[i].data(), parts[i].size());
+				}
+				return writer.close() && ok;
+			}
+			return write<int32_t>(filename, channels, sample_rate, parts, part_count);
+		}
+
+		// Output samples to a WAV file as 24-bit or 32-bit PCM, see above.
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, int32_t const* samples, size_t count,
+			uint16_t bit_depth = 32) noexcept
+		{
+			const SampleView<int32_t> part(samples, count);
+			return write(filename, channels, sample_rate, &part, 1, bit_depth);
+		}
+
 		// Output samples to a WAV file.
 		static bool write(std::string const & filename, uint16_t channels, uint32_t sample_rate, std::vector<uint8_t> const& samples) noexcept 
 		{
-			const Header header(channels, sample_rate, 8, AudioFormat::PCM, samples.size());
-			return _write_file(filename, header, samples);
+			return write(filename, channels, sample_rate, samples.data(), samples.size());
 		}
 
 		// Output samples to a WAV file.
 		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, std::vector<int16_t> const& samples) noexcept 
 		{
-			const Header header(channels, sample_rate, 16, AudioFormat::PCM, samples.size());
-			return _write_file(filename, header, samples);
+			return write(filename, channels, sample_rate, samples.data(), samples.size());
+		}
+
+		// Output samples to a WAV file as 24-bit or 32-bit PCM. For 24-bit output the samples
+		// must be in [-2^23, 2^23) and are packed to three bytes each.
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, std::vector<int32_t> const& samples, uint16_t bit_depth = 32) noexcept
+		{
+			return write(filename, channels, sample_rate, samples.data(), samples.size(), bit_depth);
 		}
 
 		// Output samples to a WAV file.
 		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, std::vector<float> const& samples) noexcept 
 		{
-			const Header header(channels, sample_rate, 32, AudioFormat::FLOAT, samples.size());
-			return _write_file(filename, header, samples);
+			return write(filename, channels, sample_rate, samples.data(), samples.size());
+		}
+
+		// Output samples to a WAV file.
+		static bool write(std::string const& filename, uint16_t channels, uint32_t sample_rate, std::vector<double> const& samples) noexcept
+		{
+			return write(filename, channels, sample_rate, samples.data(), samples.size());
+		}
+
+		// Output planar samples, one view of the same length per channel, to a WAV file in the
+		// given format. The channels are interleaved while the file is written.
+		static bool write(std::string const& filename, uint32_t sample_rate, std::vector<SampleView<float>> const& channels,
+			AudioFormat format = AudioFormat::PCM, uint16_t bit_depth = 16) noexcept
+		{
+			Writer writer(filename, static_cast<uint16_t>(channels.size()), sample_rate, format, bit_depth);
+			return writer.write(channels) && writer.close();
 		}
 	};
 }
\ No newline at end of file